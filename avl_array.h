@@ -27,9 +27,17 @@
 // avl_array combines the insert/delete and find advantages (log n) of an AVL tree
 // with a static allocated arrays and minimal storage overhead.
 // If memory is critical the 'Fast' template parameter can be set to false which
-// removes the parent member of every node. This saves sizeof(size_type) * Size bytes,
-// but slowes down the insert and delete operation by factor 10 due to 'parent search'.
+// removes the parent member of every node. This saves sizeof(size_type) * Size bytes.
+// Insert and delete then keep the path from root on a small stack instead, so they
+// stay nearly as fast. Only erasing needs up to two additional searches from root.
 // The find opeartion is not affected cause finding doesn't need a parent.
+// Iterators don't need the parent either, they keep the path to their node.
+// The 'Layout' template parameter selects how the node members are arranged in
+// memory, see avl_array_layout_soa, avl_array_layout_blocked and
+// avl_array_layout_compact below.
+// If the 'Ranked' template parameter is set to true, every node stores the size
+// of its subtree (sizeof(size_type) * Size bytes). This allows select(), rank()
+// and iterator advancing in O(log n).
 //
 // usage:
 // #include "avl_array.h"
@@ -41,371 +49,2259 @@
 #ifndef _AVL_ARRAY_H_
 #define _AVL_ARRAY_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 
 /**
- * \param Key The key type. The type (class) must provide a 'less than' and 'equal to' operator
- * \param T The Data type
- * \param size_type Container size type
- * \param Size Container size
- * \param Fast If true every node stores an extra parent index. This increases memory but speed up insert/erase by factor 10
+ * Single read of a value which may be written concurrently, see avl_array::find_bounded()
+ * A relaxed atomic load (volatile read without GCC/Clang builtins). The compiler can't read the value
+ * a second time, so an index which passed a range check can't be replaced by a newer, unchecked one.
  */
-template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast = true>
-class avl_array
+template<typename Type>
+inline Type avl_array_load_once(const Type& value)
 {
-  // child index pointer class
-  typedef struct tag_child_type {
-    size_type left;
-    size_type right;
-  } child_type;
-
-  // node storage, due to possible structure packing effects, single arrays are used instead of a 'node' structure
-  Key         key_[Size];                 // node key
-  T           val_[Size];                 // node value
-  std::int8_t balance_[Size];             // subtree balance
-  child_type  child_[Size];               // node childs
-  size_type   size_;                      // actual size
-  size_type   root_;                      // root node
-  size_type   parent_[Fast ? Size : 1];   // node parent, use one element if not needed (zero sized array is not allowed)
- 
-  // invalid index (like 'nullptr' in a pointer implementation)
-  static const size_type INVALID_IDX = Size;
+#if defined(__GNUC__)
+  return __atomic_load_n(&value, __ATOMIC_RELAXED);
+#else
+  return *static_cast<const volatile Type*>(&value);
+#endif
+}
+
+
+/**
+ * Relocation of array elements
+ * Used by allocation policies which move an array to grow or shrink it. The living elements [0, live)
+ * of type Type, kept in (raw) storage of type Storage, are move constructed in dst and destroyed in src.
+ */
+template<typename Type, typename Storage = Type>
+struct avl_array_relocate
+{
+  inline void operator()(Storage* dst, Storage* src, std::size_t live) const
+  {
+    for (std::size_t i = 0U; i < live; ++i) {
+      Type& element = *reinterpret_cast<Type*>(src + i);
+      ::new (static_cast<void*>(dst + i)) Type(std::move(element));
+      element.~Type();
+    }
+  }
+};
+
+
+/**
+ * Allocation policies
+ * An allocation policy provides the 'array' class template which backs every node array of a layout.
+ * avl_array_alloc_static embeds the arrays in the container object itself (default), avl_array_alloc_dynamic
+ * allocates them on the heap and grows them at runtime. See avl_array_mmap.h for policies using reserved
+ * but lazily committed virtual memory, huge pages and NUMA placement.
+ */
+struct avl_array_alloc_static
+{
+  template<typename Type, std::size_t N>
+  class array
+  {
+    Type data_[N];
+
+  public:
+    // the array is used like a built-in array
+    inline operator Type*()                             { return data_; }
+    inline operator const Type*() const                 { return data_; }
+
+    // true if the array memory for N elements is available
+    inline bool valid() const
+    { return true; }
+
+    // number of elements which are usable now
+    inline std::size_t capacity() const
+    { return N; }
+
+    // make n elements usable, nothing to do for static memory
+    template<typename Relocate>
+    inline bool reserve(std::size_t n, std::size_t live, Relocate relocate)
+    { (void)live; (void)relocate; return n <= N; }
+
+    // give the memory of the unused elements [first, N) back, nothing to do for static memory
+    template<typename Relocate>
+    inline void release(std::size_t first, Relocate relocate)
+    { (void)first; (void)relocate; }
+  };
+};
+
+
+/**
+ * Cache line aligned heap memory, the global new only aligns to alignof(std::max_align_t) before C++17
+ * The block is allocated one cache line bigger, the raw address is stored in front of the aligned block.
+ */
+struct avl_array_heap_aligned
+{
+  // assumed cache line size
+  static const std::size_t CACHE_LINE = 64U;
+
+  // fails like the global new
+  static inline void* allocate(std::size_t bytes)
+  { return align(::operator new(bytes + CACHE_LINE)); }
+
+  // returns nullptr if the memory can't be allocated
+  static inline void* allocate(std::size_t bytes, const std::nothrow_t& nothrow)
+  {
+    void* raw = ::operator new(bytes + CACHE_LINE, nothrow);
+    return raw ? align(raw) : nullptr;
+  }
+
+  static inline void deallocate(void* addr)
+  {
+    if (addr) {
+      ::operator delete(static_cast<void**>(addr)[-1]);
+    }
+  }
+
+private:
+  // the aligned block starts at least one pointer behind raw
+  static inline void* align(void* raw)
+  {
+    void* addr = reinterpret_cast<void*>((reinterpret_cast<std::uintptr_t>(raw) + CACHE_LINE) & ~static_cast<std::uintptr_t>(CACHE_LINE - 1U));
+    static_cast<void**>(addr)[-1] = raw;
+    return addr;
+  }
+};
+
+
+/**
+ * Heap memory source of avl_array_alloc_growing, the arrays are cache line aligned
+ */
+struct avl_array_memory_heap
+{
+  // returns nullptr if the memory can't be allocated
+  inline void* allocate(std::size_t bytes)
+  { return avl_array_heap_aligned::allocate(bytes, std::nothrow); }
+
+  inline void deallocate(void* addr, std::size_t bytes)
+  { (void)bytes; avl_array_heap_aligned::deallocate(addr); }
+};
+
+
+/**
+ * Allocation with runtime capacity
+ * The arrays start empty and are reallocated when more nodes are needed. avl_array grows them
+ * geometrically on insert, or explicitly by reserve(). 'Size' is the upper capacity limit.
+ * Because nodes are linked by index, growing only relocates the arrays, no link is rewritten.
+ * shrink_to_fit() reallocates the arrays to the actual size.
+ * \param Memory Memory source, every array owns an instance providing allocate(bytes) and deallocate(addr, bytes)
+ */
+template<typename Memory>
+struct avl_array_alloc_growing
+{
+  template<typename Type, std::size_t N>
+  class array : private Memory
+  {
+    Type*       data_;      // allocated array
+    std::size_t capacity_;  // allocated elements
+
+  public:
+    array()
+      : data_(nullptr)
+      , capacity_(0U)
+    { }
+
+    // elements are destroyed by the container, only the memory is freed
+    ~array()
+    {
+      if (data_) {
+        this->deallocate(data_, capacity_ * sizeof(Type));
+      }
+    }
+
+    // the array is used like a built-in array
+    inline operator Type*()                             { return data_; }
+    inline operator const Type*() const                 { return data_; }
+
+    // true if the array memory for N elements is available
+    inline bool valid() const
+    { return true; }
+
+    // number of elements which are usable now
+    inline std::size_t capacity() const
+    { return capacity_; }
+
+    // make n (max N) elements usable, the living elements [0, live) are moved by relocate
+    // returns false if n exceeds N or if the memory can't be allocated
+    template<typename Relocate>
+    bool reserve(std::size_t n, std::size_t live, Relocate relocate)
+    {
+      if (n <= capacity_) {
+        return true;
+      }
+      return (n <= N) && resize(n, live, relocate);
+    }
+
+    // shrink the array to the living elements [0, first)
+    template<typename Relocate>
+    void release(std::size_t first, Relocate relocate)
+    {
+      if (first < capacity_) {
+        (void)resize(first, first, relocate);
+      }
+    }
+
+  private:
+    template<typename Relocate>
+    bool resize(std::size_t n, std::size_t live, Relocate relocate)
+    {
+      Type* data = nullptr;
+      if (n) {
+        data = static_cast<Type*>(this->allocate(n * sizeof(Type)));
+        if (!data) {
+          return false;
+        }
+        relocate(data, data_, live);
+      }
+      if (data_) {
+        this->deallocate(data_, capacity_ * sizeof(Type));
+      }
+      data_     = data;
+      capacity_ = n;
+      return true;
+    }
+
+    // not copyable, every container owns its arrays
+    array(const array&);
+    array& operator=(const array&);
+  };
+};
+
+
+/**
+ * Heap allocation with runtime capacity, see avl_array_alloc_growing
+ */
+struct avl_array_alloc_dynamic : avl_array_alloc_growing<avl_array_memory_heap>
+{ };
+
+
+/**
+ * Node layout policies
+ * A layout policy provides the 'storage' class template which holds all node arrays of the container
+ * and the accessors avl_array uses to read and write the node members. The arrays are provided by the
+ * allocation policy.
+ * Keys and values are kept in uninitialized raw storage, avl_array constructs them on insert and
+ * destroys them on erase and clear.
+ */
+
+/**
+ * Structure of arrays layout (default)
+ * Every node member (key, value, balance, childs, parent) is stored in its own array.
+ * This is the most compact layout, because no structure padding is involved.
+ */
+struct avl_array_layout_soa
+{
+  template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast, const bool Ranked, typename Alloc>
+  class storage
+  {
+    // child index pointer class
+    typedef struct tag_child_type {
+      size_type left;
+      size_type right;
+    } child_type;
+
+    // raw key and value storage
+    typedef typename std::aligned_storage<sizeof(Key), alignof(Key)>::type key_storage_type;
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type     val_storage_type;
+
+    // node storage, due to possible structure packing effects, single arrays are used instead of a 'node' structure
+    typename Alloc::template array<key_storage_type, Size>        key_;     // node key
+    typename Alloc::template array<val_storage_type, Size>        val_;     // node value
+    typename Alloc::template array<std::int8_t, Size>             balance_; // subtree balance
+    typename Alloc::template array<child_type, Size>              child_;   // node childs
+    typename Alloc::template array<size_type, Fast ? Size : 1>    parent_;  // node parent, use one element if not needed (zero sized array is not allowed)
+    typename Alloc::template array<size_type, Ranked ? Size : 1>  count_;   // subtree size, use one element if not needed
+
+  public:
+    inline Key&         key(size_type node)                            { return *reinterpret_cast<Key*>(key_ + node); }
+    inline const Key&   key(size_type node) const                      { return *reinterpret_cast<const Key*>(key_ + node); }
+    inline T&           val(size_type node)                            { return *reinterpret_cast<T*>(val_ + node); }
+    inline const T&     val(size_type node) const                      { return *reinterpret_cast<const T*>(val_ + node); }
+    inline std::int8_t  balance(size_type node) const                  { return balance_[node]; }
+    inline void         set_balance(size_type node, std::int8_t value) { balance_[node] = value; }
+    inline size_type    left(size_type node) const                     { return child_[node].left; }
+    inline size_type    left_once(size_type node) const                { return avl_array_load_once(child_[node].left); }
+    inline void         set_left(size_type node, size_type left)       { child_[node].left = left; }
+    inline size_type    right(size_type node) const                    { return child_[node].right; }
+    inline size_type    right_once(size_type node) const               { return avl_array_load_once(child_[node].right); }
+    inline void         set_right(size_type node, size_type right)     { child_[node].right = right; }
+    inline size_type    parent(size_type node) const                   { return parent_[node]; }
+    inline void         set_parent(size_type node, size_type parent)   { parent_[node] = parent; }
+    inline size_type    count(size_type node) const                    { return count_[node]; }
+    inline void         set_count(size_type node, size_type count)     { count_[node] = count; }
+
+    // maximum number of nodes, 0 if the arrays can't be allocated
+    inline size_type max_size() const
+    {
+      return (key_.valid() && val_.valid() && balance_.valid() && child_.valid() && parent_.valid() && count_.valid()) ? Size : 0;
+    }
+
+    // number of nodes which are usable without reserve()
+    inline size_type capacity() const
+    {
+      std::size_t n = key_.capacity() < val_.capacity() ? key_.capacity() : val_.capacity();
+      n = balance_.capacity() < n ? balance_.capacity() : n;
+      n = child_.capacity() < n ? child_.capacity() : n;
+      n = (Fast && (parent_.capacity() < n)) ? parent_.capacity() : n;
+      n = (Ranked && (count_.capacity() < n)) ? count_.capacity() : n;
+      return static_cast<size_type>(n);
+    }
+
+    // make n nodes usable, the living nodes [0, live) are kept
+    inline bool reserve(size_type size, size_type alive)
+    {
+      const std::size_t n    = static_cast<std::size_t>(size);
+      const std::size_t live = static_cast<std::size_t>(alive);
+      return key_.reserve(n, live, avl_array_relocate<Key, key_storage_type>()) &&
+             val_.reserve(n, live, avl_array_relocate<T, val_storage_type>()) &&
+             balance_.reserve(n, live, avl_array_relocate<std::int8_t>()) &&
+             child_.reserve(n, live, avl_array_relocate<child_type>()) &&
+             (!Fast || parent_.reserve(n, live, avl_array_relocate<size_type>())) &&
+             (!Ranked || count_.reserve(n, live, avl_array_relocate<size_type>()));
+    }
+
+    // call f(array, element bytes) for every node array in use, in storage order (see avl_array_image.h)
+    template<typename Function>
+    inline void for_each_array(Function& f)
+    {
+      f(key_, sizeof(key_storage_type));
+      f(val_, sizeof(val_storage_type));
+      f(balance_, sizeof(std::int8_t));
+      f(child_, sizeof(child_type));
+      if (Fast) {
+        f(parent_, sizeof(size_type));
+      }
+      if (Ranked) {
+        f(count_, sizeof(size_type));
+      }
+    }
+
+    template<typename Function>
+    inline void for_each_array(Function& f) const
+    {
+      f(key_, sizeof(key_storage_type));
+      f(val_, sizeof(val_storage_type));
+      f(balance_, sizeof(std::int8_t));
+      f(child_, sizeof(child_type));
+      if (Fast) {
+        f(parent_, sizeof(size_type));
+      }
+      if (Ranked) {
+        f(count_, sizeof(size_type));
+      }
+    }
+
+    // give the memory of the unused nodes [first, Size) back (if supported by the allocation policy)
+    inline void release(size_type unused)
+    {
+      const std::size_t first = static_cast<std::size_t>(unused);
+      key_.release(first, avl_array_relocate<Key, key_storage_type>());
+      val_.release(first, avl_array_relocate<T, val_storage_type>());
+      balance_.release(first, avl_array_relocate<std::int8_t>());
+      child_.release(first, avl_array_relocate<child_type>());
+      if (Fast) {
+        parent_.release(first, avl_array_relocate<size_type>());
+      }
+      if (Ranked) {
+        count_.release(first, avl_array_relocate<size_type>());
+      }
+    }
+
+    // prefetch everything a search step needs
+    inline void prefetch(size_type node) const
+    {
+#if defined(__GNUC__)
+      __builtin_prefetch(key_ + node);
+      __builtin_prefetch(child_ + node);
+#else
+      (void)node;
+#endif
+    }
+
+    // prefetch the value
+    inline void prefetch_val(size_type node) const
+    {
+#if defined(__GNUC__)
+      __builtin_prefetch(val_ + node);
+#else
+      (void)node;
+#endif
+    }
+  };
+};
+
+
+/**
+ * Narrowest unsigned index type holding the node indices [0, N] (N is the invalid index) in the low bits,
+ * leaving 'Spare' high bits unused
+ */
+template<std::size_t N, unsigned Spare = 0U>
+struct avl_array_index
+{
+  typedef typename std::conditional<(N >> (8U - Spare)) == 0U, std::uint8_t,
+          typename std::conditional<(N >> (16U - Spare)) == 0U, std::uint16_t,
+          typename std::conditional<(N >> (32U - Spare)) == 0U, std::uint32_t, std::uint64_t>::type>::type>::type type;
+};
+
+
+// smallest power of two which is not less than n, at most 'limit'
+constexpr std::size_t avl_array_ceil_pow2(std::size_t n, std::size_t limit, std::size_t p = 1U)
+{ return ((p >= n) || (p >= limit)) ? p : avl_array_ceil_pow2(n, limit, 2U * p); }
+
+
+/**
+ * Cache line blocked layout
+ * Key and child indices are interleaved in one 'hot' node record, value and parent are moved to 'cold'
+ * arrays. A search step reads one record instead of the key_ and child_ arrays. Like in the compact layout
+ * the links use the narrowest index type which fits Size and the balance is packed into the left link.
+ * The record is padded to a power of two and aligned to it, the arrays of the heap allocation policies
+ * start at a cache line, so a search step touches exactly one cache line (records bigger than a cache line
+ * start one). Still bench/bench_layout.cpp (1M nodes, uint32_t keys, 16 byte records) measures it slower
+ * than the soa layout (660 vs 482 ns per find): soa touches two lines per step, but its key_ array is four
+ * times denser, so more of the upper tree levels stay cached. Measure before using it.
+ */
+struct avl_array_layout_blocked
+{
+  template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast, const bool Ranked, typename Alloc>
+  class storage
+  {
+    // node index, two spare bits for the balance
+    typedef typename avl_array_index<static_cast<std::size_t>(Size), 2U>::type index_type;
+
+    static const unsigned   BALANCE_SHIFT = 8U * sizeof(index_type) - 2U;
+    static const index_type INDEX_MASK    = static_cast<index_type>((static_cast<std::uint64_t>(1U) << BALANCE_SHIFT) - 1U);
+
+    // raw key and value storage
+    typedef typename std::aligned_storage<sizeof(Key), alignof(Key)>::type key_storage_type;
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type     val_storage_type;
+
+    // unpadded hot node record, sets the record size
+    typedef struct tag_record_type {
+      key_storage_type key;
+      index_type       left;
+      index_type       right;
+    } record_type;
+
+    // hot node record, everything a search step needs, aligned to the power of two which holds it (at most a cache line)
+    typedef struct alignas(avl_array_ceil_pow2(sizeof(record_type), avl_array_heap_aligned::CACHE_LINE)) tag_node_type {
+      key_storage_type key;                 // node key
+      index_type       left;                // left child, the two high bits hold the balance
+      index_type       right;               // right child
+    } node_type;
+
+    // relocation of node records, the key is moved
+    struct relocate_node
+    {
+      inline void operator()(node_type* dst, node_type* src, std::size_t live) const
+      {
+        for (std::size_t i = 0U; i < live; ++i) {
+          avl_array_relocate<Key, key_storage_type>()(&dst[i].key, &src[i].key, 1U);
+          dst[i].left  = src[i].left;
+          dst[i].right = src[i].right;
+        }
+      }
+    };
+
+    typename Alloc::template array<node_type, Size>               node_;    // hot node records
+    typename Alloc::template array<val_storage_type, Size>        val_;     // node value
+    typename Alloc::template array<size_type, Fast ? Size : 1>    parent_;  // node parent, use one element if not needed (zero sized array is not allowed)
+    typename Alloc::template array<size_type, Ranked ? Size : 1>  count_;   // subtree size, use one element if not needed
+
+  public:
+    inline Key&         key(size_type node)                            { return *reinterpret_cast<Key*>(&node_[node].key); }
+    inline const Key&   key(size_type node) const                      { return *reinterpret_cast<const Key*>(&node_[node].key); }
+    inline T&           val(size_type node)                            { return *reinterpret_cast<T*>(val_ + node); }
+    inline const T&     val(size_type node) const                      { return *reinterpret_cast<const T*>(val_ + node); }
+    inline size_type    left(size_type node) const                     { return static_cast<size_type>(node_[node].left & INDEX_MASK); }
+    inline size_type    left_once(size_type node) const                { return static_cast<size_type>(avl_array_load_once(node_[node].left) & INDEX_MASK); }
+    inline size_type    right(size_type node) const                    { return static_cast<size_type>(node_[node].right); }
+    inline size_type    right_once(size_type node) const               { return static_cast<size_type>(avl_array_load_once(node_[node].right)); }
+    inline void         set_right(size_type node, size_type right)     { node_[node].right = static_cast<index_type>(right); }
+    inline size_type    parent(size_type node) const                   { return parent_[node]; }
+    inline void         set_parent(size_type node, size_type parent)   { parent_[node] = parent; }
+    inline size_type    count(size_type node) const                    { return count_[node]; }
+    inline void         set_count(size_type node, size_type count)     { count_[node] = count; }
+
+    inline void set_left(size_type node, size_type left)
+    {
+      node_[node].left = static_cast<index_type>((node_[node].left & ~INDEX_MASK) | static_cast<index_type>(left));
+    }
+
+    // the balance is stored as 2 bit two's complement, like in the compact layout
+    inline std::int8_t balance(size_type node) const
+    {
+      const unsigned bits = static_cast<unsigned>(node_[node].left >> BALANCE_SHIFT);
+      return static_cast<std::int8_t>(bits == 3U ? -1 : static_cast<int>(bits));
+    }
+
+    inline void set_balance(size_type node, std::int8_t value)
+    {
+      const index_type bits = static_cast<index_type>(static_cast<index_type>(static_cast<unsigned>(value) & 3U) << BALANCE_SHIFT);
+      node_[node].left = static_cast<index_type>((node_[node].left & INDEX_MASK) | bits);
+    }
+
+    // maximum number of nodes, 0 if the arrays can't be allocated
+    inline size_type max_size() const
+    {
+      return (node_.valid() && val_.valid() && parent_.valid() && count_.valid()) ? Size : 0;
+    }
+
+    // number of nodes which are usable without reserve()
+    inline size_type capacity() const
+    {
+      std::size_t n = node_.capacity() < val_.capacity() ? node_.capacity() : val_.capacity();
+      n = (Fast && (parent_.capacity() < n)) ? parent_.capacity() : n;
+      n = (Ranked && (count_.capacity() < n)) ? count_.capacity() : n;
+      return static_cast<size_type>(n);
+    }
+
+    // make n nodes usable, the living nodes [0, live) are kept
+    inline bool reserve(size_type size, size_type alive)
+    {
+      const std::size_t n    = static_cast<std::size_t>(size);
+      const std::size_t live = static_cast<std::size_t>(alive);
+      return node_.reserve(n, live, relocate_node()) &&
+             val_.reserve(n, live, avl_array_relocate<T, val_storage_type>()) &&
+             (!Fast || parent_.reserve(n, live, avl_array_relocate<size_type>())) &&
+             (!Ranked || count_.reserve(n, live, avl_array_relocate<size_type>()));
+    }
+
+    // call f(array, element bytes) for every node array in use, in storage order (see avl_array_image.h)
+    template<typename Function>
+    inline void for_each_array(Function& f)
+    {
+      f(node_, sizeof(node_type));
+      f(val_, sizeof(val_storage_type));
+      if (Fast) {
+        f(parent_, sizeof(size_type));
+      }
+      if (Ranked) {
+        f(count_, sizeof(size_type));
+      }
+    }
+
+    template<typename Function>
+    inline void for_each_array(Function& f) const
+    {
+      f(node_, sizeof(node_type));
+      f(val_, sizeof(val_storage_type));
+      if (Fast) {
+        f(parent_, sizeof(size_type));
+      }
+      if (Ranked) {
+        f(count_, sizeof(size_type));
+      }
+    }
+
+    // give the memory of the unused nodes [first, Size) back (if supported by the allocation policy)
+    inline void release(size_type unused)
+    {
+      const std::size_t first = static_cast<std::size_t>(unused);
+      node_.release(first, relocate_node());
+      val_.release(first, avl_array_relocate<T, val_storage_type>());
+      if (Fast) {
+        parent_.release(first, avl_array_relocate<size_type>());
+      }
+      if (Ranked) {
+        count_.release(first, avl_array_relocate<size_type>());
+      }
+    }
+
+    // prefetch everything a search step needs
+    inline void prefetch(size_type node) const
+    {
+#if defined(__GNUC__)
+      __builtin_prefetch(node_ + node);
+#else
+      (void)node;
+#endif
+    }
+
+    // prefetch the value
+    inline void prefetch_val(size_type node) const
+    {
+#if defined(__GNUC__)
+      __builtin_prefetch(val_ + node);
+#else
+      (void)node;
+#endif
+    }
+  };
+};
+
+
+/**
+ * Compact layout
+ * Like avl_array_layout_soa, but the node links use the narrowest index type which fits Size, independent
+ * of the container size_type, and the balance factor (-1, 0, 1) is packed into the two high bits of the
+ * left child index. There is no balance array. E.g. with Size < 16384 a node needs 4 bytes for childs
+ * and balance instead of 2 * sizeof(size_type) + 1. Set 'Fast' to false to drop the parent array as well.
+ * More nodes fit into a cache line, which speeds up find() on big trees.
+ */
+struct avl_array_layout_compact
+{
+  template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast, const bool Ranked, typename Alloc>
+  class storage
+  {
+    // node index, two spare bits for the balance
+    typedef typename avl_array_index<static_cast<std::size_t>(Size), 2U>::type index_type;
+
+    static const unsigned   BALANCE_SHIFT = 8U * sizeof(index_type) - 2U;
+    static const index_type INDEX_MASK    = static_cast<index_type>((static_cast<std::uint64_t>(1U) << BALANCE_SHIFT) - 1U);
+
+    // child index pointer class, the high bits of left hold the balance
+    typedef struct tag_child_type {
+      index_type left;
+      index_type right;
+    } child_type;
+
+    // raw key and value storage
+    typedef typename std::aligned_storage<sizeof(Key), alignof(Key)>::type key_storage_type;
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type     val_storage_type;
+
+    typename Alloc::template array<key_storage_type, Size>        key_;     // node key
+    typename Alloc::template array<val_storage_type, Size>        val_;     // node value
+    typename Alloc::template array<child_type, Size>              child_;   // node childs and balance
+    typename Alloc::template array<index_type, Fast ? Size : 1>   parent_;  // node parent, use one element if not needed (zero sized array is not allowed)
+    typename Alloc::template array<index_type, Ranked ? Size : 1> count_;   // subtree size, use one element if not needed
+
+  public:
+    inline Key&         key(size_type node)                            { return *reinterpret_cast<Key*>(key_ + node); }
+    inline const Key&   key(size_type node) const                      { return *reinterpret_cast<const Key*>(key_ + node); }
+    inline T&           val(size_type node)                            { return *reinterpret_cast<T*>(val_ + node); }
+    inline const T&     val(size_type node) const                      { return *reinterpret_cast<const T*>(val_ + node); }
+    inline size_type    left(size_type node) const                     { return static_cast<size_type>(child_[node].left & INDEX_MASK); }
+    inline size_type    left_once(size_type node) const                { return static_cast<size_type>(avl_array_load_once(child_[node].left) & INDEX_MASK); }
+    inline size_type    right(size_type node) const                    { return static_cast<size_type>(child_[node].right); }
+    inline size_type    right_once(size_type node) const               { return static_cast<size_type>(avl_array_load_once(child_[node].right)); }
+    inline void         set_right(size_type node, size_type right)     { child_[node].right = static_cast<index_type>(right); }
+    inline size_type    parent(size_type node) const                   { return static_cast<size_type>(parent_[node]); }
+    inline void         set_parent(size_type node, size_type parent)   { parent_[node] = static_cast<index_type>(parent); }
+    inline size_type    count(size_type node) const                    { return static_cast<size_type>(count_[node]); }
+    inline void         set_count(size_type node, size_type count)     { count_[node] = static_cast<index_type>(count); }
+
+    inline void set_left(size_type node, size_type left)
+    {
+      child_[node].left = static_cast<index_type>((child_[node].left & ~INDEX_MASK) | static_cast<index_type>(left));
+    }
+
+    // the balance is stored as 2 bit two's complement
+    inline std::int8_t balance(size_type node) const
+    {
+      const unsigned bits = static_cast<unsigned>(child_[node].left >> BALANCE_SHIFT);
+      return static_cast<std::int8_t>(bits == 3U ? -1 : static_cast<int>(bits));
+    }
+
+    inline void set_balance(size_type node, std::int8_t value)
+    {
+      const index_type bits = static_cast<index_type>(static_cast<index_type>(static_cast<unsigned>(value) & 3U) << BALANCE_SHIFT);
+      child_[node].left = static_cast<index_type>((child_[node].left & INDEX_MASK) | bits);
+    }
+
+    // maximum number of nodes, 0 if the arrays can't be allocated
+    inline size_type max_size() const
+    {
+      return (key_.valid() && val_.valid() && child_.valid() && parent_.valid() && count_.valid()) ? Size : 0;
+    }
+
+    // number of nodes which are usable without reserve()
+    inline size_type capacity() const
+    {
+      std::size_t n = key_.capacity() < val_.capacity() ? key_.capacity() : val_.capacity();
+      n = child_.capacity() < n ? child_.capacity() : n;
+      n = (Fast && (parent_.capacity() < n)) ? parent_.capacity() : n;
+      n = (Ranked && (count_.capacity() < n)) ? count_.capacity() : n;
+      return static_cast<size_type>(n);
+    }
+
+    // make n nodes usable, the living nodes [0, live) are kept
+    inline bool reserve(size_type size, size_type alive)
+    {
+      const std::size_t n    = static_cast<std::size_t>(size);
+      const std::size_t live = static_cast<std::size_t>(alive);
+      return key_.reserve(n, live, avl_array_relocate<Key, key_storage_type>()) &&
+             val_.reserve(n, live, avl_array_relocate<T, val_storage_type>()) &&
+             child_.reserve(n, live, avl_array_relocate<child_type>()) &&
+             (!Fast || parent_.reserve(n, live, avl_array_relocate<index_type>())) &&
+             (!Ranked || count_.reserve(n, live, avl_array_relocate<index_type>()));
+    }
+
+    // call f(array, element bytes) for every node array in use, in storage order (see avl_array_image.h)
+    template<typename Function>
+    inline void for_each_array(Function& f)
+    {
+      f(key_, sizeof(key_storage_type));
+      f(val_, sizeof(val_storage_type));
+      f(child_, sizeof(child_type));
+      if (Fast) {
+        f(parent_, sizeof(index_type));
+      }
+      if (Ranked) {
+        f(count_, sizeof(index_type));
+      }
+    }
+
+    template<typename Function>
+    inline void for_each_array(Function& f) const
+    {
+      f(key_, sizeof(key_storage_type));
+      f(val_, sizeof(val_storage_type));
+      f(child_, sizeof(child_type));
+      if (Fast) {
+        f(parent_, sizeof(index_type));
+      }
+      if (Ranked) {
+        f(count_, sizeof(index_type));
+      }
+    }
+
+    // give the memory of the unused nodes [first, Size) back (if supported by the allocation policy)
+    inline void release(size_type unused)
+    {
+      const std::size_t first = static_cast<std::size_t>(unused);
+      key_.release(first, avl_array_relocate<Key, key_storage_type>());
+      val_.release(first, avl_array_relocate<T, val_storage_type>());
+      child_.release(first, avl_array_relocate<child_type>());
+      if (Fast) {
+        parent_.release(first, avl_array_relocate<index_type>());
+      }
+      if (Ranked) {
+        count_.release(first, avl_array_relocate<index_type>());
+      }
+    }
+
+    // prefetch everything a search step needs
+    inline void prefetch(size_type node) const
+    {
+#if defined(__GNUC__)
+      __builtin_prefetch(key_ + node);
+      __builtin_prefetch(child_ + node);
+#else
+      (void)node;
+#endif
+    }
+
+    // prefetch the value
+    inline void prefetch_val(size_type node) const
+    {
+#if defined(__GNUC__)
+      __builtin_prefetch(val_ + node);
+#else
+      (void)node;
+#endif
+    }
+  };
+};
+
+
+/**
+ * Dirty node tracking, used as storage of avl_array if the 'Dirty' parameter is set
+ * Wraps the storage of a layout and marks every node whose tree members (childs, balance, parent, subtree size)
+ * are set in a bitmap, which is provided by the allocation policy and grows with the node arrays.
+ * New and relocated nodes always get their tree members set, so they are marked as well.
+ */
+template<typename Storage, typename size_type, const size_type Size, typename Alloc>
+class avl_array_dirty_storage : public Storage
+{
+  static const std::size_t WORDS = (static_cast<std::size_t>(Size) + 63U) / 64U;
+
+  typename Alloc::template array<std::uint64_t, WORDS> dirty_;    // one bit per node
+  std::size_t                                          words_;    // number of initialized words
+
+  static inline std::size_t words(size_type nodes)
+  { return (static_cast<std::size_t>(nodes) + 63U) / 64U; }
+
+  // zero the words which became usable
+  inline void init()
+  {
+    for (; words_ < dirty_.capacity(); ++words_) {
+      dirty_[words_] = 0U;
+    }
+  }
+
+public:
+  avl_array_dirty_storage()
+    : words_(0U)
+  { init(); }
+
+  inline void mark(size_type node)                               { dirty_[node / 64U] |= static_cast<std::uint64_t>(1U) << (node % 64U); }
+  inline std::uint64_t dirty_word(std::size_t word) const         { return dirty_[word]; }
+
+  inline void set_balance(size_type node, std::int8_t value)      { mark(node); Storage::set_balance(node, value); }
+  inline void set_left(size_type node, size_type left)            { mark(node); Storage::set_left(node, left); }
+  inline void set_right(size_type node, size_type right)          { mark(node); Storage::set_right(node, right); }
+  inline void set_parent(size_type node, size_type parent)        { mark(node); Storage::set_parent(node, parent); }
+  inline void set_count(size_type node, size_type count)          { mark(node); Storage::set_count(node, count); }
+
+  // clear the marks of the nodes [0, nodes)
+  inline void clean(size_type nodes)
+  {
+    const std::size_t n = words(nodes) < words_ ? words(nodes) : words_;
+    for (std::size_t w = 0U; w < n; ++w) {
+      dirty_[w] = 0U;
+    }
+  }
+
+  inline size_type max_size() const
+  {
+    return dirty_.valid() ? Storage::max_size() : 0;
+  }
+
+  inline size_type capacity() const
+  {
+    const std::size_t bits = dirty_.capacity() * 64U;
+    const size_type   n    = Storage::capacity();
+    return (bits < static_cast<std::size_t>(n)) ? static_cast<size_type>(bits) : n;
+  }
+
+  inline bool reserve(size_type size, size_type alive)
+  {
+    if (!Storage::reserve(size, alive) || !dirty_.reserve(words(size), words(alive), avl_array_relocate<std::uint64_t>())) {
+      return false;
+    }
+    init();
+    return true;
+  }
+
+  inline void release(size_type unused)
+  {
+    Storage::release(unused);
+    dirty_.release(words(unused), avl_array_relocate<std::uint64_t>());
+    words_ = (dirty_.capacity() < words_) ? dirty_.capacity() : words_;
+  }
+};
+
+
+/**
+ * Statistics policy which counts nothing (default)
+ * avl_array calls the hooks of its statistics policy in the search loops, the rotations, the rebalancing and
+ * the tail relocation of erase(). All hooks of this policy are empty, so they and the values passed to them
+ * are removed by the compiler. avl_array derives from the policy, the empty class doesn't add any size.
+ */
+struct avl_array_stats_none
+{
+  inline void compare() const                       { }
+  inline void find(std::size_t) const               { }
+  inline void rotate_left() const                   { }
+  inline void rotate_right() const                  { }
+  inline void rotate_left_right() const             { }
+  inline void rotate_right_left() const             { }
+  inline void retrace() const                       { }
+  inline void insert_rebalance() const              { }
+  inline void erase_rebalance() const               { }
+  inline void relocate() const                      { }
+};
+
+
+/**
+ * Statistics policy which counts the work of the container operations
+ * - comparisons: key comparisons ('less than' and 'equal to') of all searches: find(), find_branchless(), find_bounded(),
+ *   find_batch(), the iterator find(), count(), lower_bound(), upper_bound(), equal_range(), rank(), the searches
+ *   of insert() and erase() and the parent searches of the slow version (Fast = false). Only check() isn't counted
+ * - find_depth: number of nodes visited by every find(), find_branchless(), find_bounded(), iterator find() and count()
+ * - rotations by type: left, right, left-right and right-left (double rotations count once)
+ * - insert_path, erase_path: number of nodes visited by the rebalancing after every insert and erase, 0 for the
+ *   insert into an empty tree and the erase of the last node, so the counts are the numbers of inserts and erases
+ * - relocations: erase() moved the last node into the place of the erased one
+ * The hooks are const, because find() is const, so the counters are mutable. The counters are not atomic,
+ * don't use this policy with concurrent readers (avl_array_seqlock, avl_array_rcu, parallel find_batch()).
+ */
+struct avl_array_stats_counting
+{
+  /**
+   * Histogram of a length (tree depth or path length)
+   * Bucket i counts the samples of length i, the last bucket all samples of length BUCKETS - 1 or more.
+   */
+  struct histogram
+  {
+    static const std::size_t BUCKETS = 64U;
+
+    std::uint64_t bucket[BUCKETS];
+    std::uint64_t count;      // number of samples
+    std::uint64_t sum;        // sum of all lengths
+
+    histogram()
+    { reset(); }
+
+    inline void add(std::size_t length)
+    {
+      bucket[(length < BUCKETS) ? length : BUCKETS - 1U]++;
+      count++;
+      sum += length;
+    }
+
+    void reset()
+    {
+      for (std::size_t b = 0U; b < BUCKETS; ++b) {
+        bucket[b] = 0U;
+      }
+      count = 0U;
+      sum   = 0U;
+    }
+
+    // mean length, 0 without samples
+    inline double mean() const
+    { return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0; }
+
+    /**
+     * Percentile
+     * \param p Fraction of the samples, e.g. 0.99
+     * \return The smallest length which at least p of the samples don't exceed, 0 without samples
+     */
+    std::size_t percentile(double p) const
+    {
+      std::uint64_t seen = 0U;
+      for (std::size_t b = 0U; b < BUCKETS; ++b) {
+        seen += bucket[b];
+        if (seen && (static_cast<double>(seen) >= p * static_cast<double>(count))) {
+          return b;
+        }
+      }
+      return 0U;
+    }
+
+    /**
+     * Export the histogram
+     * \param f Function called as f(std::size_t length, std::uint64_t samples) for every non empty bucket, ascending
+     */
+    template<typename Function>
+    void for_each_bucket(Function f) const
+    {
+      for (std::size_t b = 0U; b < BUCKETS; ++b) {
+        if (bucket[b]) {
+          f(b, bucket[b]);
+        }
+      }
+    }
+  };
+
+  mutable std::uint64_t comparisons;
+  mutable std::uint64_t left_rotations;
+  mutable std::uint64_t right_rotations;
+  mutable std::uint64_t left_right_rotations;
+  mutable std::uint64_t right_left_rotations;
+  mutable std::uint64_t relocations;
+  mutable histogram     find_depth;
+  mutable histogram     insert_path;
+  mutable histogram     erase_path;
+  mutable std::size_t   retraced;   // nodes visited by the running rebalancing
+
+  avl_array_stats_counting()
+  { reset(); }
+
+  // set all counters to zero
+  void reset()
+  {
+    comparisons          = 0U;
+    left_rotations       = 0U;
+    right_rotations      = 0U;
+    left_right_rotations = 0U;
+    right_left_rotations = 0U;
+    relocations          = 0U;
+    retraced             = 0U;
+    find_depth.reset();
+    insert_path.reset();
+    erase_path.reset();
+  }
+
+  // total number of rotations
+  inline std::uint64_t rotations() const
+  { return left_rotations + right_rotations + left_right_rotations + right_left_rotations; }
+
+  // hooks, called by avl_array
+  inline void compare() const                             { comparisons++; }
+  inline void find(std::size_t depth) const               { find_depth.add(depth); }
+  inline void rotate_left() const                         { left_rotations++; }
+  inline void rotate_right() const                        { right_rotations++; }
+  inline void rotate_left_right() const                   { left_right_rotations++; }
+  inline void rotate_right_left() const                   { right_left_rotations++; }
+  inline void retrace() const                             { retraced++; }
+  inline void insert_rebalance() const                    { insert_path.add(retraced); retraced = 0U; }
+  inline void erase_rebalance() const                     { erase_path.add(retraced); retraced = 0U; }
+  inline void relocate() const                            { relocations++; }
+};
+
+
+/**
+ * Maximum height of an AVL tree with n nodes
+ * The sparsest AVL tree of height h has N(h) = N(h-1) + N(h-2) + 1 nodes, so the height is below 1.44 * log2(n + 2)
+ * \param n Number of nodes
+ * \return Maximum tree height
+ */
+constexpr std::size_t avl_array_max_height(std::size_t n, std::size_t h = 1U, std::size_t prev = 0U, std::size_t cur = 1U)
+{
+  return (prev + cur + 1U > n) ? h : avl_array_max_height(n, h + 1U, cur, prev + cur + 1U);
+}
+
+
+// image functions of save() and load_mmap(), see avl_array_image.h
+struct avl_array_image;
+
+
+/**
+ * \param Key The key type. The type (class) must provide a 'less than' and 'equal to' operator
+ * \param T The Data type
+ * \param size_type Container size type
+ * \param Size Container size
+ * \param Fast If true every node stores an extra parent index. This increases memory but speed up insert/erase by factor 10
+ * \param Layout Node layout policy, avl_array_layout_soa (default), avl_array_layout_blocked or avl_array_layout_compact
+ * \param Ranked If true every node stores its subtree size. This increases memory but enables select(), rank() and iterator += n in O(log n)
+ * \param Alloc Allocation policy of the node arrays, avl_array_alloc_static (default), avl_array_alloc_dynamic, avl_array_alloc_mmap, avl_array_alloc_placed or avl_array_alloc_image
+ * \param Dirty If true every modified node is marked in a bitmap (one bit per node), see write_delta(). Non-const value
+ *              access (iterator, for_each_unordered(), for_each_sorted()) marks the node, even if the value is only read
+ * \param Stats Statistics policy, avl_array_stats_none (default, no overhead) or avl_array_stats_counting, see stats()
+ */
+template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast = true, typename Layout = avl_array_layout_soa, const bool Ranked = false, typename Alloc = avl_array_alloc_static, const bool Dirty = false, typename Stats = avl_array_stats_none>
+class avl_array : private Stats   // the statistics policy is a base, so an empty policy doesn't add any size
+{
+  // node storage, wrapped by the dirty node tracking if enabled
+  typedef typename Layout::template storage<Key, T, size_type, Size, Fast, Ranked, Alloc> layout_storage_type;
+  typedef typename std::conditional<Dirty, avl_array_dirty_storage<layout_storage_type, size_type, Size, Alloc>, layout_storage_type>::type storage_type;
+
+  storage_type  node_;                      // node arrays
+  size_type     size_;                      // actual size
+  size_type     root_;                      // root node
+
+  // invalid index (like 'nullptr' in a pointer implementation)
+  static const size_type INVALID_IDX = Size;
+
+  // number of search paths find_batch() walks in lock step
+  static const std::size_t BATCH_GROUP = 16U;
+
+  // number of elements per task of the parallel assign_sorted() and find_batch()
+  static const std::size_t PARALLEL_CHUNK = 16384U;
+
+  // the parallel assign_sorted() links the subtrees below this level as independent tasks
+  static const std::size_t PARALLEL_SPLIT = 6U;
+
+  // minimum capacity when the arrays grow
+  static const size_type ROOM_MIN = 16U;
+
+  // maximum tree height
+  static const std::size_t MAX_HEIGHT = avl_array_max_height(static_cast<std::size_t>(Size));
+
+  // the image and delta functions read and write the node arrays directly
+  friend struct avl_array_image;
+
+  // ancestors of a node, root first, recorded on the way down by insert and erase (only in slow version)
+  // rebalancing reads the parents from here instead of searching them from root
+  typedef struct tag_path_type {
+    size_type   node[Fast ? 1 : MAX_HEIGHT];
+    std::size_t depth;
+  } path_type;
+
+  // iterator class, Const selects the const_iterator, Reverse the reverse_iterator (descending key order)
+  template<bool Const, bool Reverse>
+  class tag_avl_array_iterator
+  {
+    typedef typename std::conditional<Const, const avl_array, avl_array>::type instance_type;
+    typedef typename std::conditional<Const, const T, T>::type                 value_ref_type;
+    typedef typename std::conditional<Const, const Key, Key>::type             key_ref_type;
+
+    // marks that the path of the actual node is not known yet
+    static const std::uint8_t PATH_UNKNOWN = 0xFFU;
+
+    instance_type*  instance_;                    // array instance
+    size_type       idx_;                         // actual node
+    size_type       path_[Fast ? 1 : MAX_HEIGHT]; // ancestors of the actual node, root first (only in slow version)
+    std::uint8_t    depth_;                       // number of ancestors in path_ (only in slow version)
+
+    friend avl_array;                             // avl_array may access index pointer
+    template<bool, bool> friend class tag_avl_array_iterator;
+
+  public:
+    // ctor
+    tag_avl_array_iterator(instance_type* instance = nullptr, size_type idx = 0U)
+      : instance_(instance)
+      , idx_(idx)
+      , path_()
+      , depth_(PATH_UNKNOWN)
+    { }
+
+    // conversion from iterator to const_iterator
+    template<bool OtherConst>
+    tag_avl_array_iterator(const tag_avl_array_iterator<OtherConst, Reverse>& other)
+      : instance_(other.instance_)
+      , idx_(other.idx_)
+      , path_()
+      , depth_(other.depth_)
+    {
+      for (std::size_t i = 0U; !Fast && (depth_ != PATH_UNKNOWN) && (i < depth_); ++i) {
+        path_[i] = other.path_[i];
+      }
+    }
+
+    template<bool OtherConst>
+    inline bool operator==(const tag_avl_array_iterator<OtherConst, Reverse>& rhs) const
+    { return idx_ == rhs.idx_; }
+
+    template<bool OtherConst>
+    inline bool operator!=(const tag_avl_array_iterator<OtherConst, Reverse>& rhs) const
+    { return !(*this == rhs); }
+
+    // dereference - access value
+    inline value_ref_type& operator*() const
+    { return val(); }
+
+    // access value
+    inline value_ref_type& val() const
+    { return instance_->value_ref(idx_); }
+
+    // access key
+    inline key_ref_type& key() const
+    { return instance_->node_.key(idx_); }
+
+    // preincrement
+    inline tag_avl_array_iterator& operator++()
+    {
+      step(!Reverse, false);
+      return *this;
+    }
+
+    // postincrement
+    inline tag_avl_array_iterator operator++(int)
+    {
+      tag_avl_array_iterator _copy = *this;
+      ++(*this);
+      return _copy;
+    }
+
+    // predecessor, decrementing end() gives the last element
+    inline tag_avl_array_iterator& operator--()
+    {
+      step(Reverse, true);
+      return *this;
+    }
+
+    // postdecrement
+    inline tag_avl_array_iterator operator--(int)
+    {
+      tag_avl_array_iterator _copy = *this;
+      --(*this);
+      return _copy;
+    }
+
+    // advance by n elements, O(log n) in Ranked version, O(n) otherwise
+    tag_avl_array_iterator& operator+=(size_type n)
+    {
+      if (Ranked) {
+        if (idx_ < Size) {
+          const size_type pos = instance_->rank_idx(instance_->node_.key(idx_));
+          if (Reverse) {
+            idx_ = (n <= pos) ? instance_->select_idx(static_cast<size_type>(pos - n)) : instance_->INVALID_IDX;
+          }
+          else {
+            idx_ = (n < instance_->size_ - pos) ? instance_->select_idx(static_cast<size_type>(pos + n)) : instance_->INVALID_IDX;
+          }
+          depth_ = PATH_UNKNOWN;
+        }
+      }
+      else {
+        for (; n > 0; --n) {
+          ++(*this);
+        }
+      }
+      return *this;
+    }
+
+  private:
+    // child in direction of the successor (right) or the predecessor (left)
+    inline size_type child(size_type node, bool successor) const
+    { return successor ? instance_->node_.right(node) : instance_->node_.left(node); }
+
+    // parent of the actual node
+    inline size_type parent()
+    {
+      if (Fast) {
+        return instance_->get_parent(idx_);
+      }
+      if (depth_ == PATH_UNKNOWN) {
+        build_path();
+      }
+      return depth_ ? path_[depth_ - 1U] : instance_->INVALID_IDX;
+    }
+
+    // move down to a child of the actual node
+    inline void down(size_type node)
+    {
+      if (!Fast) {
+        if (depth_ == PATH_UNKNOWN) {
+          build_path();
+        }
+        path_[depth_++] = idx_;
+      }
+      idx_ = node;
+    }
+
+    // move up to the parent of the actual node
+    inline void up(size_type parent)
+    {
+      if (!Fast) {
+        depth_--;
+      }
+      idx_ = parent;
+    }
+
+    // search the actual node from root to get its ancestors, needed once after the iterator was created by index
+    void build_path()
+    {
+      depth_ = 0U;
+      if (idx_ < Size) {
+        const Key& key_node = instance_->node_.key(idx_);
+        for (size_type i = instance_->root_; (i != idx_) && (i != instance_->INVALID_IDX); i = instance_->less(key_node, instance_->node_.key(i)) ? instance_->node_.left(i) : instance_->node_.right(i)) {
+          path_[depth_++] = i;
+        }
+      }
+    }
+
+    // move to the in order successor (or predecessor if successor is false)
+    // end() moves to the first (or last) element if restart is set, else end() is kept
+    void step(bool successor, bool restart)
+    {
+      // end reached?
+      if (idx_ >= Size) {
+        if (restart && (instance_->root_ != instance_->INVALID_IDX)) {
+          idx_   = instance_->root_;
+          depth_ = 0U;
+          for (size_type i = child(idx_, !successor); i != instance_->INVALID_IDX; i = child(idx_, !successor)) {
+            down(i);
+          }
+        }
+        return;
+      }
+      // take the furthest left (right) node of the right (left) child, if not existent, move up
+      size_type i = child(idx_, successor);
+      if (i != instance_->INVALID_IDX) {
+        down(i);
+        for (i = child(idx_, !successor); i != instance_->INVALID_IDX; i = child(idx_, !successor)) {
+          down(i);
+        }
+      }
+      else {
+        // have already processed the left (right) subtree, and
+        // there is no right (left) subtree. move up the tree,
+        // looking for a parent for which the node is a left (right) child,
+        // stopping if the parent becomes invalid. a valid parent
+        // is the successor. if the parent is invalid, the original node
+        // was the last node in order, and its successor
+        // is the end of the list
+        i = parent();
+        while ((i != instance_->INVALID_IDX) && (idx_ == child(i, successor))) {
+          up(i);
+          i = parent();
+        }
+        if (i != instance_->INVALID_IDX) {
+          up(i);
+        }
+        else {
+          idx_   = instance_->INVALID_IDX;
+          depth_ = 0U;
+        }
+      }
+    }
+  };
+
+
+public:
+
+  typedef T                                     value_type;
+  typedef T*                                    pointer;
+  typedef const T*                              const_pointer;
+  typedef T&                                    reference;
+  typedef const T&                              const_reference;
+  typedef Key                                   key_type;
+  typedef tag_avl_array_iterator<false, false>  iterator;
+  typedef tag_avl_array_iterator<true,  false>  const_iterator;
+  typedef tag_avl_array_iterator<false, true>   reverse_iterator;
+  typedef tag_avl_array_iterator<true,  true>   const_reverse_iterator;
+
+
+  // ctor, no element is constructed
+  avl_array()
+    : Stats()
+    , size_(0U)
+    , root_(Size)
+  { }
+
+
+  // copy ctor, only the actual elements are copied
+  avl_array(const avl_array& other)
+    : Stats()
+    , size_(0U)
+    , root_(Size)
+  { copy_from(other); }
+
+
+  // move ctor, the elements of other are moved, other keeps its (moved from) elements
+  avl_array(avl_array&& other)
+    : Stats()
+    , size_(0U)
+    , root_(Size)
+  { move_from(other); }
+
+
+  // dtor, destroys the actual elements
+  ~avl_array()
+  { clear(); }
+
+
+  // heap allocation keeps an over-aligned container aligned (static arrays of avl_array_layout_blocked records
+  // bigger than 16 bytes), the global new only aligns to alignof(std::max_align_t) before C++17
+  static void* operator new(std::size_t bytes)
+  { return (alignof(avl_array) > alignof(std::max_align_t)) ? avl_array_heap_aligned::allocate(bytes) : ::operator new(bytes); }
+
+  static void operator delete(void* addr)
+  {
+    if (alignof(avl_array) > alignof(std::max_align_t)) {
+      avl_array_heap_aligned::deallocate(addr);
+    }
+    else {
+      ::operator delete(addr);
+    }
+  }
+
+
+  avl_array& operator=(const avl_array& other)
+  {
+    if (this != &other) {
+      clear();
+      copy_from(other);
+    }
+    return *this;
+  }
+
+
+  avl_array& operator=(avl_array&& other)
+  {
+    if (this != &other) {
+      clear();
+      move_from(other);
+    }
+    return *this;
+  }
+
+
+  // iterators
+  inline iterator begin()
+  { return iterator(this, first_idx(false)); }
+
+  inline const_iterator begin() const
+  { return const_iterator(this, first_idx(false)); }
+
+  inline const_iterator cbegin() const
+  { return begin(); }
+
+  inline iterator end()
+  { return iterator(this, INVALID_IDX); }
+
+  inline const_iterator end() const
+  { return const_iterator(this, INVALID_IDX); }
+
+  inline const_iterator cend() const
+  { return end(); }
+
+  inline reverse_iterator rbegin()
+  { return reverse_iterator(this, first_idx(true)); }
+
+  inline const_reverse_iterator rbegin() const
+  { return const_reverse_iterator(this, first_idx(true)); }
+
+  inline const_reverse_iterator crbegin() const
+  { return rbegin(); }
+
+  inline reverse_iterator rend()
+  { return reverse_iterator(this, INVALID_IDX); }
+
+  inline const_reverse_iterator rend() const
+  { return const_reverse_iterator(this, INVALID_IDX); }
+
+  inline const_reverse_iterator crend() const
+  { return rend(); }
+
+
+  // capacity
+  inline size_type size() const
+  { return size_; }
+
+  inline bool empty() const
+  { return size_ == static_cast<size_type>(0); }
+
+  inline size_type max_size() const
+  { return node_.max_size(); }
+
+  // number of elements the container can hold without allocating memory (see avl_array_alloc_dynamic)
+  inline size_type capacity() const
+  { return node_.capacity(); }
+
+
+  /**
+   * Make room for a number of elements
+   * Only allocation policies with runtime capacity (avl_array_alloc_dynamic) allocate memory, for all others
+   * the capacity is fixed.
+   * \param n Number of elements
+   * \return True if the container can hold n elements, false if n exceeds max_size() or allocation failed
+   */
+  inline bool reserve(size_type n)
+  {
+    return node_.reserve(n, size_);
+  }
+
+
+  /**
+   * Give the memory of the unused nodes back
+   * avl_array_alloc_dynamic shrinks the arrays to the actual size, avl_array_alloc_mmap gives the pages of the
+   * unused nodes back to the operating system. No-op for static memory.
+   */
+  inline void shrink_to_fit()
+  {
+    node_.release(size_);
+  }
+
+
+  /**
+   * Clear the container
+   * Destroys all elements, which costs nothing for trivially destructible key and value types
+   */
+  inline void clear()
+  {
+    for (size_type i = 0U; i < size_; ++i) {
+      destroy(i);
+    }
+    size_ = 0U;
+    root_ = INVALID_IDX;
+  }
+
+
+  /**
+   * Insert or update an element
+   * \param key The key to insert. If the key already exists, it is updated
+   * \param val Value to insert or update
+   * \return True if the key was successfully inserted or updated, false if container is full
+   */
+  inline bool insert(const key_type& key, const value_type& val)
+  { return insert_or_assign(key, val); }
+
+  /**
+   * Insert or update an element, key and/or value are moved into the container
+   */
+  inline bool insert(key_type&& key, value_type&& val)
+  { return insert_or_assign(std::move(key), std::move(val)); }
+
+  inline bool insert(const key_type& key, value_type&& val)
+  { return insert_or_assign(key, std::move(val)); }
+
+  inline bool insert(key_type&& key, const value_type& val)
+  { return insert_or_assign(std::move(key), val); }
+
+
+  /**
+   * Insert an element if the key doesn't exist, the value is constructed from args
+   * If the key exists, nothing is changed and args are not used.
+   * \param key The key to insert
+   * \param args Arguments to construct the value from
+   * \return Pair of an iterator to the element with key and true if the element was inserted,
+   *         (end(), false) if the container is full
+   */
+  template<typename K, typename... Args>
+  inline std::pair<iterator, bool> emplace(K&& key, Args&&... args)
+  { return try_emplace(std::forward<K>(key), std::forward<Args>(args)...); }
+
+
+  /**
+   * Insert an element if the key doesn't exist, the value is constructed from args
+   * Same as emplace(), the value is never constructed if the key exists
+   * \param key The key to insert
+   * \param args Arguments to construct the value from
+   * \return Pair of an iterator to the element with key and true if the element was inserted,
+   *         (end(), false) if the container is full
+   */
+  template<typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace(K&& key, Args&&... args)
+  {
+    size_type parent;
+    bool      left;
+    path_type path;
+    const size_type i = insert_pos(key, parent, left, path);
+    if (i != INVALID_IDX) {
+      return std::pair<iterator, bool>(iterator(this, i), false);
+    }
+    if (!room(size_, size_)) {
+      // container is full
+      return std::pair<iterator, bool>(end(), false);
+    }
+    construct(size_, std::forward<K>(key), std::forward<Args>(args)...);
+    return std::pair<iterator, bool>(iterator(this, insert_link(parent, left, path)), true);
+  }
+
+
+  /**
+   * Replace the container content by a sorted sequence
+   * Builds a perfectly balanced tree directly in the arrays in O(n), without any key comparison
+   * or rotation. The element with sorted position i is stored at index i.
+   * THE KEYS MUST BE UNIQUE AND IN ASCENDING ORDER! This is not checked, use check() if in doubt.
+   * \param first Begin of the element range, *first must provide the members 'first' (key) and 'second' (value) like std::pair
+   * \param last End of the element range
+   * \return True if the content was assigned, false if the range has more than Size elements (container is empty then)
+   */
+  template<typename InputIt>
+  bool assign_sorted(InputIt first, InputIt last)
+  {
+    clear();
+
+    size_type n = 0;
+    for (; first != last; ++first, ++n) {
+      if (!room(n, n)) {
+        // container is full, discard the elements
+        while (n) {
+          destroy(--n);
+        }
+        return false;
+      }
+      construct(n, first->first, first->second);
+    }
+    if (n == 0) {
+      return true;
+    }
+
+    size_  = n;
+    root_  = static_cast<size_type>(n / 2);
+    set_parent(root_, INVALID_IDX);
+    std::size_t tasks = 0U;
+    link_sorted(0, n, 0U, nullptr, tasks);
+    return true;
+  }
+
+
+  /**
+   * Replace the container content by a sorted sequence, parallel variant
+   * Same as assign_sorted(first, last), but the elements are constructed in chunks and the subtrees
+   * below the top 6 levels are linked as independent tasks. Subtrees over disjoint index ranges write
+   * disjoint nodes, so the tasks can run concurrently.
+   * THE KEYS MUST BE UNIQUE AND IN ASCENDING ORDER! See avl_array_bulk_load() in avl_array_parallel.h for unsorted input.
+   * \param first Begin of the element range, random access iterator
+   * \param last End of the element range
+   * \param parallel Task runner, parallel(n, f) calls f(0) ... f(n - 1), maybe concurrently, and returns
+   *        when all calls are done (e.g. avl_array_thread_pool)
+   * \return True if the content was assigned, false if the range has more than Size elements (container is empty then)
+   */
+  template<typename RandomIt, typename Parallel>
+  bool assign_sorted(RandomIt first, RandomIt last, Parallel&& parallel)
+  {
+    clear();
+
+    const std::size_t count = static_cast<std::size_t>(last - first);
+    if ((count > static_cast<std::size_t>(max_size())) || !node_.reserve(static_cast<size_type>(count), 0U)) {
+      // container is full
+      return false;
+    }
+    const size_type n = static_cast<size_type>(count);
+    if (n == 0) {
+      return true;
+    }
+
+    parallel((count + PARALLEL_CHUNK - 1U) / PARALLEL_CHUNK, [this, first, count](std::size_t chunk) {
+      const std::size_t end = (count - chunk * PARALLEL_CHUNK < PARALLEL_CHUNK) ? count : (chunk + 1U) * PARALLEL_CHUNK;
+      RandomIt it = first + static_cast<std::ptrdiff_t>(chunk * PARALLEL_CHUNK);
+      for (std::size_t i = chunk * PARALLEL_CHUNK; i < end; ++i, ++it) {
+        construct(static_cast<size_type>(i), it->first, it->second);
+      }
+    });
+
+    // link the top levels here, collect the ranges of the subtrees below
+    range_type  ranges[static_cast<std::size_t>(1U) << PARALLEL_SPLIT];
+    std::size_t tasks = 0U;
+    size_  = n;
+    root_  = static_cast<size_type>(n / 2);
+    set_parent(root_, INVALID_IDX);
+    link_sorted(0, n, PARALLEL_SPLIT, ranges, tasks);
+
+    const auto link = [this, &ranges](std::size_t task) {
+      std::size_t none = 0U;
+      link_sorted(ranges[task].lo, ranges[task].hi, 0U, nullptr, none);
+    };
+    if (Dirty) {
+      // neighbour subtrees may share a word of the dirty node bitmap, link them one after the other
+      for (std::size_t task = 0U; task < tasks; ++task) {
+        link(task);
+      }
+    }
+    else {
+      parallel(tasks, link);
+    }
+    return true;
+  }
+
+
+  /**
+   * Find an element
+   * \param key The key to find
+   * \param val If key is found, the value of the element is set
+   * \return True if key was found
+   */
+  inline bool find(const key_type& key, value_type& val) const
+  {
+    std::size_t depth = 0U;
+    for (size_type i = root_; i != INVALID_IDX; ++depth) {
+      if (less(key, node_.key(i))) {
+        i = node_.left(i);
+      }
+      else if (equal(key, node_.key(i))) {
+        // found key
+        stats().find(depth + 1U);
+        val = node_.val(i);
+        return true;
+      }
+      else {
+        i = node_.right(i);
+      }
+    }
+    // key not found
+    stats().find(depth);
+    return false;
+  }
+
+
+  /**
+   * Find an element, branch free variant
+   * Makes only one 'less than' comparison per level and selects the next child without a branch,
+   * the key equality is checked once at the end. Both childs of the next level are prefetched, this
+   * only overlaps their loads with the comparison of the actual node, it hides no further latency.
+   * Faster than find() for uniformly distributed keys only, because no branches are mispredicted.
+   * It always descends down to a leaf, so on skewed key streams whose hot keys sit near the root
+   * find() is faster (bench/bench_find.cpp, Zipfian keys, 1M nodes: find() 189 ns vs find_branchless() 269 ns).
+   * \param key The key to find
+   * \param val If key is found, the value of the element is set
+   * \return True if key was found
+   */
+  inline bool find_branchless(const key_type& key, value_type& val) const
+  {
+    // candidate is the last node whose key is not greater than key
+    size_type candidate = INVALID_IDX;
+    std::size_t depth = 0U;
+    for (size_type i = root_; i != INVALID_IDX; ++depth) {
+      const size_type left  = node_.left(i);
+      const size_type right = node_.right(i);
+      node_.prefetch(left);
+      node_.prefetch(right);
+      // all bits set if key is less than the node key, select by masking
+      const size_type mask = static_cast<size_type>(-static_cast<int>(less(key, node_.key(i))));
+      candidate = (candidate & mask) | (i & ~mask);
+      i         = (left & mask) | (right & ~mask);
+    }
+    stats().find(depth);
+    if ((candidate != INVALID_IDX) && equal(node_.key(candidate), key)) {
+      // found key
+      val = node_.val(candidate);
+      return true;
+    }
+    // key not found
+    return false;
+  }
+
+
+  /**
+   * Find an element while the container may be modified concurrently, see avl_array_seqlock.h
+   * Every node index is read once (avl_array_load_once()) and range checked, and the descent stops after
+   * the maximum tree height, so a read which is torn by a concurrent modification can return a wrong result,
+   * but it never accesses memory outside of the arrays and never loops endlessly. The result is only valid
+   * if no modification happened meanwhile, which the caller has to verify.
+   * The key and value reads still race with the writer in terms of the C++ memory model (and are reported
+   * by ThreadSanitizer), they are plain copies of trivially copyable types whose result is discarded if torn.
+   * Key and value types must be trivially copyable. The arrays must not be reallocated meanwhile.
+   * \param key The key to find
+   * \param val If key is found, the value of the element is set
+   * \return True if key was found
+   */
+  inline bool find_bounded(const key_type& key, value_type& val) const
+  {
+    size_type i = avl_array_load_once(root_);
+    std::size_t depth = 0U;
+    for (; (depth < MAX_HEIGHT) && (static_cast<std::size_t>(i) < static_cast<std::size_t>(Size)); ++depth) {
+      if (less(key, node_.key(i))) {
+        i = node_.left_once(i);
+      }
+      else if (equal(key, node_.key(i))) {
+        // found key
+        stats().find(depth + 1U);
+        val = node_.val(i);
+        return true;
+      }
+      else {
+        i = node_.right_once(i);
+      }
+    }
+    // key not found (or torn read)
+    stats().find(depth);
+    return false;
+  }
+
 
-  // iterator class
-  typedef class tag_avl_array_iterator
+  /**
+   * Find a batch of elements
+   * The search paths of up to 16 keys are walked in lock step, one level of every path per round.
+   * The next node of every path is prefetched, so the memory latency of one search is hidden
+   * behind the steps of the other searches. This gives a much higher throughput than calling
+   * find() in a loop as soon as the tree doesn't fit into the cache anymore.
+   * \param keys Array of keys to find
+   * \param n Number of keys
+   * \param out Array of n values, out[i] is set if keys[i] is found
+   * \param found Array of n flags, found[i] is set true if keys[i] is found, else false
+   * \return Number of found keys
+   */
+  std::size_t find_batch(const key_type* keys, std::size_t n, value_type* out, bool* found) const
   {
-    avl_array*  instance_;    // array instance
-    size_type   idx_;         // actual node
+    std::size_t count = 0U;
+    for (std::size_t base = 0U; base < n; base += BATCH_GROUP) {
+      const std::size_t group = (n - base < BATCH_GROUP) ? n - base : BATCH_GROUP;
+      size_type node[BATCH_GROUP];        // actual node of every path
+      size_type candidate[BATCH_GROUP];   // last node whose key is not greater than the key
+      for (std::size_t g = 0U; g < group; ++g) {
+        node[g]      = root_;
+        candidate[g] = INVALID_IDX;
+      }
 
-    friend avl_array;         // avl_array may access index pointer
+      // lock step descent, like find_branchless()
+      for (bool active = true; active;) {
+        active = false;
+        for (std::size_t g = 0U; g < group; ++g) {
+          const size_type i = node[g];
+          if (i != INVALID_IDX) {
+            const size_type mask = static_cast<size_type>(-static_cast<int>(less(keys[base + g], node_.key(i))));
+            candidate[g] = (candidate[g] & mask) | (i & ~mask);
+            node[g]      = (node_.left(i) & mask) | (node_.right(i) & ~mask);
+            node_.prefetch(node[g]);
+            active = true;
+          }
+        }
+      }
 
-  public:
-    // ctor
-    tag_avl_array_iterator(avl_array* instance = nullptr, size_type idx = 0U)
-      : instance_(instance)
-      , idx_(idx)
-    { }
+      for (std::size_t g = 0U; g < group; ++g) {
+        const size_type i = candidate[g];
+        found[base + g] = (i != INVALID_IDX) && equal(node_.key(i), keys[base + g]);
+        if (found[base + g]) {
+          out[base + g] = node_.val(i);
+          count++;
+        }
+      }
+    }
+    return count;
+  }
 
-    inline tag_avl_array_iterator& operator=(const tag_avl_array_iterator& other)
-    {
-      instance_ = other.instance_;
-      idx_      = other.idx_;
-      return *this;
+
+  /**
+   * Find a batch of elements, parallel variant
+   * The keys are split into chunks of 16K keys, every chunk is searched by find_batch() as an independent task.
+   * \param keys Array of keys to find
+   * \param n Number of keys
+   * \param out Array of n values, out[i] is set if keys[i] is found
+   * \param found Array of n flags, found[i] is set true if keys[i] is found, else false
+   * \param parallel Task runner, see assign_sorted()
+   * \return Number of found keys
+   */
+  template<typename Parallel>
+  std::size_t find_batch(const key_type* keys, std::size_t n, value_type* out, bool* found, Parallel&& parallel) const
+  {
+    parallel((n + PARALLEL_CHUNK - 1U) / PARALLEL_CHUNK, [this, keys, n, out, found](std::size_t chunk) {
+      const std::size_t base = chunk * PARALLEL_CHUNK;
+      (void)find_batch(keys + base, (n - base < PARALLEL_CHUNK) ? n - base : PARALLEL_CHUNK, out + base, found + base);
+    });
+    std::size_t count = 0U;
+    for (std::size_t i = 0U; i < n; ++i) {
+      count += found[i] ? 1U : 0U;
     }
+    return count;
+  }
 
-    inline bool operator==(const tag_avl_array_iterator& rhs) const
-    { return idx_ == rhs.idx_; }
 
-    inline bool operator!=(const tag_avl_array_iterator& rhs) const
-    { return !(*this == rhs); }
+  /**
+   * Find an element and return an iterator as result
+   * \param key The key to find
+   * \return Iterator if key was found, else end() is returned
+   */
+  inline iterator find(const key_type& key)
+  { return iterator(this, find_idx(key)); }
 
-    // dereference - access value
-    inline T& operator*() const
-    { return val(); }
+  inline const_iterator find(const key_type& key) const
+  { return const_iterator(this, find_idx(key)); }
 
-    // access value
-    inline T& val() const
-    { return instance_->val_[idx_]; }
 
-    // access key
-    inline Key& key() const
-    { return instance_->key_[idx_]; }
+  /**
+   * Find the first element whose key is not less than the given key
+   * \param key The key to compare
+   * \return Iterator to the first element not less than key, end() if there is none
+   */
+  inline iterator lower_bound(const key_type& key)
+  { return iterator(this, lower_bound_idx(key)); }
 
-    // preincrement
-    tag_avl_array_iterator& operator++()
-    {
-      // end reached?
-      if (idx_ >= Size) {
-        return *this;
-      }
-      // take left most child of right child, if not existent, take parent
-      size_type i = instance_->child_[idx_].right;
-      if (i != instance_->INVALID_IDX) {
-        // successor is the furthest left node of right subtree
-        for (; i != instance_->INVALID_IDX; i = instance_->child_[i].left) {
-          idx_ = i;
-        }
-      }
-      else {
-        // have already processed the left subtree, and
-        // there is no right subtree. move up the tree,
-        // looking for a parent for which nodePtr is a left child,
-        // stopping if the parent becomes NULL. a non-NULL parent
-        // is the successor. if parent is NULL, the original node
-        // was the last node inorder, and its successor
-        // is the end of the list
-        i = instance_->get_parent(idx_);
-        while ((i != instance_->INVALID_IDX) && (idx_ == instance_->child_[i].right)) {
-          idx_ = i;
-          i = instance_->get_parent(idx_);
-        }
-        idx_ = i;
-      }
-      return *this;
-    }
+  inline const_iterator lower_bound(const key_type& key) const
+  { return const_iterator(this, lower_bound_idx(key)); }
 
-    // postincrement
-    inline tag_avl_array_iterator operator++(int)
-    {
-      tag_avl_array_iterator _copy = *this;
-      ++(*this);
-      return _copy;
+
+  /**
+   * Find the first element whose key is greater than the given key
+   * \param key The key to compare
+   * \return Iterator to the first element greater than key, end() if there is none
+   */
+  inline iterator upper_bound(const key_type& key)
+  { return iterator(this, upper_bound_idx(key)); }
+
+  inline const_iterator upper_bound(const key_type& key) const
+  { return const_iterator(this, upper_bound_idx(key)); }
+
+
+  /**
+   * Find the range of elements with a specific key
+   * Because all elements are unique, the range contains one element (if the key is found) or is empty.
+   * \param key The key to compare
+   * \return Pair of lower_bound(key) and upper_bound(key)
+   */
+  inline std::pair<iterator, iterator> equal_range(const key_type& key)
+  {
+    const size_type lower = lower_bound_idx(key);
+    const size_type upper = ((lower != INVALID_IDX) && equal(node_.key(lower), key)) ? upper_bound_idx(key) : lower;
+    return std::pair<iterator, iterator>(iterator(this, lower), iterator(this, upper));
+  }
+
+  inline std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const
+  {
+    const size_type lower = lower_bound_idx(key);
+    const size_type upper = ((lower != INVALID_IDX) && equal(node_.key(lower), key)) ? upper_bound_idx(key) : lower;
+    return std::pair<const_iterator, const_iterator>(const_iterator(this, lower), const_iterator(this, upper));
+  }
+
+
+  /**
+   * Count elements with a specific key
+   * Searches the container for elements with a key equivalent to key and returns the number of matches.
+   * Because all elements are unique, the function can only return 1 (if the element is found) or zero (otherwise).
+   * \param key The key to find/count
+   * \return 0 if key was not found, 1 if key was found
+   */
+  inline size_type count(const key_type& key) const
+  {
+    return find_idx(key) != INVALID_IDX ? 1U : 0U;
+  }
+
+
+  /**
+   * Remove element by key
+   * \param key The key of the element to remove
+   * \return True if the element ws removed, false if key was not found
+   */
+  inline bool erase(const key_type& key)
+  {
+    path_type path;
+    return erase_idx(find_path(key, path), path);
+  }
+
+
+  /**
+   * Remove element by iterator position
+   * THIS ERASE OPERATION INVALIDATES ALL ITERATORS!
+   * \param position The iterator position of the element to remove
+   * \return True if the element was successfully removed, false if error
+   */
+  bool erase(iterator position)
+  {
+    if (empty() || (position == end())) {
+      return false;
     }
-  } avl_array_iterator;
+    path_type path;
+    if (!Fast) {
+      // the path of the iterator may not be known, search it once from root
+      (void)find_path(node_.key(position.idx_), path);
+    }
+    return erase_idx(position.idx_, path);
+  }
 
 
-public:
+  /**
+   * Find the element with a specific position in key order (only in Ranked version)
+   * \param k The position, 0 is the smallest element
+   * \return Iterator to the k-th smallest element, end() if k is out of range
+   */
+  inline iterator select(size_type k)
+  {
+    static_assert(Ranked, "select() needs the Ranked version");
+    return iterator(this, select_idx(k));
+  }
 
-  typedef T                   value_type;
-  typedef T*                  pointer;
-  typedef const T*            const_pointer;
-  typedef T&                  reference;
-  typedef const T&            const_reference;
-  typedef Key                 key_type;
-  typedef avl_array_iterator  iterator;
+  inline const_iterator select(size_type k) const
+  {
+    static_assert(Ranked, "select() needs the Ranked version");
+    return const_iterator(this, select_idx(k));
+  }
 
 
-  // ctor
-  avl_array()
-    : size_(0U)
-    , root_(Size)
-  { }
+  /**
+   * Get the position of a key in key order (only in Ranked version)
+   * \param key The key to rank. The key doesn't need to exist
+   * \return Number of elements with a key less than key, which is the position of lower_bound(key)
+   */
+  inline size_type rank(const key_type& key) const
+  {
+    static_assert(Ranked, "rank() needs the Ranked version");
+    return rank_idx(key);
+  }
 
 
-  // iterators
-  inline iterator begin()
+  /**
+   * Call a function for every element in storage order (NOT key order)
+   * The element arrays are dense, so this is a sequential scan without any tree traversal.
+   * Use it for aggregations over all elements (sums, exports, checksums) where the order doesn't matter.
+   * The function must not insert or erase elements.
+   * \param f Function (or function object) called as f(const key_type& key, value_type& val)
+   */
+  template<typename Function>
+  inline void for_each_unordered(Function f)
   {
-    size_type i = INVALID_IDX;
-    if (root_ != INVALID_IDX) {
-      // find smallest element, it's the farthest node left from root
-      for (i = root_; child_[i].left != INVALID_IDX; i = child_[i].left);
+    for (size_type i = 0U; i < size_; ++i) {
+      const key_type& key = node_.key(i);   // keys must not be changed
+      f(key, value_ref(i));
     }
-    return iterator(this, i);
   }
 
-  inline iterator end()
-  { return iterator(this, INVALID_IDX); }
+  template<typename Function>
+  inline void for_each_unordered(Function f) const
+  {
+    for (size_type i = 0U; i < size_; ++i) {
+      f(node_.key(i), node_.val(i));
+    }
+  }
 
 
-  // capacity
-  inline size_type size() const
-  { return size_; }
+  /**
+   * Call a function for every element in ascending key order
+   * This is an in order walk using a stack instead of parent indices. The right subtree of every node on the
+   * stack is prefetched, so it's faster than iterating with operator++.
+   * The function must not insert or erase elements.
+   * \param f Function (or function object) called as f(const key_type& key, value_type& val)
+   */
+  template<typename Function>
+  inline void for_each_sorted(Function f)
+  { walk_sorted(*this, f); }
 
-  inline bool empty() const
-  { return size_ == static_cast<size_type>(0); }
+  template<typename Function>
+  inline void for_each_sorted(Function f) const
+  { walk_sorted(*this, f); }
 
-  inline size_type max_size() const
-  { return Size; }
+
+  /**
+   * Write the container as position independent image, see avl_array_image.h
+   * \param fd File descriptor of a file opened for writing, the image is written at file offset 0
+   * \return True if the image was written
+   */
+  template<typename Image = avl_array_image>
+  inline bool save(int fd) const
+  { return Image::save(*this, fd); }
 
 
   /**
-   * Clear the container
+   * Replace the container content by an image file, the node arrays are mapped in place, see avl_array_image.h
+   * Needs the avl_array_alloc_image allocation policy.
+   * \param path Path of the image file
+   * \param verify If true, the checksum and all links of the arrays are verified in one O(n) pass, which reads the whole file.
+   *               False maps the file without reading it, for trusted files only: a corrupt image leads to out of bounds accesses
+   * \return True if the image was loaded, false if the file can't be mapped, doesn't match the container type or is corrupt (container is empty then)
    */
-  inline void clear()
+  template<typename Image = avl_array_image>
+  inline bool load_mmap(const char* path, bool verify = true)
+  { return Image::load_mmap(*this, path, verify); }
+
+
+  /**
+   * Number of nodes modified since the last write_delta() or clear_dirty() (only in Dirty version)
+   * \return Number of modified nodes in the actual index range [0, size())
+   */
+  size_type dirty_count() const
   {
-    size_ = 0U;
-    root_ = INVALID_IDX;
+    static_assert(Dirty, "dirty_count() needs the Dirty version");
+    size_type count = 0U;
+    for (size_type i = 0U; i < size_; ++i) {
+      count += static_cast<size_type>((node_.dirty_word(static_cast<std::size_t>(i) / 64U) >> (i % 64U)) & 1U);
+    }
+    return count;
   }
 
 
   /**
-   * Insert or update an element
-   * \param key The key to insert. If the key already exists, it is updated
-   * \param val Value to insert or update
-   * \return True if the key was successfully inserted or updated, false if container is full
+   * Mark all nodes as unmodified (only in Dirty version), e.g. after save() of a full image
    */
-  bool insert(const key_type& key, const value_type& val)
+  inline void clear_dirty()
   {
-    if (root_ == INVALID_IDX) {
-      key_[size_]     = key;
-      val_[size_]     = val;
-      balance_[size_] = 0;
-      child_[size_]   = { INVALID_IDX, INVALID_IDX };
-      set_parent(size_, INVALID_IDX);
-      root_ = size_++;
-      return true;
+    static_assert(Dirty, "clear_dirty() needs the Dirty version");
+    node_.clean(size_);
+  }
+
+
+  /**
+   * Write the nodes modified since the last write_delta() or clear_dirty() as delta record, see avl_array_image.h
+   * Only in Dirty version. The marks are cleared if the record was written.
+   * \param fd File descriptor of a file (or pipe) opened for writing, the record is written at the actual position
+   * \return True if the record was written
+   */
+  template<typename Image = avl_array_image>
+  inline bool write_delta(int fd)
+  { return Image::write_delta(*this, fd); }
+
+
+  /**
+   * Apply a delta record to a container which holds the state the record is based on, see avl_array_image.h
+   * \param fd File descriptor of a file (or pipe) opened for reading, one record is read from the actual position
+   * \return True if the record was applied, false if it can't be read, is corrupted or doesn't match the container type (container unchanged)
+   */
+  template<typename Image = avl_array_image>
+  inline bool apply_delta(int fd)
+  { return Image::apply_delta(*this, fd); }
+
+
+  /**
+   * Statistics of the container operations, see avl_array_stats_counting
+   * \return The statistics policy, e.g. stats().comparisons or stats().find_depth.percentile(0.99)
+   */
+  inline const Stats& stats() const
+  { return *this; }
+
+  inline Stats& stats()
+  { return *this; }
+
+
+  /**
+   * Integrity (self) check
+   * \return True if the tree intergity is correct, false if error (should not happen normally)
+   */
+  bool check() const
+  {
+    // check root
+    if (empty() && (root_ != INVALID_IDX)) {
+      // invalid root
+      return false;
+    }
+    if (size() && root_ >= size()) {
+      // root out of bounds
+      return false;
+    }
+
+    // check tree
+    for (size_type i = 0U; i < size(); ++i)
+    {
+      if ((node_.left(i) != INVALID_IDX) && (!(node_.key(node_.left(i)) < node_.key(i)) || (node_.key(node_.left(i)) == node_.key(i)))) {
+        // wrong key order to the left
+        return false;
+      }
+      if ((node_.right(i) != INVALID_IDX) && ((node_.key(node_.right(i)) < node_.key(i)) || (node_.key(node_.right(i)) == node_.key(i)))) {
+        // wrong key order to the right
+        return false;
+      }
+      const size_type parent = get_parent(i);
+      if ((i != root_) && (parent == INVALID_IDX)) {
+        // no parent
+        return false;
+      }
+      if ((i == root_) && (parent != INVALID_IDX)) {
+        // invalid root parent
+        return false;
+      }
+      if (Ranked && (get_count(i) != static_cast<size_type>(1 + get_count(node_.left(i)) + get_count(node_.right(i))))) {
+        // wrong subtree size
+        return false;
+      }
     }
 
-    for (size_type i = root_; i != INVALID_IDX; i = (key < key_[i]) ? child_[i].left : child_[i].right) {
-      if (key < key_[i]) {
-        if (child_[i].left == INVALID_IDX) {
-          if (size_ >= max_size()) {
-            // container is full
+    // check the balance of every node against the subtree heights, iterative post order traversal
+    struct frame_type {
+      size_type   node;
+      std::size_t left_height;
+      int         stage;      // 0: descend left, 1: descend right, 2: done
+    } stack[MAX_HEIGHT];
+    std::size_t depth = 0U, height = 0U;  // height of the last completed subtree
+    if (root_ != INVALID_IDX) {
+      stack[depth++] = { root_, 0U, 0 };
+    }
+    while (depth) {
+      frame_type& frame = stack[depth - 1U];
+      if (frame.stage == 0) {
+        frame.stage = 1;
+        if (node_.left(frame.node) != INVALID_IDX) {
+          if (depth == MAX_HEIGHT) {
+            // tree too high
             return false;
           }
-          key_[size_]     = key;
-          val_[size_]     = val;
-          balance_[size_] = 0;
-          child_[size_]   = { INVALID_IDX, INVALID_IDX };
-          set_parent(size_, i);
-          child_[i].left  = size_++;
-          insert_balance(i, 1);
-          return true;
-        }
-      }
-      else if (key_[i] == key) {
-        // found same key, update node
-        val_[i] = val;
-        return true;
+          stack[depth++] = { node_.left(frame.node), 0U, 0 };
+          continue;
+        }
+        height = 0U;
       }
-      else {
-        if (child_[i].right == INVALID_IDX) {
-          if (size_ >= max_size()) {
-            // container is full
+      if (frame.stage == 1) {
+        frame.left_height = height;
+        frame.stage = 2;
+        if (node_.right(frame.node) != INVALID_IDX) {
+          if (depth == MAX_HEIGHT) {
+            // tree too high
             return false;
           }
-          key_[size_]     = key;
-          val_[size_]     = val;
-          balance_[size_] = 0;
-          child_[size_]   = { INVALID_IDX, INVALID_IDX };
-          set_parent(size_, i);
-          child_[i].right = size_++;
-          insert_balance(i, -1);
-          return true;
+          stack[depth++] = { node_.right(frame.node), 0U, 0 };
+          continue;
         }
+        height = 0U;
+      }
+      if (static_cast<int>(node_.balance(frame.node)) != static_cast<int>(frame.left_height) - static_cast<int>(height)) {
+        // wrong balance
+        return false;
       }
+      height = (frame.left_height > height ? frame.left_height : height) + 1U;
+      --depth;
     }
-    // node doesn't fit (should not happen) - discard it anyway
-    return false;
+
+    // check passed
+    return true;
   }
 
 
-  /**
-   * Find an element
-   * \param key The key to find
-   * \param val If key is found, the value of the element is set
-   * \return True if key was found
-   */
-  inline bool find(const key_type& key, value_type& val) const
+  /////////////////////////////////////////////////////////////////////////////
+  // Helper functions
+private:
+
+  // find parent element
+  inline size_type get_parent(size_type node) const
   {
-    for (size_type i = root_; i != INVALID_IDX;) {
-      if (key < key_[i]) {
-        i = child_[i].left;
-      }
-      else if (key == key_[i]) {
-        // found key
-        val = val_[i];
-        return true;
-      }
-      else {
-        i = child_[i].right;
+    if (Fast) {
+      return node_.parent(node);
+    }
+    else {
+      const Key& key_node = node_.key(node);
+      for (size_type i = root_; i != INVALID_IDX; i = less(key_node, node_.key(i)) ? node_.left(i) : node_.right(i)) {
+        if ((node_.left(i) == node) || (node_.right(i) == node)) {
+          // found parent
+          return i;
+        }
       }
+      // parent not found
+      return INVALID_IDX;
     }
-    // key not found
-    return false;
   }
 
 
-  /**
-   * Find an element and return an iterator as result
-   * \param key The key to find
-   * \return Iterator if key was found, else end() is returned
-   */
-  inline iterator find(const key_type& key)
+  // parent of node, whose ancestors are in path (slow version)
+  inline size_type get_parent(size_type node, const path_type& path) const
   {
-    for (size_type i = root_; i != INVALID_IDX;) {
-      if (key < key_[i]) {
-        i = child_[i].left;
-      } else if (key == key_[i]) {
-        // found key
-        return iterator(this, i);
-      }
-      else {
-        i = child_[i].right;
-      }
+    if (Fast) {
+      return node_.parent(node);
     }
-    // key not found, return end() iterator
-    return end();
+    return path.depth ? path.node[path.depth - 1U] : INVALID_IDX;
   }
 
 
-  /**
-   * Count elements with a specific key
-   * Searches the container for elements with a key equivalent to key and returns the number of matches.
-   * Because all elements are unique, the function can only return 1 (if the element is found) or zero (otherwise).
-   * \param key The key to find/count
-   * \return 0 if key was not found, 1 if key was found
-   */
-  inline size_type count(const key_type& key)
+  // append node to path (only in slow version)
+  static inline void push(path_type& path, size_type node)
   {
-    return find(key) != end() ? 1U : 0U;
+    if (!Fast) {
+      path.node[path.depth++] = node;
+    }
   }
 
 
-  /**
-   * Remove element by key
-   * \param key The key of the element to remove
-   * \return True if the element ws removed, false if key was not found
-   */
-  inline bool erase(const key_type& key)
+  // remove the last node from path (only in slow version)
+  static inline void pop(path_type& path)
+  {
+    if (!Fast && path.depth) {
+      path.depth--;
+    }
+  }
+
+
+  // search the node with key, path is set to its ancestors (only in slow version)
+  // returns INVALID_IDX if not found
+  size_type find_path(const key_type& key, path_type& path) const
   {
-    return erase(find(key));
+    path.depth = 0U;
+    for (size_type i = root_; i != INVALID_IDX;) {
+      if (less(key, node_.key(i))) {
+        push(path, i);
+        i = node_.left(i);
+      }
+      else if (equal(node_.key(i), key)) {
+        return i;
+      }
+      else {
+        push(path, i);
+        i = node_.right(i);
+      }
+    }
+    return INVALID_IDX;
   }
 
 
-  /**
-   * Remove element by iterator position
-   * THIS ERASE OPERATION INVALIDATES ALL ITERATORS!
-   * \param position The iterator position of the element to remove
-   * \return True if the element was successfully removed, false if error
-   */
-  bool erase(iterator position)
+  // remove node, path holds its ancestors (slow version), returns false if node is INVALID_IDX
+  bool erase_idx(size_type node, path_type& path)
   {
-    if (empty() || (position == end())) {
+    if (node == INVALID_IDX) {
       return false;
     }
 
-    const size_type node  = position.idx_;
-    const size_type left  = child_[node].left;
-    const size_type right = child_[node].right;
+    const size_type left  = node_.left(node);
+    const size_type right = node_.right(node);
 
     if (left == INVALID_IDX) {
+      const size_type parent = get_parent(node, path);
+      pop(path);
+      update_count_path(parent, false, path);
       if (right == INVALID_IDX) {
-        const size_type parent = get_parent(node);
         if (parent != INVALID_IDX) {
-          if (child_[parent].left == node) {
-            child_[parent].left = INVALID_IDX;
-            delete_balance(parent, -1);
+          if (node_.left(parent) == node) {
+            node_.set_left(parent, INVALID_IDX);
+            delete_balance(parent, -1, path);
           }
           else {
-            child_[parent].right = INVALID_IDX;
-            delete_balance(parent, 1);
+            node_.set_right(parent, INVALID_IDX);
+            delete_balance(parent, 1, path);
           }
         }
         else {
           root_ = INVALID_IDX;
+          stats().erase_rebalance();   // empty path
         }
       }
       else {
-        const size_type parent = get_parent(node);
         if (parent != INVALID_IDX) {
-          child_[parent].left == node ? child_[parent].left = right : child_[parent].right = right;
+          node_.left(parent) == node ? node_.set_left(parent, right) : node_.set_right(parent, right);
+          push(path, parent);
         }
         else {
           root_ = right;
         }
         set_parent(right, parent);
-        delete_balance(right, 0);
+        delete_balance(right, 0, path);
       }
     }
     else if (right == INVALID_IDX) {
-      const size_type parent = get_parent(node);
+      const size_type parent = get_parent(node, path);
+      pop(path);
+      update_count_path(parent, false, path);
       if (parent != INVALID_IDX) {
-        child_[parent].left == node ? child_[parent].left = left : child_[parent].right = left;
+        node_.left(parent) == node ? node_.set_left(parent, left) : node_.set_right(parent, left);
+        push(path, parent);
       }
       else {
         root_ = left;
       }
       set_parent(left, parent);
-      delete_balance(left, 0);
+      delete_balance(left, 0, path);
     }
     else {
+      // the successor takes the place of node, so the ancestors of node are the ancestors of the successor
+      const size_type parent = get_parent(node, path);
       size_type successor = right;
-      if (child_[successor].left == INVALID_IDX) {
-        const size_type parent = get_parent(node);
-        child_[successor].left = left;
-        balance_[successor] = balance_[node];
+      if (node_.left(successor) == INVALID_IDX) {
+        update_count_path(node, false, path);
+        node_.set_left(successor, left);
+        node_.set_balance(successor, node_.balance(node));
+        set_count(successor, get_count(node));
         set_parent(successor, parent);
         set_parent(left, successor);
 
@@ -413,382 +2309,791 @@ public:
           root_ = successor;
         }
         else {
-          if (child_[parent].left == node) {
-            child_[parent].left = successor;
+          if (node_.left(parent) == node) {
+            node_.set_left(parent, successor);
           }
           else {
-            child_[parent].right = successor;
+            node_.set_right(parent, successor);
           }
         }
-        delete_balance(successor, 1);
+        delete_balance(successor, 1, path);
       }
       else {
-        while (child_[successor].left != INVALID_IDX) {
-          successor = child_[successor].left;
+        // record the way down to the successor, node is replaced by the successor later
+        const std::size_t node_depth = path.depth;
+        push(path, node);
+        while (node_.left(successor) != INVALID_IDX) {
+          push(path, successor);
+          successor = node_.left(successor);
         }
 
-        const size_type parent           = get_parent(node);
-        const size_type successor_parent = get_parent(successor);
-        const size_type successor_right  = child_[successor].right;
+        const size_type successor_parent = get_parent(successor, path);
+        const size_type successor_right  = node_.right(successor);
+        pop(path);
+        update_count_path(successor_parent, false, path);
+        if (!Fast) {
+          path.node[node_depth] = successor;
+        }
 
-        if (child_[successor_parent].left == successor) {
-          child_[successor_parent].left = successor_right;
+        if (node_.left(successor_parent) == successor) {
+          node_.set_left(successor_parent, successor_right);
         }
         else {
-          child_[successor_parent].right = successor_right;
+          node_.set_right(successor_parent, successor_right);
         }
 
         set_parent(successor_right, successor_parent);
         set_parent(successor, parent);
         set_parent(right, successor);
         set_parent(left, successor);
-        child_[successor].left  = left;
-        child_[successor].right = right;
-        balance_[successor]     = balance_[node];
+        node_.set_left(successor, left);
+        node_.set_right(successor, right);
+        node_.set_balance(successor, node_.balance(node));
+        set_count(successor, get_count(node));
 
         if (node == root_) {
           root_ = successor;
         }
         else {
-          if (child_[parent].left == node) {
-            child_[parent].left = successor;
+          if (node_.left(parent) == node) {
+            node_.set_left(parent, successor);
           }
           else {
-            child_[parent].right = successor;
+            node_.set_right(parent, successor);
           }
         }
-        delete_balance(successor_parent, -1);
+        delete_balance(successor_parent, -1, path);
       }
     }
     size_--;
+    destroy(node);
 
     // relocate the node at the end to the deleted node, if it's not the deleted one
     if (node != size_) {
+      stats().relocate();
       size_type parent = INVALID_IDX;
       if (root_ == size_) {
         root_ = node;
       }
       else {
         parent = get_parent(size_);
-          child_[parent].left == size_ ? child_[parent].left = node : child_[parent].right = node;
-        }
+        node_.left(parent) == size_ ? node_.set_left(parent, node) : node_.set_right(parent, node);
+      }
 
       // correct childs parent
-      set_parent(child_[size_].left,  node);
-      set_parent(child_[size_].right, node);
+      set_parent(node_.left(size_),  node);
+      set_parent(node_.right(size_), node);
 
       // move content
-      key_[node]     = key_[size_];
-      val_[node]     = val_[size_];
-      balance_[node] = balance_[size_];
-      child_[node]   = child_[size_];
+      construct(node, std::move(node_.key(size_)), std::move(node_.val(size_)));
+      destroy(size_);
+      node_.set_balance(node, node_.balance(size_));
+      node_.set_left(node, node_.left(size_));
+      node_.set_right(node, node_.right(size_));
       set_parent(node, parent);
+      set_count(node, get_count(size_));
     }
 
     return true;
   }
 
 
-  /**
-   * Integrity (self) check
-   * \return True if the tree intergity is correct, false if error (should not happen normally)
-   */   
-  bool check() const
+  // set parent element (only in Fast version)
+  inline void set_parent(size_type node, size_type parent)
   {
-    // check root
-    if (empty() && (root_ != INVALID_IDX)) {
-      // invalid root
-      return false;
+    if (Fast) {
+      if (node != INVALID_IDX) {
+        node_.set_parent(node, parent);
+      }
     }
-    if (size() && root_ >= size()) {
-      // root out of bounds
+  }
+
+
+  // get subtree size, zero for an invalid node (only in Ranked version)
+  inline size_type get_count(size_type node) const
+  {
+    return (Ranked && (node != INVALID_IDX)) ? node_.count(node) : 0;
+  }
+
+
+  // set subtree size (only in Ranked version)
+  inline void set_count(size_type node, size_type count)
+  {
+    if (Ranked) {
+      node_.set_count(node, count);
+    }
+  }
+
+
+  // recalculate the subtree size of node from its childs (only in Ranked version)
+  inline void update_count(size_type node)
+  {
+    if (Ranked) {
+      node_.set_count(node, static_cast<size_type>(1 + get_count(node_.left(node)) + get_count(node_.right(node))));
+    }
+  }
+
+
+  // increment (insert) or decrement (erase) the subtree size of node and all its ancestors (only in Ranked version)
+  // path holds the ancestors of node (slow version)
+  inline void update_count_path(size_type node, bool increment, const path_type& path)
+  {
+    if (Ranked) {
+      for (std::size_t depth = path.depth; node != INVALID_IDX;) {
+        node_.set_count(node, static_cast<size_type>(increment ? node_.count(node) + 1 : node_.count(node) - 1));
+        if (Fast) {
+          node = node_.parent(node);
+        }
+        else {
+          node = depth ? path.node[--depth] : INVALID_IDX;
+        }
+      }
+    }
+  }
+
+
+  // make node usable, the arrays grow geometrically if the allocation policy supports it
+  // the nodes [0, live) are kept, returns false if the container is full
+  inline bool room(size_type node, size_type live)
+  {
+    const size_type capacity = node_.capacity();
+    if (node < capacity) {
+      return true;
+    }
+    const size_type max = node_.max_size();
+    size_type n = (capacity < max / 2) ? static_cast<size_type>(capacity * 2) : max;
+    n = (n < ROOM_MIN) ? ((ROOM_MIN < max) ? static_cast<size_type>(ROOM_MIN) : max) : n;
+    return (node < n) && node_.reserve(n, live);
+  }
+
+
+  // key comparisons of the searches, counted by the statistics policy
+  inline bool less(const key_type& a, const key_type& b) const
+  {
+    stats().compare();
+    return a < b;
+  }
+
+  inline bool equal(const key_type& a, const key_type& b) const
+  {
+    stats().compare();
+    return a == b;
+  }
+
+
+  // mark a node as modified (only in Dirty version)
+  inline void touch(size_type node, std::true_type)
+  { node_.mark(node); }
+
+  inline void touch(size_type, std::false_type)
+  { }
+
+
+  // value access for the caller, a non-const access marks the node as modified (only in Dirty version)
+  inline value_type& value_ref(size_type node)
+  {
+    touch(node, std::integral_constant<bool, Dirty>());
+    return node_.val(node);
+  }
+
+  inline const value_type& value_ref(size_type node) const
+  { return node_.val(node); }
+
+
+  // construct key and value of an unused node, the value is constructed from args
+  template<typename K, typename... Args>
+  inline void construct(size_type node, K&& key, Args&&... args)
+  {
+    ::new (static_cast<void*>(&node_.key(node))) key_type(std::forward<K>(key));
+    ::new (static_cast<void*>(&node_.val(node))) value_type(std::forward<Args>(args)...);
+  }
+
+
+  // destroy key and value of a node
+  inline void destroy(size_type node)
+  {
+    node_.key(node).~key_type();
+    node_.val(node).~value_type();
+  }
+
+
+  // copy (or move) all elements and the tree structure of other, the container must be empty
+  void copy_from(const avl_array& other)
+  {
+    if (!node_.reserve(other.size_, 0U)) {
+      return;
+    }
+    for (size_type i = 0U; i < other.size_; ++i) {
+      construct(i, other.node_.key(i), other.node_.val(i));
+      copy_node(other, i);
+    }
+    size_ = other.size_;
+    root_ = other.root_;
+  }
+
+  void move_from(avl_array& other)
+  {
+    if (!node_.reserve(other.size_, 0U)) {
+      return;
+    }
+    for (size_type i = 0U; i < other.size_; ++i) {
+      construct(i, std::move(other.node_.key(i)), std::move(other.node_.val(i)));
+      copy_node(other, i);
+    }
+    size_ = other.size_;
+    root_ = other.root_;
+  }
+
+  // copy the tree structure members of a node
+  inline void copy_node(const avl_array& other, size_type node)
+  {
+    node_.set_balance(node, other.node_.balance(node));
+    node_.set_left(node, other.node_.left(node));
+    node_.set_right(node, other.node_.right(node));
+    if (Fast) {
+      node_.set_parent(node, other.node_.parent(node));
+    }
+    set_count(node, other.get_count(node));
+  }
+
+
+  // insert or update, K and V are (const) key_type& or key_type&& / value_type& or value_type&&
+  template<typename K, typename V>
+  bool insert_or_assign(K&& key, V&& val)
+  {
+    size_type parent;
+    bool      left;
+    path_type path;
+    const size_type i = insert_pos(key, parent, left, path);
+    if (i != INVALID_IDX) {
+      // found same key, update node
+      node_.val(i) = std::forward<V>(val);
+      touch(i, std::integral_constant<bool, Dirty>());
+      return true;
+    }
+    if (!room(size_, size_)) {
+      // container is full
       return false;
     }
+    construct(size_, std::forward<K>(key), std::forward<V>(val));
+    insert_link(parent, left, path);
+    return true;
+  }
 
-    // check tree
-    for (size_type i = 0U; i < size(); ++i)
-    {
-      if ((child_[i].left != INVALID_IDX) && (!(key_[child_[i].left] < key_[i]) || (key_[child_[i].left] == key_[i]))) {
-        // wrong key order to the left
-        return false;
+
+  // search the node with key, INVALID_IDX if not found. Then parent is set to the leaf to attach key to
+  // (INVALID_IDX if the tree is empty), left tells on which side and path holds the ancestors of the new node
+  size_type insert_pos(const key_type& key, size_type& parent, bool& left, path_type& path) const
+  {
+    parent     = INVALID_IDX;
+    left       = false;
+    path.depth = 0U;
+    for (size_type i = root_; i != INVALID_IDX;) {
+      parent = i;
+      push(path, i);
+      left   = less(key, node_.key(i));
+      if (left) {
+        i = node_.left(i);
       }
-      if ((child_[i].right != INVALID_IDX) && ((key_[child_[i].right] < key_[i]) || (key_[child_[i].right] == key_[i]))) {
-        // wrong key order to the right
-        return false;
+      else if (equal(node_.key(i), key)) {
+        return i;
       }
-      const size_type parent = get_parent(i);
-      if ((i != root_) && (parent == INVALID_IDX)) {
-        // no parent
-        return false;
+      else {
+        i = node_.right(i);
       }
-      if ((i == root_) && (parent != INVALID_IDX)) {
-        // invalid root parent
-        return false;
+    }
+    return INVALID_IDX;
+  }
+
+
+  // link the new node at index size_, whose key and value are already constructed, as left or right child of parent
+  // and rebalance, path holds the ancestors of the new node. Returns the index of the new node
+  size_type insert_link(size_type parent, bool left, path_type& path)
+  {
+    const size_type node = size_++;
+    node_.set_balance(node, 0);
+    node_.set_left(node, INVALID_IDX);
+    node_.set_right(node, INVALID_IDX);
+    set_parent(node, parent);
+    set_count(node, 1);
+    if (parent == INVALID_IDX) {
+      root_ = node;
+      stats().insert_rebalance();   // empty path
+    }
+    else {
+      // continue with the ancestors of parent
+      pop(path);
+      update_count_path(parent, true, path);
+      if (left) {
+        node_.set_left(parent, node);
+        insert_balance(parent, 1, path);
+      }
+      else {
+        node_.set_right(parent, node);
+        insert_balance(parent, -1, path);
       }
     }
-    // check passed
-    return true;
+    return node;
   }
 
 
-  /////////////////////////////////////////////////////////////////////////////
-  // Helper functions
-private:
+  // index range of a subtree of assign_sorted()
+  typedef struct tag_range_type {
+    size_type lo;
+    size_type hi;
+  } range_type;
 
-  // find parent element
-  inline size_type get_parent(size_type node) const
+  // link the nodes [lo, hi) to a perfectly balanced subtree, top down, every node is the middle element of its
+  // index range. The parent of the subtree root must be set. If tasks is given, the ranges 'split' levels below
+  // the subtree root are not linked but appended to tasks (at most 2^split ranges), task_count is their number
+  void link_sorted(size_type lo, size_type hi, std::size_t split, range_type* tasks, std::size_t& task_count)
   {
-    if (Fast) {
-      return parent_[node];
+    // the range stack holds at most one pending range per level
+    typedef struct tag_pending_type {
+      range_type  range;
+      std::size_t level;
+    } pending_type;
+    pending_type stack[sizeof(size_type) * 8U + 2U];
+    std::size_t  top = 0U;
+
+    stack[top].range.lo = lo;
+    stack[top].range.hi = hi;
+    stack[top].level    = 0U;
+    top++;
+
+    while (top) {
+      --top;
+      if (tasks && (stack[top].level == split)) {
+        tasks[task_count++] = stack[top].range;
+        continue;
+      }
+      const size_type   range_lo  = stack[top].range.lo;
+      const size_type   range_hi  = stack[top].range.hi;
+      const std::size_t level     = stack[top].level;
+      const size_type   mid       = static_cast<size_type>(range_lo + (range_hi - range_lo) / 2);
+      const size_type   left_len  = static_cast<size_type>(mid - range_lo);
+      const size_type   right_len = static_cast<size_type>(range_hi - mid - 1);
+      const size_type   left      = left_len  ? static_cast<size_type>(range_lo + left_len / 2)   : INVALID_IDX;
+      const size_type   right     = right_len ? static_cast<size_type>(mid + 1 + right_len / 2) : INVALID_IDX;
+
+      node_.set_left(mid, left);
+      node_.set_right(mid, right);
+      set_parent(left, mid);
+      set_parent(right, mid);
+      // the left range has the same size or one element more, the left subtree is only one level higher
+      // if it's one element more and its size is a power of 2
+      node_.set_balance(mid, ((left_len > right_len) && !(left_len & (left_len - 1))) ? 1 : 0);
+      set_count(mid, static_cast<size_type>(range_hi - range_lo));
+
+      if (right_len) {
+        stack[top].range.lo = static_cast<size_type>(mid + 1);
+        stack[top].range.hi = range_hi;
+        stack[top].level    = level + 1U;
+        top++;
+      }
+      if (left_len) {
+        stack[top].range.lo = range_lo;
+        stack[top].range.hi = mid;
+        stack[top].level    = level + 1U;
+        top++;
+      }
     }
-    else {
-      const Key key_node = key_[node];
-      for (size_type i = root_; i != INVALID_IDX; i = (key_node < key_[i]) ? child_[i].left : child_[i].right) {
-        if ((child_[i].left == node) || (child_[i].right == node)) {
-          // found parent
-          return i;
+  }
+
+
+  // in order walk of for_each_sorted(), Self is a (const) avl_array
+  template<typename Self, typename Function>
+  static void walk_sorted(Self& self, Function& f)
+  {
+    size_type stack[MAX_HEIGHT];
+    std::size_t depth = 0U;
+    for (size_type i = self.root_; (i != INVALID_IDX) || depth;) {
+      // descend the left spine, prefetch the value and the right subtree of every node for the way back
+      for (; i != INVALID_IDX; i = self.node_.left(i)) {
+        const size_type right = self.node_.right(i);
+        self.node_.prefetch_val(i);
+        if (right != INVALID_IDX) {
+          self.node_.prefetch(right);
         }
+        stack[depth++] = i;
       }
-      // parent not found
-      return INVALID_IDX;
+      i = stack[--depth];
+      const key_type& key = self.node_.key(i);
+      f(key, self.value_ref(i));
+      i = self.node_.right(i);
     }
   }
 
 
-  // set parent element (only in Fast version)
-  inline void set_parent(size_type node, size_type parent)
+  // index of the smallest (or largest if last is set) element, INVALID_IDX if empty
+  size_type first_idx(bool last) const
   {
-    if (Fast) {
-      if (node != INVALID_IDX) {
-        parent_[node] = parent;
+    size_type i = root_;
+    if (i != INVALID_IDX) {
+      for (size_type n = last ? node_.right(i) : node_.left(i); n != INVALID_IDX; n = last ? node_.right(i) : node_.left(i)) {
+        i = n;
+      }
+    }
+    return i;
+  }
+
+
+  // index of key, INVALID_IDX if not found
+  size_type find_idx(const key_type& key) const
+  {
+    std::size_t depth = 0U;
+    for (size_type i = root_; i != INVALID_IDX; ++depth) {
+      if (less(key, node_.key(i))) {
+        i = node_.left(i);
+      } else if (equal(key, node_.key(i))) {
+        // found key
+        stats().find(depth + 1U);
+        return i;
+      }
+      else {
+        i = node_.right(i);
+      }
+    }
+    // key not found
+    stats().find(depth);
+    return INVALID_IDX;
+  }
+
+
+  // index of the first element not less than key, INVALID_IDX if there is none
+  size_type lower_bound_idx(const key_type& key) const
+  {
+    size_type result = INVALID_IDX;
+    for (size_type i = root_; i != INVALID_IDX;) {
+      if (less(node_.key(i), key)) {
+        i = node_.right(i);
+      }
+      else {
+        // candidate, a smaller one can only be in the left subtree
+        result = i;
+        i = node_.left(i);
+      }
+    }
+    return result;
+  }
+
+
+  // index of the first element greater than key, INVALID_IDX if there is none
+  size_type upper_bound_idx(const key_type& key) const
+  {
+    size_type result = INVALID_IDX;
+    for (size_type i = root_; i != INVALID_IDX;) {
+      if (less(key, node_.key(i))) {
+        // candidate, a smaller one can only be in the left subtree
+        result = i;
+        i = node_.left(i);
+      }
+      else {
+        i = node_.right(i);
       }
     }
+    return result;
   }
 
 
-  void insert_balance(size_type node, std::int8_t balance)
+  // find the k-th smallest node
+  size_type select_idx(size_type k) const
+  {
+    for (size_type i = root_; i != INVALID_IDX;) {
+      const size_type left = get_count(node_.left(i));
+      if (k < left) {
+        i = node_.left(i);
+      }
+      else if (k == left) {
+        return i;
+      }
+      else {
+        k = static_cast<size_type>(k - left - 1);
+        i = node_.right(i);
+      }
+    }
+    // out of range
+    return INVALID_IDX;
+  }
+
+
+  // count the nodes with a key less than key
+  size_type rank_idx(const key_type& key) const
+  {
+    size_type rank = 0;
+    for (size_type i = root_; i != INVALID_IDX;) {
+      if (less(key, node_.key(i))) {
+        i = node_.left(i);
+      }
+      else if (equal(key, node_.key(i))) {
+        return static_cast<size_type>(rank + get_count(node_.left(i)));
+      }
+      else {
+        rank = static_cast<size_type>(rank + get_count(node_.left(i)) + 1);
+        i = node_.right(i);
+      }
+    }
+    return rank;
+  }
+
+
+  // rebalance after insert, path holds the ancestors of node
+  void insert_balance(size_type node, std::int8_t balance, path_type& path)
   {
     while (node != INVALID_IDX) {
-      balance = (balance_[node] += balance);
-     
+      stats().retrace();
+      // a balance of +/-2 is never stored, the rotations set the final balance
+      balance = static_cast<std::int8_t>(node_.balance(node) + balance);
+
       if (balance == 0) {
-        return;
+        node_.set_balance(node, balance);
+        break;
       }
       else if (balance == 2) {
-        if (balance_[child_[node].left] == 1) {
-          rotate_right(node);
+        if (node_.balance(node_.left(node)) == 1) {
+          rotate_right(node, path);
         }
         else {
-          rotate_left_right(node);
+          rotate_left_right(node, path);
         }
-        return;
+        break;
       }
       else if (balance == -2) {
-        if (balance_[child_[node].right] == -1) {
-          rotate_left(node);
+        if (node_.balance(node_.right(node)) == -1) {
+          rotate_left(node, path);
         }
         else {
-          rotate_right_left(node);
+          rotate_right_left(node, path);
         }
-        return;
+        break;
       }
-     
-      const size_type parent = get_parent(node);
+      node_.set_balance(node, balance);
+
+      const size_type parent = get_parent(node, path);
+      pop(path);
       if (parent != INVALID_IDX) {
-        balance = child_[parent].left == node ? 1 : -1;
+        balance = node_.left(parent) == node ? 1 : -1;
       }
       node = parent;
     }
+    stats().insert_rebalance();
   }
 
 
-  void delete_balance(size_type node, std::int8_t balance)
+  // rebalance after erase, path holds the ancestors of node
+  void delete_balance(size_type node, std::int8_t balance, path_type& path)
   {
     while (node != INVALID_IDX) {
-      balance = (balance_[node] += balance);
+      stats().retrace();
+      // a balance of +/-2 is never stored, the rotations set the final balance
+      balance = static_cast<std::int8_t>(node_.balance(node) + balance);
 
       if (balance == -2) {
-        if (balance_[child_[node].right] <= 0) {
-          node = rotate_left(node);
-          if (balance_[node] == 1) {
-            return;
+        if (node_.balance(node_.right(node)) <= 0) {
+          node = rotate_left(node, path);
+          if (node_.balance(node) == 1) {
+            break;
           }
         }
         else {
-          node = rotate_right_left(node);
+          node = rotate_right_left(node, path);
         }
       }
       else if (balance == 2) {
-        if (balance_[child_[node].left] >= 0) {
-          node = rotate_right(node);
-          if (balance_[node] == -1) {
-            return;
+        if (node_.balance(node_.left(node)) >= 0) {
+          node = rotate_right(node, path);
+          if (node_.balance(node) == -1) {
+            break;
           }
         }
         else {
-          node = rotate_left_right(node);
+          node = rotate_left_right(node, path);
         }
       }
-      else if (balance != 0) {
-        return;
+      else {
+        node_.set_balance(node, balance);
+        if (balance != 0) {
+          break;
+        }
       }
 
       if (node != INVALID_IDX) {
-        const size_type parent = get_parent(node);
+        const size_type parent = get_parent(node, path);
+        pop(path);
         if (parent != INVALID_IDX) {
-          balance = child_[parent].left == node ? -1 : 1;
+          balance = node_.left(parent) == node ? -1 : 1;
         }
         node = parent;
       }
     }
+    stats().erase_rebalance();
   }
 
 
-  size_type rotate_left(size_type node)
+  // path holds the ancestors of node, they are the ancestors of the new subtree root as well
+  size_type rotate_left(size_type node, const path_type& path)
   {
-    const size_type right      = child_[node].right;
-    const size_type right_left = child_[right].left;
-    const size_type parent     = get_parent(node);
+    stats().rotate_left();
+    const size_type right      = node_.right(node);
+    const size_type right_left = node_.left(right);
+    const size_type parent     = get_parent(node, path);
 
     set_parent(right, parent);
     set_parent(node, right);
     set_parent(right_left, node);
-    child_[right].left = node;
-    child_[node].right = right_left;
+    node_.set_left(right, node);
+    node_.set_right(node, right_left);
 
     if (node == root_) {
       root_ = right;
     }
-    else if (child_[parent].right == node) {
-      child_[parent].right = right;
+    else if (node_.right(parent) == node) {
+      node_.set_right(parent, right);
     }
     else {
-      child_[parent].left = right;
+      node_.set_left(parent, right);
     }
 
-    balance_[right]++;
-    balance_[node] = -balance_[right];
+    node_.set_balance(right, static_cast<std::int8_t>(node_.balance(right) + 1));
+    node_.set_balance(node, static_cast<std::int8_t>(-node_.balance(right)));
+
+    update_count(node);
+    update_count(right);
 
     return right;
   }
 
 
-  size_type rotate_right(size_type node)
+  size_type rotate_right(size_type node, const path_type& path)
   {
-    const size_type left       = child_[node].left;
-    const size_type left_right = child_[left].right;
-    const size_type parent     = get_parent(node);
+    stats().rotate_right();
+    const size_type left       = node_.left(node);
+    const size_type left_right = node_.right(left);
+    const size_type parent     = get_parent(node, path);
 
     set_parent(left, parent);
     set_parent(node, left);
     set_parent(left_right, node);
-    child_[left].right = node;
-    child_[node].left  = left_right;
+    node_.set_right(left, node);
+    node_.set_left(node, left_right);
 
     if (node == root_) {
       root_ = left;
     }
-    else if (child_[parent].left == node) {
-      child_[parent].left = left;
+    else if (node_.left(parent) == node) {
+      node_.set_left(parent, left);
     }
     else {
-      child_[parent].right = left;
+      node_.set_right(parent, left);
     }
 
-    balance_[left]--;
-    balance_[node] = -balance_[left];
+    node_.set_balance(left, static_cast<std::int8_t>(node_.balance(left) - 1));
+    node_.set_balance(node, static_cast<std::int8_t>(-node_.balance(left)));
+
+    update_count(node);
+    update_count(left);
 
     return left;
   }
 
 
-  size_type rotate_left_right(size_type node)
+  size_type rotate_left_right(size_type node, const path_type& path)
   {
-    const size_type left             = child_[node].left;
-    const size_type left_right       = child_[left].right;
-    const size_type left_right_right = child_[left_right].right;
-    const size_type left_right_left  = child_[left_right].left;
-    const size_type parent           = get_parent(node);
+    stats().rotate_left_right();
+    const size_type left             = node_.left(node);
+    const size_type left_right       = node_.right(left);
+    const size_type left_right_right = node_.right(left_right);
+    const size_type left_right_left  = node_.left(left_right);
+    const size_type parent           = get_parent(node, path);
 
     set_parent(left_right, parent);
     set_parent(left, left_right);
     set_parent(node, left_right);
     set_parent(left_right_right, node);
     set_parent(left_right_left, left);
-    child_[node].left        = left_right_right;
-    child_[left].right       = left_right_left;
-    child_[left_right].left  = left;
-    child_[left_right].right = node;
+    node_.set_left(node, left_right_right);
+    node_.set_right(left, left_right_left);
+    node_.set_left(left_right, left);
+    node_.set_right(left_right, node);
 
     if (node == root_) {
       root_ = left_right;
     }
-    else if (child_[parent].left == node) {
-      child_[parent].left = left_right;
+    else if (node_.left(parent) == node) {
+      node_.set_left(parent, left_right);
     }
     else {
-      child_[parent].right = left_right;
+      node_.set_right(parent, left_right);
     }
 
-    if (balance_[left_right] == 0) {
-      balance_[node] = 0;
-      balance_[left] = 0;
+    if (node_.balance(left_right) == 0) {
+      node_.set_balance(node, 0);
+      node_.set_balance(left, 0);
     }
-    else if (balance_[left_right] == -1) {
-      balance_[node] = 0;
-      balance_[left] = 1;
+    else if (node_.balance(left_right) == -1) {
+      node_.set_balance(node, 0);
+      node_.set_balance(left, 1);
     }
     else {
-      balance_[node] = -1;
-      balance_[left] = 0;
+      node_.set_balance(node, -1);
+      node_.set_balance(left, 0);
     }
-    balance_[left_right] = 0;
+    node_.set_balance(left_right, 0);
+
+    update_count(left);
+    update_count(node);
+    update_count(left_right);
 
     return left_right;
   }
 
 
-  size_type rotate_right_left(size_type node)
+  size_type rotate_right_left(size_type node, const path_type& path)
   {
-    const size_type right            = child_[node].right;
-    const size_type right_left       = child_[right].left;
-    const size_type right_left_left  = child_[right_left].left;
-    const size_type right_left_right = child_[right_left].right;
-    const size_type parent           = get_parent(node);
+    stats().rotate_right_left();
+    const size_type right            = node_.right(node);
+    const size_type right_left       = node_.left(right);
+    const size_type right_left_left  = node_.left(right_left);
+    const size_type right_left_right = node_.right(right_left);
+    const size_type parent           = get_parent(node, path);
 
     set_parent(right_left, parent);
     set_parent(right, right_left);
     set_parent(node, right_left);
     set_parent(right_left_left, node);
     set_parent(right_left_right, right);
-    child_[node].right       = right_left_left;
-    child_[right].left       = right_left_right;
-    child_[right_left].right = right;
-    child_[right_left].left  = node;
+    node_.set_right(node, right_left_left);
+    node_.set_left(right, right_left_right);
+    node_.set_right(right_left, right);
+    node_.set_left(right_left, node);
 
     if (node == root_) {
       root_ = right_left;
     }
-    else if (child_[parent].right == node) {
-      child_[parent].right = right_left;
+    else if (node_.right(parent) == node) {
+      node_.set_right(parent, right_left);
     }
     else {
-      child_[parent].left = right_left;
+      node_.set_left(parent, right_left);
     }
 
-    if (balance_[right_left] == 0) {
-      balance_[node]  = 0;
-      balance_[right] = 0;
+    if (node_.balance(right_left) == 0) {
+      node_.set_balance(node, 0);
+      node_.set_balance(right, 0);
     }
-    else if (balance_[right_left] == 1) {
-      balance_[node]  = 0;
-      balance_[right] = -1;
+    else if (node_.balance(right_left) == 1) {
+      node_.set_balance(node, 0);
+      node_.set_balance(right, -1);
     }
     else {
-      balance_[node]  = 1;
-      balance_[right] = 0;
+      node_.set_balance(node, 1);
+      node_.set_balance(right, 0);
     }
-    balance_[right_left] = 0;
+    node_.set_balance(right_left, 0);
+
+    update_count(node);
+    update_count(right);
+    update_count(right_left);
 
     return right_left;
   }
@@ -0,0 +1,778 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief avl_array image files
+// The nodes of an avl_array are linked by index, so the node arrays are position
+// independent. avl_array::save() writes them unchanged to a file, behind a header
+// which holds the format version, the byte order, Size, the key, value and index
+// sizes, the layout of every array and checksums. Every array starts at a 64K
+// aligned file offset.
+// avl_array::load_mmap() maps the arrays of an image file in place (private
+// copy on write mappings), nothing is deserialized. By default the mapped arrays
+// are verified: the checksum and every link (child and parent indices, balance,
+// subtree size) are checked in one O(n) pass, so a corrupt or truncated image is
+// rejected instead of leading to out of bounds accesses. Without verification the
+// pages are read on first access and loading takes the same time for any image
+// size, use that only for trusted files (e.g. written by this process). The container needs
+// the avl_array_alloc_image allocation policy, which behaves like
+// avl_array_alloc_dynamic but can adopt a file mapping as array. The mapped
+// arrays are used until the container grows, then they are copied to the heap.
+// Modifications are never written back to the file.
+// Key and value types must be trivially copyable (and must not hold pointers).
+// The image can only be loaded by a container of the same type on a machine
+// with the same byte order. This needs a POSIX system (pread/pwrite/mmap).
+// Containers with the 'Dirty' parameter mark every modified node in a bitmap.
+// avl_array::write_delta() appends the modified nodes as delta record to a
+// file (or pipe) and clears the marks, avl_array::apply_delta() reads one record
+// and writes the nodes into a container which holds the state the record is
+// based on (e.g. the last full image and all older records). A checkpoint costs
+// I/O in proportion to the number of modified nodes, not to the capacity.
+//
+// usage:
+// #include "avl_array_image.h"
+// avl_array<std::uint64_t, rec, std::uint32_t, 64U * 1024U * 1024U, true, avl_array_layout_soa, false, avl_array_alloc_image> avl;
+// avl.save(fd);
+// avl.load_mmap("index.img");
+// avl_array<std::uint64_t, rec, std::uint32_t, 64U * 1024U * 1024U, true, avl_array_layout_soa, false, avl_array_alloc_image, true> dirty;
+// dirty.write_delta(log_fd);             // primary
+// replica.apply_delta(log_fd);           // replica, or recovery after load_mmap() of the last full image
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AVL_ARRAY_IMAGE_H_
+#define _AVL_ARRAY_IMAGE_H_
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+#include "avl_array.h"
+
+
+/**
+ * Heap allocation with runtime capacity, like avl_array_alloc_dynamic, whose arrays can be mapped from an image file
+ */
+struct avl_array_alloc_image
+{
+  template<typename Type, std::size_t N>
+  class array
+  {
+    Type*       data_;      // heap or mapped array
+    std::size_t capacity_;  // usable elements
+    std::size_t mapped_;    // length of the file mapping, 0 if the array is on the heap
+
+  public:
+    array()
+      : data_(nullptr)
+      , capacity_(0U)
+      , mapped_(0U)
+    { }
+
+    // elements are destroyed by the container, only the memory is freed
+    ~array()
+    { free(); }
+
+    // the array is used like a built-in array
+    inline operator Type*()                             { return data_; }
+    inline operator const Type*() const                 { return data_; }
+
+    // true if the array memory for N elements is available
+    inline bool valid() const
+    { return true; }
+
+    // number of elements which are usable now
+    inline std::size_t capacity() const
+    { return capacity_; }
+
+    // make n (max N) elements usable, the living elements [0, live) are moved by relocate
+    // a mapped array is copied to the heap
+    template<typename Relocate>
+    bool reserve(std::size_t n, std::size_t live, Relocate relocate)
+    {
+      if (n <= capacity_) {
+        return true;
+      }
+      return (n <= N) && resize(n, live, relocate);
+    }
+
+    // shrink the array to the living elements [0, first)
+    template<typename Relocate>
+    void release(std::size_t first, Relocate relocate)
+    {
+      if (first < capacity_) {
+        (void)resize(first, first, relocate);
+      }
+    }
+
+    /**
+     * Replace the array by n elements of a file, mapped private (modifications are not written to the file)
+     * \param fd File descriptor
+     * \param offset File offset of the first element, a multiple of the page size
+     * \param n Number of elements
+     * \return True if the file was mapped, the array is empty otherwise
+     */
+    bool attach(int fd, std::uint64_t offset, std::size_t n)
+    {
+      free();
+      if ((n == 0U) || (n > N)) {
+        return n == 0U;
+      }
+      void* addr = ::mmap(nullptr, n * sizeof(Type), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+      if (addr == MAP_FAILED) {
+        return false;
+      }
+      data_     = static_cast<Type*>(addr);
+      capacity_ = n;
+      mapped_   = n * sizeof(Type);
+      return true;
+    }
+
+  private:
+    template<typename Relocate>
+    bool resize(std::size_t n, std::size_t live, Relocate relocate)
+    {
+      Type* data = nullptr;
+      if (n) {
+        data = static_cast<Type*>(avl_array_heap_aligned::allocate(n * sizeof(Type), std::nothrow));
+        if (!data) {
+          return false;
+        }
+        relocate(data, data_, live);
+      }
+      free();
+      data_     = data;
+      capacity_ = n;
+      return true;
+    }
+
+    void free()
+    {
+      if (mapped_) {
+        (void)::munmap(data_, mapped_);
+      }
+      else {
+        avl_array_heap_aligned::deallocate(data_);
+      }
+      data_     = nullptr;
+      capacity_ = 0U;
+      mapped_   = 0U;
+    }
+
+    // not copyable, every container owns its arrays
+    array(const array&);
+    array& operator=(const array&);
+  };
+};
+
+
+/**
+ * Image file and delta record functions, called by avl_array::save(), load_mmap(), write_delta() and apply_delta()
+ */
+struct avl_array_image
+{
+  // format version, incremented with every incompatible change
+  static const std::uint32_t VERSION = 1U;
+
+  // file alignment of the arrays, a multiple of all common page sizes
+  static const std::uint64_t ALIGN = 65536U;
+
+  // maximum number of node arrays of a layout
+  static const std::size_t MAX_ARRAYS = 6U;
+
+  // byte order mark, written in native byte order
+  static const std::uint32_t ENDIAN = 0x01020304U;
+
+  // file header, at file offset 0
+  typedef struct tag_header_type {
+    char          magic[8];                 // "AVLARRAY"
+    std::uint32_t version;                  // VERSION
+    std::uint32_t endian;                   // ENDIAN
+    std::uint64_t size_max;                 // Size
+    std::uint32_t key_bytes;                // sizeof(Key)
+    std::uint32_t val_bytes;                // sizeof(T)
+    std::uint32_t index_bytes;              // sizeof(size_type)
+    std::uint32_t flags;                    // bit 0: Fast, bit 1: Ranked
+    std::uint64_t size;                     // number of elements
+    std::uint64_t root;                     // root node
+    std::uint64_t align;                    // ALIGN
+    std::uint32_t arrays;                   // number of node arrays
+    std::uint32_t elem_bytes[MAX_ARRAYS];   // element size of every array
+    std::uint32_t reserved;
+    std::uint64_t offset[MAX_ARRAYS];       // file offset of every array
+    std::uint64_t data_checksum;            // checksum of all array bytes
+    std::uint64_t header_checksum;          // checksum of the header with header_checksum = 0
+  } header_type;
+
+  // delta record header, followed by 'nodes' node records and the data checksum (std::uint64_t)
+  // a node record is the node index (std::uint64_t) followed by the node element of every array
+  typedef struct tag_delta_header_type {
+    char          magic[8];                 // "AVLDELTA"
+    std::uint32_t version;                  // VERSION
+    std::uint32_t endian;                   // ENDIAN
+    std::uint64_t size_max;                 // Size
+    std::uint32_t key_bytes;                // sizeof(Key)
+    std::uint32_t val_bytes;                // sizeof(T)
+    std::uint32_t index_bytes;              // sizeof(size_type)
+    std::uint32_t flags;                    // bit 0: Fast, bit 1: Ranked
+    std::uint64_t size;                     // number of elements
+    std::uint64_t root;                     // root node
+    std::uint64_t nodes;                    // number of node records
+    std::uint32_t arrays;                   // number of node arrays
+    std::uint32_t elem_bytes[MAX_ARRAYS];   // element size of every array
+    std::uint32_t reserved;
+    std::uint64_t header_checksum;          // checksum of the header with header_checksum = 0
+  } delta_header_type;
+
+  // buffer size of write_delta()
+  static const std::size_t DELTA_BUFFER = 16384U;
+
+
+  /**
+   * 64 bit checksum, processes 8 bytes per step
+   * \param data Data
+   * \param bytes Length of data
+   * \param sum Checksum of the preceding data, 0 at start
+   * \return Checksum
+   */
+  static std::uint64_t checksum(const void* data, std::size_t bytes, std::uint64_t sum = 0U)
+  {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    std::uint64_t h = sum ^ 0x9E3779B97F4A7C15ULL;
+    for (; bytes >= 8U; bytes -= 8U, p += 8U) {
+      std::uint64_t word;
+      std::memcpy(&word, p, 8U);
+      h = (h ^ word) * 0xFF51AFD7ED558CCDULL;
+      h ^= h >> 32U;
+    }
+    for (; bytes; --bytes, ++p) {
+      h = (h ^ *p) * 0x100000001B3ULL;
+    }
+    return h;
+  }
+
+
+  /**
+   * Write the image of a container, see avl_array::save()
+   */
+  template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast, typename Layout, const bool Ranked, typename Alloc, const bool Dirty, typename Stats>
+  static bool save(const avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc, Dirty, Stats>& avl, int fd)
+  {
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                  "avl_array images need trivially copyable key and value types");
+
+    header_type header;
+    describe(avl, header, "AVLARRAY");
+    header.align = ALIGN;
+    array_list arrays;
+    avl.node_.for_each_array(arrays);
+
+    // the arrays follow the header, every array at an aligned offset
+    std::uint64_t end = align(sizeof(header_type));
+    for (std::uint32_t a = 0U; a < header.arrays; ++a) {
+      const std::size_t bytes = static_cast<std::size_t>(header.size) * header.elem_bytes[a];
+      header.offset[a]      = end;
+      header.data_checksum  = checksum(arrays.data[a], bytes, header.data_checksum);
+      if (!write(fd, arrays.data[a], bytes, end)) {
+        return false;
+      }
+      end = align(end + bytes);
+    }
+    header.header_checksum = checksum(&header, sizeof(header_type));
+    if (!write(fd, &header, sizeof(header_type), 0U)) {
+      return false;
+    }
+    int result;
+    while (((result = ::ftruncate(fd, static_cast<off_t>(end))) < 0) && (errno == EINTR));
+    return !result;
+  }
+
+
+  /**
+   * Map the image file into a container, see avl_array::load_mmap()
+   */
+  template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast, typename Layout, const bool Ranked, typename Alloc, const bool Dirty, typename Stats>
+  static bool load_mmap(avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc, Dirty, Stats>& avl, const char* path, bool verify)
+  {
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                  "avl_array images need trivially copyable key and value types");
+    static_assert(std::is_same<Alloc, avl_array_alloc_image>::value, "load_mmap() needs the avl_array_alloc_image allocation policy");
+
+    avl.clear();
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+
+    // the header must match the container type exactly
+    header_type expected, header;
+    describe(avl, expected, "AVLARRAY");
+    expected.align = ALIGN;
+    struct stat st;
+    bool ok = !::fstat(fd, &st) && read(fd, &header, sizeof(header_type), 0U);
+    if (ok) {
+      const std::uint64_t header_checksum = header.header_checksum;
+      header.header_checksum = 0U;
+      ok = (checksum(&header, sizeof(header_type)) == header_checksum) &&
+           !std::memcmp(header.magic, expected.magic, sizeof(header.magic)) &&
+           (header.version == expected.version) && (header.endian == expected.endian) && (header.size_max == expected.size_max) &&
+           (header.key_bytes == expected.key_bytes) && (header.val_bytes == expected.val_bytes) &&
+           (header.index_bytes == expected.index_bytes) && (header.flags == expected.flags) &&
+           (header.align == expected.align) && (header.arrays == expected.arrays) &&
+           !std::memcmp(header.elem_bytes, expected.elem_bytes, sizeof(header.elem_bytes)) &&
+           (header.size <= static_cast<std::uint64_t>(Size)) &&
+           (header.size ? (header.root < header.size) : (header.root == static_cast<std::uint64_t>(Size)));
+    }
+    for (std::uint32_t a = 0U; ok && (a < header.arrays); ++a) {
+      // size and element bytes are checked above, only a corrupt offset could wrap the end of the array around
+      ok = !(header.offset[a] % ALIGN) && (header.offset[a] <= static_cast<std::uint64_t>(st.st_size)) &&
+           (header.size * header.elem_bytes[a] <= static_cast<std::uint64_t>(st.st_size) - header.offset[a]);
+    }
+
+    if (ok) {
+      array_attach attach(fd, header);
+      avl.node_.for_each_array(attach);
+      // the arrays which aren't part of the image (dirty node bitmap) are allocated for the loaded nodes
+      ok = attach.ok && avl.node_.reserve(static_cast<size_type>(header.size), static_cast<size_type>(header.size));
+    }
+    ::close(fd);
+
+    if (ok && verify) {
+      array_list arrays;
+      avl.node_.for_each_array(arrays);
+      std::uint64_t sum = 0U;
+      for (std::uint32_t a = 0U; a < header.arrays; ++a) {
+        sum = checksum(arrays.data[a], static_cast<std::size_t>(header.size) * header.elem_bytes[a], sum);
+      }
+      ok = (sum == header.data_checksum) && check_links(avl, static_cast<size_type>(header.size), static_cast<size_type>(header.root));
+    }
+    if (!ok) {
+      // unmap what was mapped
+      avl.node_.release(0U);
+      return false;
+    }
+    avl.size_ = static_cast<size_type>(header.size);
+    avl.root_ = static_cast<size_type>(header.root);
+    return true;
+  }
+
+
+  /**
+   * Write the modified nodes of a container as delta record, see avl_array::write_delta()
+   */
+  template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast, typename Layout, const bool Ranked, typename Alloc, const bool Dirty, typename Stats>
+  static bool write_delta(avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc, Dirty, Stats>& avl, int fd)
+  {
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                  "avl_array deltas need trivially copyable key and value types");
+    static_assert(Dirty, "write_delta() needs the Dirty version");
+
+    delta_header_type header;
+    describe(avl, header, "AVLDELTA");
+    header.nodes = static_cast<std::uint64_t>(avl.dirty_count());
+    header.header_checksum = checksum(&header, sizeof(delta_header_type));
+    if (!write(fd, &header, sizeof(delta_header_type))) {
+      return false;
+    }
+
+    // node records, collected in a buffer, the checksum is chained record by record
+    array_list arrays;
+    avl.node_.for_each_array(arrays);
+    std::size_t record = sizeof(std::uint64_t);
+    for (std::uint32_t a = 0U; a < arrays.count; ++a) {
+      record += arrays.elem_bytes[a];
+    }
+    std::vector<unsigned char> buffer(record > DELTA_BUFFER ? record : DELTA_BUFFER);
+    std::size_t   used = 0U;
+    std::uint64_t sum  = 0U;
+    for (std::size_t word = 0U; word * 64U < static_cast<std::size_t>(avl.size_); ++word) {
+      for (std::uint64_t bits = avl.node_.dirty_word(word); bits; bits &= bits - 1U) {
+        const std::uint64_t node = word * 64U + lowest_bit(bits);
+        if (node >= static_cast<std::uint64_t>(avl.size_)) {
+          break;
+        }
+        if (used + record > buffer.size()) {
+          if (!write(fd, buffer.data(), used)) {
+            return false;
+          }
+          used = 0U;
+        }
+        unsigned char* p = buffer.data() + used;
+        std::memcpy(p, &node, sizeof(std::uint64_t));
+        std::size_t offset = sizeof(std::uint64_t);
+        for (std::uint32_t a = 0U; a < arrays.count; ++a) {
+          std::memcpy(p + offset, static_cast<const unsigned char*>(arrays.data[a]) + node * arrays.elem_bytes[a], arrays.elem_bytes[a]);
+          offset += arrays.elem_bytes[a];
+        }
+        sum   = checksum(p, record, sum);
+        used += record;
+      }
+    }
+    if (!write(fd, buffer.data(), used) || !write(fd, &sum, sizeof(std::uint64_t))) {
+      return false;
+    }
+    avl.node_.clean(avl.size_);
+    return true;
+  }
+
+
+  /**
+   * Read a delta record and apply it to a container, see avl_array::apply_delta()
+   * The whole record is read and verified before the container is modified.
+   */
+  template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast, typename Layout, const bool Ranked, typename Alloc, const bool Dirty, typename Stats>
+  static bool apply_delta(avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc, Dirty, Stats>& avl, int fd)
+  {
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                  "avl_array deltas need trivially copyable key and value types");
+
+    delta_header_type expected, header;
+    describe(avl, expected, "AVLDELTA");
+    if (!read(fd, &header, sizeof(delta_header_type))) {
+      return false;
+    }
+    const std::uint64_t header_checksum = header.header_checksum;
+    header.header_checksum = 0U;
+    if ((checksum(&header, sizeof(delta_header_type)) != header_checksum) ||
+        std::memcmp(header.magic, expected.magic, sizeof(header.magic)) ||
+        (header.version != expected.version) || (header.endian != expected.endian) || (header.size_max != expected.size_max) ||
+        (header.key_bytes != expected.key_bytes) || (header.val_bytes != expected.val_bytes) ||
+        (header.index_bytes != expected.index_bytes) || (header.flags != expected.flags) || (header.arrays != expected.arrays) ||
+        std::memcmp(header.elem_bytes, expected.elem_bytes, sizeof(header.elem_bytes)) ||
+        (header.size > static_cast<std::uint64_t>(Size)) || (header.nodes > header.size) ||
+        (header.size ? (header.root >= header.size) : (header.root != static_cast<std::uint64_t>(Size)))) {
+      return false;
+    }
+
+    // read and verify all node records
+    std::size_t record = sizeof(std::uint64_t);
+    for (std::uint32_t a = 0U; a < header.arrays; ++a) {
+      record += header.elem_bytes[a];
+    }
+    std::vector<unsigned char> records(static_cast<std::size_t>(header.nodes) * record);
+    std::uint64_t sum = 0U, expected_sum;
+    if (!read(fd, records.data(), records.size()) || !read(fd, &expected_sum, sizeof(std::uint64_t))) {
+      return false;
+    }
+    for (std::size_t r = 0U; r < records.size(); r += record) {
+      std::uint64_t node;
+      std::memcpy(&node, &records[r], sizeof(std::uint64_t));
+      if (node >= header.size) {
+        return false;
+      }
+      sum = checksum(&records[r], record, sum);
+    }
+    if (sum != expected_sum) {
+      return false;
+    }
+
+    // the nodes [0, size) must be usable, grow geometrically like insert() to avoid a relocation per delta
+    const size_type size = static_cast<size_type>(header.size);
+    if (size && !avl.room(static_cast<size_type>(size - 1U), avl.size_) && !avl.node_.reserve(size, avl.size_)) {
+      return false;
+    }
+    array_list_mutable arrays;
+    avl.node_.for_each_array(arrays);
+    for (std::size_t r = 0U; r < records.size(); r += record) {
+      std::uint64_t node;
+      std::memcpy(&node, &records[r], sizeof(std::uint64_t));
+      std::size_t offset = r + sizeof(std::uint64_t);
+      for (std::uint32_t a = 0U; a < arrays.count; ++a) {
+        std::memcpy(static_cast<unsigned char*>(arrays.data[a]) + node * arrays.elem_bytes[a], &records[offset], arrays.elem_bytes[a]);
+        offset += arrays.elem_bytes[a];
+      }
+    }
+    avl.size_ = size;
+    avl.root_ = static_cast<size_type>(header.root);
+    return true;
+  }
+
+
+private:
+  // collects the address and element size of every node array
+  struct array_list
+  {
+    const void*   data[MAX_ARRAYS];
+    std::uint32_t elem_bytes[MAX_ARRAYS];
+    std::uint32_t count;
+
+    array_list()
+      : count(0U)
+    { }
+
+    template<typename Array>
+    inline void operator()(const Array& array, std::size_t bytes)
+    {
+      data[count]       = array;
+      elem_bytes[count] = static_cast<std::uint32_t>(bytes);
+      count++;
+    }
+  };
+
+  // collects the writable address and element size of every node array
+  struct array_list_mutable
+  {
+    void*         data[MAX_ARRAYS];
+    std::uint32_t elem_bytes[MAX_ARRAYS];
+    std::uint32_t count;
+
+    array_list_mutable()
+      : count(0U)
+    { }
+
+    template<typename Array>
+    inline void operator()(Array& array, std::size_t bytes)
+    {
+      data[count]       = array;
+      elem_bytes[count] = static_cast<std::uint32_t>(bytes);
+      count++;
+    }
+  };
+
+  // maps every node array from the image file
+  struct array_attach
+  {
+    int                 fd;
+    const header_type&  header;
+    std::uint32_t       count;
+    bool                ok;
+
+    array_attach(int file, const header_type& head)
+      : fd(file)
+      , header(head)
+      , count(0U)
+      , ok(true)
+    { }
+
+    template<typename Array>
+    inline void operator()(Array& array, std::size_t bytes)
+    {
+      (void)bytes;
+      ok = ok && array.attach(fd, header.offset[count], static_cast<std::size_t>(header.size));
+      count++;
+    }
+  };
+
+  // image or delta header of a container, only the container type, size and root are set
+  template<typename Header, typename Key, typename T, typename size_type, const size_type Size, const bool Fast, typename Layout, const bool Ranked, typename Alloc, const bool Dirty, typename Stats>
+  static void describe(const avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc, Dirty, Stats>& avl, Header& header, const char* magic)
+  {
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version     = VERSION;
+    header.endian      = ENDIAN;
+    header.size_max    = static_cast<std::uint64_t>(Size);
+    header.key_bytes   = static_cast<std::uint32_t>(sizeof(Key));
+    header.val_bytes   = static_cast<std::uint32_t>(sizeof(T));
+    header.index_bytes = static_cast<std::uint32_t>(sizeof(size_type));
+    header.flags       = (Fast ? 1U : 0U) | (Ranked ? 2U : 0U);
+    header.size        = static_cast<std::uint64_t>(avl.size_);
+    header.root        = static_cast<std::uint64_t>(avl.root_);
+
+    array_list arrays;
+    avl.node_.for_each_array(arrays);
+    header.arrays = arrays.count;
+    std::memcpy(header.elem_bytes, arrays.elem_bytes, arrays.count * sizeof(std::uint32_t));
+  }
+
+  // check the links of the nodes [0, size) of a mapped image, every index is range checked before it is followed:
+  // the childs link all nodes to one tree below root, the parents match, every balance matches the subtree heights
+  // (so the height is bounded like in any AVL tree) and the subtree sizes add up. The keys are not compared
+  template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast, typename Layout, const bool Ranked, typename Alloc, const bool Dirty, typename Stats>
+  static bool check_links(const avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc, Dirty, Stats>& avl, size_type size, size_type root)
+  {
+    if (!size) {
+      return true;
+    }
+    if (Fast && (avl.node_.parent(root) != Size)) {
+      // invalid root parent
+      return false;
+    }
+
+    // breadth first order of the tree, a node must not be reached twice
+    std::vector<size_type> order;
+    std::vector<bool>      reached(static_cast<std::size_t>(size), false);
+    order.reserve(static_cast<std::size_t>(size));
+    order.push_back(root);
+    reached[static_cast<std::size_t>(root)] = true;
+    for (std::size_t i = 0U; i < order.size(); ++i) {
+      const size_type node     = order[i];
+      const size_type child[2] = { avl.node_.left(node), avl.node_.right(node) };
+      for (std::size_t c = 0U; c < 2U; ++c) {
+        if (child[c] == Size) {
+          continue;
+        }
+        if ((child[c] >= size) || reached[static_cast<std::size_t>(child[c])] || (Fast && (avl.node_.parent(child[c]) != node))) {
+          // out of bounds, linked twice or wrong parent
+          return false;
+        }
+        reached[static_cast<std::size_t>(child[c])] = true;
+        order.push_back(child[c]);
+      }
+    }
+    if (order.size() != static_cast<std::size_t>(size)) {
+      // unreachable nodes
+      return false;
+    }
+
+    // bottom up, the childs of a node are checked before the node
+    std::vector<unsigned char> height(static_cast<std::size_t>(size));
+    for (std::size_t i = order.size(); i--;) {
+      const size_type node  = order[i];
+      const size_type left  = avl.node_.left(node);
+      const size_type right = avl.node_.right(node);
+      const int left_height  = (left  == Size) ? 0 : static_cast<int>(height[static_cast<std::size_t>(left)]);
+      const int right_height = (right == Size) ? 0 : static_cast<int>(height[static_cast<std::size_t>(right)]);
+      if ((static_cast<int>(avl.node_.balance(node)) != left_height - right_height) || (left_height - right_height > 1) || (right_height - left_height > 1)) {
+        // wrong balance
+        return false;
+      }
+      height[static_cast<std::size_t>(node)] = static_cast<unsigned char>(1 + (left_height > right_height ? left_height : right_height));
+      if (Ranked) {
+        const std::uint64_t count = 1U + ((left == Size) ? 0U : static_cast<std::uint64_t>(avl.node_.count(left))) +
+                                         ((right == Size) ? 0U : static_cast<std::uint64_t>(avl.node_.count(right)));
+        if (static_cast<std::uint64_t>(avl.node_.count(node)) != count) {
+          // wrong subtree size
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // index of the lowest set bit, bits must not be 0
+  static inline std::size_t lowest_bit(std::uint64_t bits)
+  {
+#if defined(__GNUC__)
+    return static_cast<std::size_t>(__builtin_ctzll(bits));
+#else
+    std::size_t bit = 0U;
+    for (; !(bits & 1U); bits >>= 1U) {
+      ++bit;
+    }
+    return bit;
+#endif
+  }
+
+  static inline std::uint64_t align(std::uint64_t offset)
+  { return (offset + ALIGN - 1U) & ~(ALIGN - 1U); }
+
+  // write all bytes at the actual file position, returns false on error, a signal interruption is retried
+  static bool write(int fd, const void* data, std::size_t bytes)
+  {
+    const char* p = static_cast<const char*>(data);
+    while (bytes) {
+      const ssize_t n = ::write(fd, p, bytes);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      if (n == 0) {
+        // no progress, e.g. the device is full
+        return false;
+      }
+      p     += n;
+      bytes -= static_cast<std::size_t>(n);
+    }
+    return true;
+  }
+
+  // read all bytes from the actual file position, returns false on error or end of file, a signal interruption is retried
+  static bool read(int fd, void* data, std::size_t bytes)
+  {
+    char* p = static_cast<char*>(data);
+    while (bytes) {
+      const ssize_t n = ::read(fd, p, bytes);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      if (n == 0) {
+        // end of file, short read
+        return false;
+      }
+      p     += n;
+      bytes -= static_cast<std::size_t>(n);
+    }
+    return true;
+  }
+
+  // write all bytes at offset, returns false on error, a signal interruption is retried
+  static bool write(int fd, const void* data, std::size_t bytes, std::uint64_t offset)
+  {
+    const char* p = static_cast<const char*>(data);
+    while (bytes) {
+      const ssize_t n = ::pwrite(fd, p, bytes, static_cast<off_t>(offset));
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      if (n == 0) {
+        // no progress, e.g. the device is full
+        return false;
+      }
+      p      += n;
+      bytes  -= static_cast<std::size_t>(n);
+      offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+  }
+
+  // read all bytes at offset, returns false on error or end of file, a signal interruption is retried
+  static bool read(int fd, void* data, std::size_t bytes, std::uint64_t offset)
+  {
+    char* p = static_cast<char*>(data);
+    while (bytes) {
+      const ssize_t n = ::pread(fd, p, bytes, static_cast<off_t>(offset));
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      if (n == 0) {
+        // end of file, short read
+        return false;
+      }
+      p      += n;
+      bytes  -= static_cast<std::size_t>(n);
+      offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+  }
+};
+
+#endif  // _AVL_ARRAY_IMAGE_H_
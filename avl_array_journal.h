@@ -0,0 +1,705 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief avl_array_journal class
+// Write-ahead log of an avl_array for crash recovery. insert() and erase()
+// modify the container and append a compact binary record (operation, key,
+// value, checksum) to an in-memory batch. The batch is written and synced
+// to the log file as a whole (group commit): a writer which needs its record
+// on disk waits until a sync covers it, and all writers which append while
+// a sync is running share the next one. So the number of fsync calls depends
+// on the sync latency, not on the write rate. A flusher thread syncs a batch
+// whose oldest record waits longer than the maximum delay, so at a low write
+// rate no record stays in memory for more than this time.
+// If the log can't be written or synced, the log is cut back to the end of
+// the last synced record and every modification since the last successful
+// sync is undone (also the ones of writers which didn't wait for the sync),
+// and the journal refuses further modifications. The records of the failed
+// batch may have reached the file partly or completely, if the log can't be
+// cut back either, a recovery may replay them although the container undid
+// them.
+// checkpoint() saves the container as image file (see avl_array_image.h) and
+// starts an empty log based on that image. open() rebuilds the state from the
+// last image (zero copy by load_mmap()) and replays the records of the log.
+// A torn record at the end of the log (crash during a write) and all records
+// behind it are cut off.
+// Files: <path>.img (image) and <path>.log (log). The container needs the
+// avl_array_alloc_image allocation policy, key and value types must be
+// trivially copyable. This needs a POSIX system.
+//
+// usage:
+// #include "avl_array_journal.h"
+// avl_array_journal<std::uint64_t, std::uint64_t, std::uint32_t, 1024U * 1024U> journal;
+// journal.open("/var/db/index");      // recovery
+// journal.insert(1U, 10U);             // durable after the next sync, at most 100 ms
+// journal.insert(2U, 20U, true);       // durable on return
+// journal.checkpoint();                // new image, empty log
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AVL_ARRAY_JOURNAL_H_
+#define _AVL_ARRAY_JOURNAL_H_
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "avl_array_image.h"
+
+
+/**
+ * \param Key The key type, must be trivially copyable
+ * \param T The Data type, must be trivially copyable
+ * \param size_type Container size type
+ * \param Size Container size
+ * \param Fast, Layout, Ranked See avl_array
+ * \param Alloc Allocation policy, avl_array_alloc_image or a policy which is compatible to it
+ */
+template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast = true, typename Layout = avl_array_layout_soa, const bool Ranked = false, typename Alloc = avl_array_alloc_image>
+class avl_array_journal
+{
+public:
+  typedef avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc> container_type;
+  typedef T                                                               value_type;
+  typedef Key                                                             key_type;
+
+  // log format version, incremented with every incompatible change
+  static const std::uint32_t VERSION = 1U;
+
+  // default size of a batch, a full batch is synced without waiting for sync()
+  static const std::size_t BATCH_BYTES = 65536U;
+
+  // default maximum time in ms a record waits in the batch before the flusher thread syncs it
+  static const unsigned MAX_DELAY_MS = 100U;
+
+  // log file header, at file offset 0
+  typedef struct tag_header_type {
+    char          magic[8];                 // "AVLJOURN"
+    std::uint32_t version;                  // VERSION
+    std::uint32_t endian;                   // avl_array_image::ENDIAN
+    std::uint32_t key_bytes;                // sizeof(Key)
+    std::uint32_t val_bytes;                // sizeof(T)
+    std::uint64_t base;                     // checksum of the image header the log is based on, 0 without image
+    std::uint64_t header_checksum;          // checksum of the header with header_checksum = 0
+  } header_type;
+
+private:
+  static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                "avl_array_journal needs trivially copyable key and value types");
+
+  // record operations, a record is the operation (1 byte), the key, the value (insert only)
+  // and the low 32 bit of the log checksum, which is chained over all records since the header
+  static const unsigned char OP_INSERT = 1U;
+  static const unsigned char OP_ERASE  = 2U;
+
+  // minimum read buffer size of the replay
+  static const std::size_t REPLAY_BUFFER = 65536U;
+
+  // previous state of the key of a record, to undo the record if its sync fails
+  typedef struct tag_undo_type {
+    key_type    key;
+    value_type  val;                        // previous value if existed
+    bool        existed;                    // false if the record inserted key
+  } undo_type;
+
+  container_type              avl_;         // the journaled container
+  std::string                 path_;        // file path without extension
+  int                         fd_;          // log file, -1 if not open
+  std::size_t                 batch_bytes_;
+  std::chrono::milliseconds   max_delay_;   // maximum delay of a record, 0 without flusher thread
+  mutable std::mutex          mutex_;       // guards the container and all members below
+  std::condition_variable     synced_;      // signals the end of a sync
+  std::condition_variable     flush_;       // wakes the flusher thread: first record of a batch or stop
+  std::chrono::steady_clock::time_point oldest_;  // append time of the first record of the pending batch
+  std::vector<unsigned char>  pending_;     // records which are not written yet
+  std::vector<unsigned char>  batch_;       // records which are written by the actual sync
+  std::vector<undo_type>      undo_;        // undo entries of the records which are not synced, in append order
+  std::uint64_t               sum_;         // log checksum up to the last appended record
+  std::uint64_t               appended_;    // sequence number of the last appended record
+  std::uint64_t               durable_;     // sequence number of the last synced record
+  off_t                       end_;         // log file size up to the last synced record
+  std::uint64_t               syncs_;       // number of syncs since open()
+  bool                        syncing_;     // a writer writes and syncs a batch
+  bool                        failed_;      // the log couldn't be written, no more modifications
+  bool                        stop_;        // the flusher thread has to stop
+  std::thread                 flusher_;     // syncs batches which wait longer than max_delay_
+
+public:
+
+  /**
+   * ctor
+   * \param batch_bytes A batch which reaches this size is synced by the appending writer
+   * \param max_delay_ms A batch whose first record waits this time (in ms) is synced by the flusher thread,
+   *                     0 for no flusher thread, records are synced by sync() or a full batch only then
+   */
+  explicit avl_array_journal(std::size_t batch_bytes = BATCH_BYTES, unsigned max_delay_ms = MAX_DELAY_MS)
+    : fd_(-1)
+    , batch_bytes_(batch_bytes)
+    , max_delay_(max_delay_ms)
+    , sum_(0U)
+    , appended_(0U)
+    , durable_(0U)
+    , end_(0)
+    , syncs_(0U)
+    , syncing_(false)
+    , failed_(false)
+    , stop_(false)
+  {
+    if (max_delay_ms) {
+      flusher_ = std::thread(&avl_array_journal::flush, this);
+    }
+  }
+
+
+  // dtor, syncs and closes the log
+  ~avl_array_journal()
+  {
+    if (flusher_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      flush_.notify_one();
+      flusher_.join();
+    }
+    if (fd_ >= 0) {
+      (void)sync();
+      ::close(fd_);
+    }
+  }
+
+
+  /**
+   * Open the journal and recover the state: load the image (if any) and replay the log
+   * A log which is based on another image is discarded, it is included in the image already
+   * (crash during checkpoint()). A torn record at the end of the log and all records behind it are cut off.
+   * \param path File path without extension, the journal uses <path>.img and <path>.log
+   * \param verify True to verify the checksum and the links of the image arrays, false for trusted files only, see avl_array::load_mmap()
+   * \return True if the state was recovered, false if the journal is open already, the files belong to
+   *         another container type, the image is missing or corrupt or the files can't be read or written
+   */
+  bool open(const char* path, bool verify = true)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ >= 0) {
+      return false;
+    }
+
+    path_ = path;
+    avl_.clear();
+    std::uint64_t base = 0U;
+    const std::string image = path_ + ".img";
+    struct stat st;
+    if (::stat(image.c_str(), &st) == 0) {
+      const int fd = ::open(image.c_str(), O_RDONLY);
+      const bool ok = (fd >= 0) && fingerprint(fd, base) && avl_.load_mmap(image.c_str(), verify);
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      if (!ok) {
+        return false;
+      }
+    }
+
+    fd_ = ::open((path_ + ".log").c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      return false;
+    }
+    header_type header, expected;
+    describe(expected, 0U);
+    const bool valid = read_header(header);
+    if (valid && (std::memcmp(&header, &expected, offsetof(header_type, base)) || (!base && header.base))) {
+      // another container type, or the image is missing
+      ::close(fd_);
+      fd_ = -1;
+      return false;
+    }
+    pending_.clear();
+    pending_.reserve(batch_bytes_ + record_bytes(OP_INSERT));
+    undo_.clear();
+    appended_ = durable_ = syncs_ = 0U;
+    failed_   = false;
+    if (!((valid && (header.base == base)) ? replay(header.header_checksum) : reset(base))) {
+      ::close(fd_);
+      fd_ = -1;
+      return false;
+    }
+    return true;
+  }
+
+
+  /**
+   * Insert or update an element and append it to the log
+   * \param key The key to insert
+   * \param val The value to insert
+   * \param durable True to return after the record is synced to the log file
+   * \return True if the element was inserted or updated (and synced if durable), false if the journal is
+   *         not open, the container is full or the log can't be written. In the last case the container
+   *         is unchanged: this and all other modifications since the last successful sync are undone and
+   *         cut off the log (a recovery may restore them if the log can't be cut back)
+   */
+  bool insert(const key_type& key, const value_type& val, bool durable = false)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if ((fd_ < 0) || failed_) {
+      return false;
+    }
+    const std::pair<typename container_type::iterator, bool> result = avl_.try_emplace(key, val);
+    if (result.first == avl_.end()) {
+      // full
+      return false;
+    }
+    const undo_type undo = { key, *result.first, !result.second };
+    if (!result.second) {
+      *result.first = val;
+    }
+    undo_.push_back(undo);
+    append(OP_INSERT, key, &val);
+    return commit(lock, durable);
+  }
+
+
+  /**
+   * Remove an element and append it to the log
+   * \param key The key of the element to remove
+   * \param durable True to return after the record is synced to the log file
+   * \return True if the element was removed (and synced if durable), false if the journal is not open,
+   *         key was not found or the log can't be written. In the last case the container is unchanged,
+   *         see insert()
+   */
+  bool erase(const key_type& key, bool durable = false)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if ((fd_ < 0) || failed_) {
+      return false;
+    }
+    const typename container_type::iterator it = avl_.find(key);
+    if (it == avl_.end()) {
+      return false;
+    }
+    const undo_type undo = { key, *it, true };
+    (void)avl_.erase(it);
+    undo_.push_back(undo);
+    append(OP_ERASE, key, nullptr);
+    return commit(lock, durable);
+  }
+
+
+  /**
+   * Sync all appended records to the log file
+   * Records of other writers which are appended meanwhile are synced by the same fsync call.
+   * \return True if all records are synced
+   */
+  bool sync()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return (fd_ >= 0) && sync(lock, appended_);
+  }
+
+
+  /**
+   * Save the container as new image and start an empty log
+   * The image is written to <path>.img.tmp and renamed, a crash leaves either the old image and log or
+   * the new image. Writers wait until the image is written.
+   * \return True if the checkpoint was written, false on error (the old image and log stay valid)
+   */
+  bool checkpoint()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    synced_.wait(lock, [this]() { return !syncing_; });
+    if ((fd_ < 0) || failed_) {
+      return false;
+    }
+
+    const std::string image = path_ + ".img", temp = image + ".tmp";
+    const int fd = ::open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    std::uint64_t base = 0U;
+    bool ok = (fd >= 0) && avl_.save(fd) && (::fsync(fd) == 0) && fingerprint(fd, base);
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    ok = ok && (::rename(temp.c_str(), image.c_str()) == 0) && sync_dir();
+    if (!ok) {
+      ::unlink(temp.c_str());
+      return false;
+    }
+
+    // the image holds all records, also the pending ones
+    pending_.clear();
+    undo_.clear();
+    durable_ = appended_;
+    if (!reset(base)) {
+      // the old log is discarded on recovery anyway, because it's based on the old image
+      failed_ = true;
+      return false;
+    }
+    return true;
+  }
+
+
+  /**
+   * Find an element
+   * \param key The key to find
+   * \param val If key is found, the value of the element is set
+   * \return True if key was found
+   */
+  bool find(const key_type& key, value_type& val) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return avl_.find(key, val);
+  }
+
+
+  /**
+   * Number of elements
+   * \return Actual size
+   */
+  size_type size() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return avl_.size();
+  }
+
+
+  /**
+   * Read access to the container, e.g. for iteration
+   * \param f Function called as f(const container_type&), writers wait until f returns
+   */
+  template<typename Function>
+  void read(Function f) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    f(avl_);
+  }
+
+
+  // number of fsync calls of the log since open(), for statistics
+  std::uint64_t syncs() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return syncs_;
+  }
+
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Helper functions
+private:
+
+  // size of a record
+  static inline std::size_t record_bytes(unsigned char op)
+  {
+    return (op == OP_INSERT) ? 1U + sizeof(key_type) + sizeof(value_type) + sizeof(std::uint32_t) :
+           (op == OP_ERASE)  ? 1U + sizeof(key_type) + sizeof(std::uint32_t) : 0U;
+  }
+
+
+  // append a record to the pending batch
+  void append(unsigned char op, const key_type& key, const value_type* val)
+  {
+    const std::size_t at = pending_.size(), bytes = record_bytes(op);
+    if (!at && (max_delay_.count() > 0)) {
+      // first record of a batch, the flusher thread waits for its delay
+      oldest_ = std::chrono::steady_clock::now();
+      flush_.notify_one();
+    }
+    pending_.resize(at + bytes);
+    unsigned char* record = &pending_[at];
+    record[0] = op;
+    std::memcpy(record + 1U, &key, sizeof(key_type));
+    if (val) {
+      std::memcpy(record + 1U + sizeof(key_type), val, sizeof(value_type));
+    }
+    sum_ = avl_array_image::checksum(record, bytes - sizeof(std::uint32_t), sum_);
+    const std::uint32_t check = static_cast<std::uint32_t>(sum_);
+    std::memcpy(record + bytes - sizeof(std::uint32_t), &check, sizeof(std::uint32_t));
+    appended_++;
+  }
+
+
+  // finish a modification: sync if the writer needs it durable or the batch is full
+  inline bool commit(std::unique_lock<std::mutex>& lock, bool durable)
+  {
+    if (durable || ((pending_.size() >= batch_bytes_) && !syncing_)) {
+      return sync(lock, appended_);
+    }
+    return true;
+  }
+
+
+  // group commit: wait for the running sync or sync the pending batch, until the record 'seq' is synced
+  // the log file is written outside of the lock, so other writers can append meanwhile
+  bool sync(std::unique_lock<std::mutex>& lock, std::uint64_t seq)
+  {
+    while ((durable_ < seq) && !failed_) {
+      if (syncing_) {
+        synced_.wait(lock);
+        continue;
+      }
+      syncing_ = true;
+      batch_.swap(pending_);
+      const std::uint64_t last = appended_;
+      const off_t bytes = static_cast<off_t>(batch_.size());
+      lock.unlock();
+      const bool ok = write(fd_, batch_.data(), batch_.size()) && (::fsync(fd_) == 0);
+      batch_.clear();
+      lock.lock();
+      syncing_ = false;
+      syncs_++;
+      if (ok) {
+        undo_.erase(undo_.begin(), undo_.begin() + static_cast<std::ptrdiff_t>(last - durable_));
+        durable_ = last;
+        end_    += bytes;
+      }
+      else {
+        // the batch may be in the file partly or completely, cut it off so a recovery doesn't replay it,
+        // if that fails too, a recovery may restore some of the records which are undone here
+        failed_ = true;
+        (void)((::ftruncate(fd_, end_) == 0) && (::fsync(fd_) == 0));
+        rollback();
+      }
+      synced_.notify_all();
+    }
+    return !failed_;
+  }
+
+
+  // flusher thread, syncs the pending batch when its first record waited max_delay_
+  void flush()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+      if (pending_.empty() || failed_ || (fd_ < 0)) {
+        flush_.wait(lock);
+        continue;
+      }
+      const std::chrono::steady_clock::time_point due = oldest_ + max_delay_;
+      if (std::chrono::steady_clock::now() < due) {
+        flush_.wait_until(lock, due);
+        continue;
+      }
+      (void)sync(lock, appended_);
+    }
+  }
+
+
+  // undo all modifications which are not synced, newest first, the container holds the synced state then
+  void rollback()
+  {
+    while (!undo_.empty()) {
+      const undo_type& undo = undo_.back();
+      if (undo.existed) {
+        (void)avl_.insert(undo.key, undo.val);
+      }
+      else {
+        (void)avl_.erase(undo.key);
+      }
+      undo_.pop_back();
+    }
+    pending_.clear();
+  }
+
+
+  // fill the log header
+  static void describe(header_type& header, std::uint64_t base)
+  {
+    std::memset(&header, 0, sizeof(header_type));
+    std::memcpy(header.magic, "AVLJOURN", sizeof(header.magic));
+    header.version         = VERSION;
+    header.endian          = avl_array_image::ENDIAN;
+    header.key_bytes       = static_cast<std::uint32_t>(sizeof(key_type));
+    header.val_bytes       = static_cast<std::uint32_t>(sizeof(value_type));
+    header.base            = base;
+    header.header_checksum = avl_array_image::checksum(&header, sizeof(header_type));
+  }
+
+
+  // read the log header, false if there is no complete header
+  bool read_header(header_type& header)
+  {
+    std::size_t got = 0U;
+    while (got < sizeof(header_type)) {
+      const ssize_t n = ::pread(fd_, reinterpret_cast<char*>(&header) + got, sizeof(header_type) - got, static_cast<off_t>(got));
+      if ((n < 0) && (errno == EINTR)) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      got += static_cast<std::size_t>(n);
+    }
+    const std::uint64_t sum = header.header_checksum;
+    header.header_checksum = 0U;
+    const bool valid = (avl_array_image::checksum(&header, sizeof(header_type)) == sum);
+    header.header_checksum = sum;
+    return valid;
+  }
+
+
+  // start an empty log which is based on the given image
+  bool reset(std::uint64_t base)
+  {
+    header_type header;
+    describe(header, base);
+    if ((::ftruncate(fd_, 0) != 0) || (::lseek(fd_, 0, SEEK_SET) != 0) ||
+        !write(fd_, &header, sizeof(header_type)) || (::fsync(fd_) != 0)) {
+      return false;
+    }
+    sum_ = header.header_checksum;
+    end_ = static_cast<off_t>(sizeof(header_type));
+    return true;
+  }
+
+
+  // replay the records behind the header, cut off a torn tail
+  bool replay(std::uint64_t sum)
+  {
+    // the buffer holds at least one complete record, a larger record would look like a torn tail
+    std::vector<unsigned char> buffer(record_bytes(OP_INSERT) > REPLAY_BUFFER ? record_bytes(OP_INSERT) : REPLAY_BUFFER);
+    std::size_t have = 0U;
+    off_t end = static_cast<off_t>(sizeof(header_type));   // end of the last valid record
+    if (::lseek(fd_, end, SEEK_SET) != end) {
+      return false;
+    }
+    for (bool more = true; more; ) {
+      const ssize_t got = ::read(fd_, &buffer[have], buffer.size() - have);
+      if (got < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      more = (got > 0);
+      have += static_cast<std::size_t>(got);
+
+      // apply the complete records of the buffer
+      std::size_t pos = 0U;
+      for (;;) {
+        const std::size_t bytes = (pos < have) ? record_bytes(buffer[pos]) : 0U;
+        if (!bytes || (have - pos < bytes)) {
+          // no unknown operation at the end, the remaining bytes belong to the next read
+          more = more && (bytes || (pos == have));
+          break;
+        }
+        const std::uint64_t next = avl_array_image::checksum(&buffer[pos], bytes - sizeof(std::uint32_t), sum);
+        std::uint32_t check;
+        std::memcpy(&check, &buffer[pos + bytes - sizeof(std::uint32_t)], sizeof(std::uint32_t));
+        if (check != static_cast<std::uint32_t>(next)) {
+          more = false;
+          break;
+        }
+        if (!apply(&buffer[pos])) {
+          return false;
+        }
+        sum  = next;
+        pos += bytes;
+        end += static_cast<off_t>(bytes);
+      }
+      std::memmove(buffer.data(), buffer.data() + pos, have - pos);
+      have -= pos;
+    }
+
+    // cut off the torn tail, new records are appended behind the last valid one
+    if ((::lseek(fd_, 0, SEEK_END) != end) && ((::ftruncate(fd_, end) != 0) || (::fsync(fd_) != 0))) {
+      return false;
+    }
+    sum_ = sum;
+    end_ = end;
+    return ::lseek(fd_, end, SEEK_SET) == end;
+  }
+
+
+  // apply a record to the container
+  bool apply(const unsigned char* record)
+  {
+    key_type key;
+    std::memcpy(&key, record + 1U, sizeof(key_type));
+    if (record[0] == OP_INSERT) {
+      value_type val;
+      std::memcpy(&val, record + 1U + sizeof(key_type), sizeof(value_type));
+      return avl_.insert(key, val);
+    }
+    (void)avl_.erase(key);
+    return true;
+  }
+
+
+  // checksum of an image header, identifies the image a log is based on
+  static bool fingerprint(int fd, std::uint64_t& base)
+  {
+    avl_array_image::header_type header;
+    if (::pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+      return false;
+    }
+    base = avl_array_image::checksum(&header, sizeof(header));
+    return true;
+  }
+
+
+  // sync the directory of the files, makes a rename durable
+  bool sync_dir() const
+  {
+    const std::string::size_type slash = path_.rfind('/');
+    const std::string dir = (slash == std::string::npos) ? std::string(".") : path_.substr(0U, slash ? slash : 1U);
+    const int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    const bool ok = (::fsync(fd) == 0);
+    ::close(fd);
+    return ok;
+  }
+
+
+  // write all bytes at the file position
+  static bool write(int fd, const void* data, std::size_t bytes)
+  {
+    const char* p = static_cast<const char*>(data);
+    while (bytes) {
+      const ssize_t n = ::write(fd, p, bytes);
+      if ((n < 0) && (errno == EINTR)) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      p     += n;
+      bytes -= static_cast<std::size_t>(n);
+    }
+    return true;
+  }
+
+
+  // not copyable
+  avl_array_journal(const avl_array_journal&);
+  avl_array_journal& operator=(const avl_array_journal&);
+};
+
+#endif  // _AVL_ARRAY_JOURNAL_H_
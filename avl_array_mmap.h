@@ -0,0 +1,347 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief avl_array mmap allocation policies
+// avl_array_alloc_mmap backs every node array of an avl_array by its own
+// anonymous memory mapping, reserved with MAP_NORESERVE. The address space for
+// 'Size' nodes is reserved when the container is created, but physical memory is
+// only committed when a page is touched for the first time. Because the node
+// arrays are always dense (index range [0, size)), the resident memory grows with
+// the number of elements and not with Size. After erasing many elements,
+// shrink_to_fit() gives the pages of the unused nodes back via madvise(MADV_DONTNEED).
+// avl_array_alloc_placed maps the arrays like avl_array_alloc_dynamic allocates
+// them: they start empty and grow at runtime.
+// Both policies take a placement hook, which requests huge pages (transparent
+// or MAP_HUGETLB 2MB/1GB) and NUMA placement (bind to a node or interleave
+// across all nodes via mbind) for every array, and which is told the placement
+// that actually happened. Huge pages reduce the TLB misses of big containers.
+// Arrays smaller than one MAP_HUGETLB page (e.g. the one element placeholders
+// of disabled features) are mapped with regular pages.
+// This needs a POSIX system (mmap/madvise), huge page and NUMA placement need Linux.
+//
+// usage:
+// #include "avl_array_mmap.h"
+// avl_array<std::uint64_t, rec, std::uint32_t, 64U * 1024U * 1024U, true, avl_array_layout_soa, false, avl_array_alloc_mmap<> > avl;
+// if (!avl.max_size()) { /* address space couldn't be reserved */ }
+//
+// struct on_node1 : avl_array_placement_fixed<avl_array_placement::PAGE_HUGE_2MB, avl_array_placement::NUMA_BIND, 1> {
+//   static void placed(const void* addr, std::size_t bytes, const avl_array_placement& actual) { /* log it */ }
+// };
+// avl_array<std::uint64_t, rec, std::uint32_t, 64U * 1024U * 1024U, true, avl_array_layout_soa, false, avl_array_alloc_placed<on_node1> > avl;
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AVL_ARRAY_MMAP_H_
+#define _AVL_ARRAY_MMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "avl_array.h"
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+
+
+/**
+ * Placement of a node array
+ * Requested by the placement hook and reported back to it with what actually happened
+ */
+typedef struct tag_avl_array_placement
+{
+  enum page_type {
+    PAGE_DEFAULT,             // regular pages
+    PAGE_TRANSPARENT_HUGE,    // transparent huge pages, madvise(MADV_HUGEPAGE)
+    PAGE_HUGE_2MB,            // 2MB pages of the hugetlb pool, MAP_HUGETLB
+    PAGE_HUGE_1GB             // 1GB pages of the hugetlb pool, MAP_HUGETLB
+  };
+  enum numa_type {
+    NUMA_DEFAULT,             // policy of the calling thread, usually the local node
+    NUMA_BIND,                // pages only on the given node
+    NUMA_INTERLEAVE           // pages interleaved across all allowed nodes
+  };
+
+  page_type page;
+  numa_type numa;
+  int       node;             // NUMA node of NUMA_BIND
+} avl_array_placement;
+
+
+/**
+ * Placement hook with a compile time placement
+ * A placement hook provides request(), the placement of every new array, and placed(), which is
+ * called with the actual placement after an array was mapped. Derive from this class and hide
+ * placed() to log the placement, or write an own hook to decide the placement at runtime.
+ * request() must return the same placement during the lifetime of a container.
+ */
+template<avl_array_placement::page_type Page, avl_array_placement::numa_type Numa = avl_array_placement::NUMA_DEFAULT, int Node = 0>
+struct avl_array_placement_fixed
+{
+  static inline avl_array_placement request()
+  {
+    avl_array_placement placement = { Page, Numa, Node };
+    return placement;
+  }
+
+  static inline void placed(const void* addr, std::size_t bytes, const avl_array_placement& actual)
+  { (void)addr; (void)bytes; (void)actual; }
+};
+
+typedef avl_array_placement_fixed<avl_array_placement::PAGE_DEFAULT>          avl_array_placement_default;
+typedef avl_array_placement_fixed<avl_array_placement::PAGE_TRANSPARENT_HUGE> avl_array_placement_transparent;
+
+
+/**
+ * Returns the NUMA node of the page at addr, the page is committed if it isn't yet
+ * \param addr Any address of a mapped page
+ * \return Node number, -1 if unknown (no Linux, no NUMA support)
+ */
+inline int avl_array_numa_node(const void* addr)
+{
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+  int node = -1;
+  if (::syscall(SYS_get_mempolicy, &node, nullptr, 0UL, addr, static_cast<unsigned long>(MPOL_F_NODE | MPOL_F_ADDR)) == 0) {
+    return node;
+  }
+#else
+  (void)addr;
+#endif
+  return -1;
+}
+
+
+/**
+ * Memory source which maps every allocation with the placement of the hook
+ * Used as memory source of avl_array_alloc_growing and by avl_array_alloc_mmap.
+ * \param Placement Placement hook, see avl_array_placement_fixed
+ */
+template<typename Placement>
+class avl_array_memory_mmap
+{
+  avl_array_placement request_;   // requested placement, read once per array
+  std::size_t         page_;      // page size of the last mapping
+
+  // node mask of mbind, large enough for the NUMA node limit of common kernels
+  static const unsigned long NODE_BITS = 1024UL;
+  static const std::size_t   NODE_WORDS = NODE_BITS / (8U * sizeof(unsigned long));
+
+public:
+  avl_array_memory_mmap()
+    : request_(Placement::request())
+    , page_(regular_page())
+  { }
+
+  /**
+   * Map memory, the length is rounded up to the requested page size
+   * If hugetlb pages are requested but the pool can't provide them, regular pages with transparent huge pages are used.
+   * Less than one hugetlb page is mapped with regular pages, small arrays don't occupy a whole huge page.
+   * \param bytes Minimum length
+   * \return Mapped memory, nullptr if the address space couldn't be reserved
+   */
+  void* allocate(std::size_t bytes)
+  {
+    const std::size_t length = round(bytes);
+    avl_array_placement actual = { avl_array_placement::PAGE_DEFAULT, avl_array_placement::NUMA_DEFAULT, 0 };
+    void* addr = MAP_FAILED;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    if (page(bytes) != regular_page()) {
+      // no MAP_NORESERVE, the pool pages are reserved now, else the first touch of a missing page raises SIGBUS
+      const int huge = (request_.page == avl_array_placement::PAGE_HUGE_2MB ? 21 : 30) << MAP_HUGE_SHIFT;
+      addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | huge, -1, 0);
+      if (addr != MAP_FAILED) {
+        actual.page = request_.page;
+        page_       = page(bytes);
+      }
+    }
+#endif
+    if (addr == MAP_FAILED) {
+      addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (addr == MAP_FAILED) {
+        return nullptr;
+      }
+      page_ = regular_page();
+#if defined(MADV_HUGEPAGE)
+      if ((request_.page != avl_array_placement::PAGE_DEFAULT) && !::madvise(addr, length, MADV_HUGEPAGE)) {
+        actual.page = avl_array_placement::PAGE_TRANSPARENT_HUGE;
+      }
+#endif
+    }
+
+    // the policy must be set before the first page is touched
+    if (request_.numa != avl_array_placement::NUMA_DEFAULT) {
+      if (bind(addr, length)) {
+        actual.numa = request_.numa;
+        actual.node = request_.node;
+      }
+    }
+
+    Placement::placed(addr, length, actual);
+    return addr;
+  }
+
+  void deallocate(void* addr, std::size_t bytes)
+  {
+    (void)::munmap(addr, round(bytes));
+  }
+
+  // page size of the last mapping, ranges given to madvise() must be aligned to it
+  inline std::size_t page_size() const
+  { return page_; }
+
+private:
+  static inline std::size_t regular_page()
+  { return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)); }
+
+  // requested page size of a mapping of bytes, regular pages if hugetlb pages aren't requested or bytes is less than one
+  inline std::size_t page(std::size_t bytes) const
+  {
+    const std::size_t huge = (request_.page == avl_array_placement::PAGE_HUGE_2MB) ? 2U * 1024U * 1024U :
+                             (request_.page == avl_array_placement::PAGE_HUGE_1GB) ? 1024U * 1024U * 1024U : 0U;
+    return (huge && (bytes >= huge)) ? huge : regular_page();
+  }
+
+  // round up to the requested page size, this doesn't depend on the actual page size,
+  // so deallocate() unmaps the same length even if allocate() fell back to regular pages
+  inline std::size_t round(std::size_t bytes) const
+  {
+    const std::size_t size = page(bytes);
+    return (bytes + size - 1U) & ~(size - 1U);
+  }
+
+  // apply the NUMA policy to the mapping, returns true on success
+  bool bind(void* addr, std::size_t length) const
+  {
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_get_mempolicy)
+    unsigned long mask[NODE_WORDS] = { 0UL };
+    int mode;
+    if (request_.numa == avl_array_placement::NUMA_BIND) {
+      if ((request_.node < 0) || (static_cast<unsigned long>(request_.node) >= NODE_BITS)) {
+        return false;
+      }
+      const std::size_t node = static_cast<std::size_t>(request_.node);
+      mask[node / (8U * sizeof(unsigned long))] = 1UL << (node % (8U * sizeof(unsigned long)));
+      mode = MPOL_BIND;
+    }
+    else {
+      // interleave across the nodes this thread may use
+      if (::syscall(SYS_get_mempolicy, nullptr, mask, NODE_BITS + 1UL, nullptr, static_cast<unsigned long>(MPOL_F_MEMS_ALLOWED))) {
+        return false;
+      }
+      mode = MPOL_INTERLEAVE;
+    }
+    // the kernel reads maxnode - 1 bits
+    return ::syscall(SYS_mbind, addr, static_cast<unsigned long>(length), static_cast<unsigned long>(mode), mask, NODE_BITS + 1UL, 0UL) == 0;
+#else
+    (void)addr; (void)length;
+    return false;
+#endif
+  }
+};
+
+
+/**
+ * Reserved, lazily committed node arrays
+ * \param Placement Placement hook, see avl_array_placement_fixed
+ */
+template<typename Placement = avl_array_placement_default>
+struct avl_array_alloc_mmap
+{
+  template<typename Type, std::size_t N>
+  class array : private avl_array_memory_mmap<Placement>
+  {
+    Type* data_;    // mapped array, nullptr if mapping failed
+    bool  discard_; // false if the kernel can't drop pages of the mapping (hugetlb before Linux 5.18)
+
+    static const std::size_t BYTES = N * sizeof(Type);
+
+  public:
+    array()
+      : data_(static_cast<Type*>(this->allocate(BYTES)))
+      , discard_(true)
+    { }
+
+    ~array()
+    {
+      if (data_) {
+        this->deallocate(data_, BYTES);
+      }
+    }
+
+    // the array is used like a built-in array
+    inline operator Type*()                             { return data_; }
+    inline operator const Type*() const                 { return data_; }
+
+    // true if the array memory for N elements is available
+    inline bool valid() const
+    { return data_ != nullptr; }
+
+    // number of elements which are usable now
+    inline std::size_t capacity() const
+    { return data_ ? N : 0U; }
+
+    // make n elements usable, nothing to do because all pages are reserved
+    template<typename Relocate>
+    inline bool reserve(std::size_t n, std::size_t live, Relocate relocate)
+    { (void)live; (void)relocate; return n <= capacity(); }
+
+    // give the pages which only hold the unused elements [first, N) back, they read as zero when touched again
+    template<typename Relocate>
+    void release(std::size_t first, Relocate relocate)
+    {
+      (void)relocate;
+      if (!data_ || !discard_ || (first >= N)) {
+        return;
+      }
+      // the range must be aligned to the page size of the mapping, hugetlb pages are released as a whole
+      const std::uintptr_t page  = static_cast<std::uintptr_t>(this->page_size());
+      const std::uintptr_t begin = (reinterpret_cast<std::uintptr_t>(data_ + first) + page - 1U) & ~(page - 1U);
+      const std::uintptr_t end   = (reinterpret_cast<std::uintptr_t>(data_) + BYTES + page - 1U) & ~(page - 1U);
+      if ((begin < end) && (::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED) != 0)) {
+        // the pages stay committed like static memory, don't try again on every shrink_to_fit()
+        discard_ = false;
+      }
+    }
+
+  private:
+    // not copyable, every container owns its mappings
+    array(const array&);
+    array& operator=(const array&);
+  };
+};
+
+
+/**
+ * Mapped node arrays with runtime capacity
+ * Grows and shrinks like avl_array_alloc_dynamic, every reallocation is mapped with the placement of the hook.
+ * \param Placement Placement hook, see avl_array_placement_fixed
+ */
+template<typename Placement = avl_array_placement_default>
+struct avl_array_alloc_placed : avl_array_alloc_growing<avl_array_memory_mmap<Placement> >
+{ };
+
+#endif  // _AVL_ARRAY_MMAP_H_
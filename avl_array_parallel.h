@@ -0,0 +1,246 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief avl_array parallel bulk operations
+// avl_array_thread_pool is a task runner for the parallel variants of
+// avl_array::assign_sorted() and avl_array::find_batch(). It keeps its worker
+// threads alive between calls, the calling thread works on the tasks as well.
+// avl_array_bulk_load() replaces the content of an avl_array by unsorted
+// key/value pairs: the pairs are sorted in parallel (sorted runs, merged
+// pairwise) and the tree is built by the parallel assign_sorted().
+//
+// usage:
+// #include "avl_array_parallel.h"
+// avl_array_thread_pool pool;                                // one thread per core
+// avl_array_bulk_load(avl, records.begin(), records.end(), pool);
+// avl.find_batch(keys, n, out, found, pool);
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AVL_ARRAY_PARALLEL_H_
+#define _AVL_ARRAY_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "avl_array.h"
+
+
+/**
+ * Thread pool task runner
+ * pool(n, f) calls f(0) ... f(n - 1) on the worker threads and the calling thread and returns when all
+ * calls are done. Tasks are handed out one by one, so tasks of different duration are balanced.
+ * Calls of different threads are serialized.
+ */
+class avl_array_thread_pool
+{
+  std::vector<std::thread>  threads_;     // worker threads, the calling thread is the last worker
+  std::mutex                mutex_;       // guards the job members below
+  std::mutex                run_mutex_;   // serializes the callers
+  std::condition_variable   wake_;        // signals a new job (or stop) to the workers
+  std::condition_variable   done_;        // signals the caller that all workers are done
+
+  // actual job
+  void                      (*call_)(void*, std::size_t);
+  void*                     func_;
+  std::size_t               tasks_;
+  std::atomic<std::size_t>  next_;        // next task to hand out
+  std::size_t               busy_;        // number of workers which didn't finish the job yet
+  std::uint64_t             job_;         // job sequence number
+  bool                      stop_;
+
+  template<typename Function>
+  static void invoke(void* func, std::size_t task)
+  { (*static_cast<Function*>(func))(task); }
+
+  // work on the tasks of the actual job until all are handed out
+  inline void work()
+  {
+    for (std::size_t task = next_++; task < tasks_; task = next_++) {
+      call_(func_, task);
+    }
+  }
+
+  void worker()
+  {
+    std::uint64_t job = 0U;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [this, job]() { return stop_ || (job_ != job); });
+      if (stop_) {
+        return;
+      }
+      job = job_;
+      lock.unlock();
+      work();
+      lock.lock();
+      if (--busy_ == 0U) {
+        done_.notify_one();
+      }
+    }
+  }
+
+public:
+  /**
+   * ctor, starts the worker threads
+   * \param threads Number of threads which work on the tasks, including the calling thread
+   */
+  explicit avl_array_thread_pool(std::size_t threads = std::thread::hardware_concurrency())
+    : call_(nullptr)
+    , func_(nullptr)
+    , tasks_(0U)
+    , next_(0U)
+    , busy_(0U)
+    , job_(0U)
+    , stop_(false)
+  {
+    for (std::size_t t = 1U; t < threads; ++t) {
+      threads_.push_back(std::thread([this]() { worker(); }));
+    }
+  }
+
+
+  // dtor, stops the worker threads
+  ~avl_array_thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::size_t t = 0U; t < threads_.size(); ++t) {
+      threads_[t].join();
+    }
+  }
+
+
+  // number of threads which work on the tasks, including the calling thread
+  inline std::size_t size() const
+  { return threads_.size() + 1U; }
+
+
+  /**
+   * Run tasks
+   * \param tasks Number of tasks
+   * \param f Function called as f(std::size_t task) for every task in [0, tasks)
+   */
+  template<typename Function>
+  void operator()(std::size_t tasks, Function f)
+  {
+    if (threads_.empty() || (tasks < 2U)) {
+      for (std::size_t task = 0U; task < tasks; ++task) {
+        f(task);
+      }
+      return;
+    }
+
+    std::lock_guard<std::mutex> run(run_mutex_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      call_  = &invoke<Function>;
+      func_  = &f;
+      tasks_ = tasks;
+      next_  = 0U;
+      busy_  = threads_.size();
+      job_++;
+    }
+    wake_.notify_all();
+    work();
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return busy_ == 0U; });
+  }
+
+private:
+  // not copyable
+  avl_array_thread_pool(const avl_array_thread_pool&);
+  avl_array_thread_pool& operator=(const avl_array_thread_pool&);
+};
+
+
+/**
+ * Replace the content of an avl_array by unsorted key/value pairs
+ * The pairs are copied to a temporary buffer (additional memory for all pairs is needed), sorted in parallel
+ * and the tree is built by the parallel assign_sorted(). If a key is given more than once, the last pair wins,
+ * like a sequence of insert() calls.
+ * \param avl The container
+ * \param first Begin of the element range, *first must provide the members 'first' (key) and 'second' (value) like std::pair
+ * \param last End of the element range
+ * \param parallel Task runner, see avl_array::assign_sorted()
+ * \return True if the content was assigned, false if there are more unique keys than the container can hold (container is empty then)
+ */
+template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast, typename Layout, const bool Ranked, typename Alloc, const bool Dirty, typename Stats, typename InputIt, typename Parallel>
+bool avl_array_bulk_load(avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc, Dirty, Stats>& avl, InputIt first, InputIt last, Parallel&& parallel)
+{
+  typedef std::pair<Key, T> pair_type;
+
+  // the buffer is sorted as RUNS runs, which are merged pairwise
+  static const std::size_t RUNS = 64U;
+
+  std::vector<pair_type> buffer;
+  for (; first != last; ++first) {
+    buffer.push_back(pair_type(first->first, first->second));
+  }
+
+  const std::size_t n = buffer.size();
+  std::size_t bound[RUNS + 1U];
+  for (std::size_t r = 0U; r <= RUNS; ++r) {
+    bound[r] = n * r / RUNS;
+  }
+  // stable sort and merge, so pairs with the same key keep their input order
+  const auto less = [](const pair_type& a, const pair_type& b) { return a.first < b.first; };
+  pair_type* data = buffer.data();
+  parallel(RUNS, [data, &bound, &less](std::size_t run) {
+    std::stable_sort(data + bound[run], data + bound[run + 1U], less);
+  });
+  for (std::size_t width = 1U; width < RUNS; width *= 2U) {
+    parallel(RUNS / (2U * width), [data, &bound, &less, width](std::size_t merge) {
+      std::inplace_merge(data + bound[2U * merge * width], data + bound[(2U * merge + 1U) * width], data + bound[(2U * merge + 2U) * width], less);
+    });
+  }
+
+  // remove the duplicates, the last pair of a key wins
+  std::size_t unique = 0U;
+  for (std::size_t i = 0U; i < n; ++i) {
+    if (unique && (buffer[unique - 1U].first == buffer[i].first)) {
+      buffer[unique - 1U] = std::move(buffer[i]);
+    }
+    else {
+      if (unique != i) {
+        buffer[unique] = std::move(buffer[i]);
+      }
+      unique++;
+    }
+  }
+  buffer.erase(buffer.begin() + static_cast<std::ptrdiff_t>(unique), buffer.end());
+
+  return avl.assign_sorted(buffer.begin(), buffer.end(), std::forward<Parallel>(parallel));
+}
+
+#endif  // _AVL_ARRAY_PARALLEL_H_
@@ -0,0 +1,283 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief avl_array_rcu class
+// Double buffered avl_array for readers which never block and never retry.
+// Two copies of the container are kept, readers search the active copy while
+// a writer modifies the standby copy. The writer publishes the standby copy
+// by one atomic store of the active index, waits until no reader uses the old
+// copy anymore (epoch based grace period) and then applies the same
+// modification to the old copy, which becomes the new standby copy.
+// A reader announces the actual epoch in its own cache line before it reads
+// the active index and clears it afterwards, readers never write shared cache
+// lines. Every reader thread needs a 'reader' handle, which occupies one of
+// 'Readers' slots.
+// Writers are serialized by a mutex and apply every modification twice, so a
+// modification function must do the same on both copies (deterministic).
+// The memory of two containers is needed.
+//
+// usage:
+// #include "avl_array_rcu.h"
+// typedef avl_array_rcu<int, int, int, 1024> rcu_type;
+// rcu_type avl;
+// avl.write([](rcu_type::container_type& c) { c.insert(1, 1); c.insert(2, 2); });   // writer thread
+// rcu_type::reader reader(avl);                                                      // reader thread
+// int val;
+// reader.find(1, val);
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AVL_ARRAY_RCU_H_
+#define _AVL_ARRAY_RCU_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "avl_array.h"
+
+
+/**
+ * \param Key The key type
+ * \param T The Data type
+ * \param size_type Container size type
+ * \param Size Container size
+ * \param Fast, Layout, Ranked, Alloc See avl_array
+ * \param Readers Maximum number of reader handles at the same time
+ */
+template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast = true, typename Layout = avl_array_layout_soa, const bool Ranked = false, typename Alloc = avl_array_alloc_static, const std::size_t Readers = 64U>
+class avl_array_rcu
+{
+public:
+  typedef avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc> container_type;
+  typedef T                                                               value_type;
+  typedef Key                                                             key_type;
+
+private:
+  // assumed cache line size
+  static const std::size_t CACHE_LINE = 64U;
+
+  // reader slot, cache line aligned, so every reader writes its own cache line only
+  typedef struct alignas(CACHE_LINE) tag_slot_type {
+    std::atomic<std::uint64_t> epoch;     // epoch of the actual read, 0 if not reading
+    std::atomic<bool>          used;      // slot is owned by a reader handle
+  } slot_type;
+
+  container_type             avl_[2];       // active and standby copy
+  std::atomic<unsigned>      active_;       // index of the active copy
+  std::atomic<std::uint64_t> epoch_;        // actual epoch, incremented by every publish
+  std::mutex                 mutex_;        // writer lock
+  mutable slot_type          slot_[Readers]; // reader slots, written by the readers
+
+  // number of busy wait rounds before the writer yields
+  static const unsigned SPIN_LIMIT = 64U;
+
+public:
+
+  /**
+   * Reader handle
+   * Owns one reader slot of the container. Create one handle per reader thread and keep it, the
+   * handle must not be shared by threads at the same time. read() calls must not be nested.
+   */
+  class reader
+  {
+    const avl_array_rcu& instance_;
+    std::size_t          slot_;           // owned slot, Readers if no slot was free
+
+  public:
+    explicit reader(const avl_array_rcu& instance)
+      : instance_(instance)
+      , slot_(Readers)
+    {
+      for (std::size_t i = 0U; i < Readers; ++i) {
+        bool expected = false;
+        if (instance_.slot_[i].used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+          slot_ = i;
+          break;
+        }
+      }
+    }
+
+    ~reader()
+    {
+      if (valid()) {
+        instance_.slot_[slot_].used.store(false, std::memory_order_release);
+      }
+    }
+
+    // true if the handle owns a slot, false if all 'Readers' slots are in use
+    inline bool valid() const
+    { return slot_ < Readers; }
+
+    /**
+     * Read the active copy, never blocks
+     * \param f Function called with the active copy, f(const container_type&)
+     * \return False if the handle is not valid and f wasn't called
+     */
+    template<typename Function>
+    bool read(Function f) const
+    {
+      if (!valid()) {
+        return false;
+      }
+      // announce the epoch before the active index is read, a writer waits for every announced older epoch
+      std::atomic<std::uint64_t>& epoch = instance_.slot_[slot_].epoch;
+      epoch.store(instance_.epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+      f(instance_.avl_[instance_.active_.load(std::memory_order_seq_cst)]);
+      epoch.store(0U, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * Find an element, never blocks
+     * \param key The key to find
+     * \param val If key is found, the value of the element is set
+     * \return True if key was found
+     */
+    bool find(const key_type& key, value_type& val) const
+    {
+      bool found = false;
+      (void)read([&](const container_type& avl) { found = avl.find(key, val); });
+      return found;
+    }
+
+  private:
+    // not copyable, a handle owns its slot
+    reader(const reader&);
+    reader& operator=(const reader&);
+  };
+
+
+  // ctor
+  avl_array_rcu()
+    : active_(0U)
+    , epoch_(1U)
+  {
+    for (std::size_t i = 0U; i < Readers; ++i) {
+      slot_[i].epoch.store(0U, std::memory_order_relaxed);
+      slot_[i].used.store(false, std::memory_order_relaxed);
+    }
+  }
+
+
+  // heap allocation keeps the reader slots cache line aligned, the global new only aligns to alignof(std::max_align_t) before C++17
+  static void* operator new(std::size_t bytes)
+  {
+    void* raw = ::operator new(bytes + CACHE_LINE);
+    // the aligned block starts at least one pointer behind raw, the raw address is stored in front of it
+    void* addr = reinterpret_cast<void*>((reinterpret_cast<std::uintptr_t>(raw) + CACHE_LINE) & ~static_cast<std::uintptr_t>(CACHE_LINE - 1U));
+    static_cast<void**>(addr)[-1] = raw;
+    return addr;
+  }
+
+  static void operator delete(void* addr)
+  {
+    if (addr) {
+      ::operator delete(static_cast<void**>(addr)[-1]);
+    }
+  }
+
+
+  /**
+   * Modify the container, serialized with other writers
+   * f is applied to the standby copy, which is published afterwards. Then f is applied to the old copy,
+   * as soon as no reader uses it anymore. f must do the same modification on both copies.
+   * Readers see all modifications of f at once.
+   * \param f Function called twice with a copy, f(container_type&)
+   */
+  template<typename Function>
+  void write(Function f)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const unsigned active = active_.load(std::memory_order_relaxed);
+    f(avl_[active ^ 1U]);
+    publish(active ^ 1U);
+    f(avl_[active]);
+  }
+
+
+  /**
+   * Insert or update an element, serialized with other writers
+   * \param key The key to insert
+   * \param val The value to insert
+   * \return True if the element was inserted or updated, false if the container is full
+   */
+  bool insert(const key_type& key, const value_type& val)
+  {
+    bool result = false;
+    write([&](container_type& avl) { result = avl.insert(key, val); });
+    return result;
+  }
+
+
+  /**
+   * Remove an element, serialized with other writers
+   * \param key The key of the element to remove
+   * \return True if the element was removed, false if key was not found
+   */
+  bool erase(const key_type& key)
+  {
+    bool result = false;
+    write([&](container_type& avl) { result = avl.erase(key); });
+    return result;
+  }
+
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Helper functions
+private:
+
+  // make copy the active one and wait for the end of the grace period:
+  // a reader which announced an older epoch may still use the old copy
+  void publish(unsigned copy)
+  {
+    active_.store(copy, std::memory_order_seq_cst);
+    const std::uint64_t epoch = epoch_.fetch_add(1U, std::memory_order_seq_cst) + 1U;
+    for (std::size_t i = 0U; i < Readers; ++i) {
+      for (unsigned spins = 0U;; ) {
+        const std::uint64_t reading = slot_[i].epoch.load(std::memory_order_seq_cst);
+        if (!reading || (reading >= epoch)) {
+          break;
+        }
+        if (++spins < SPIN_LIMIT) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+          __builtin_ia32_pause();
+#endif
+        }
+        else {
+          spins = 0U;
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+
+  // not copyable
+  avl_array_rcu(const avl_array_rcu&);
+  avl_array_rcu& operator=(const avl_array_rcu&);
+};
+
+#endif  // _AVL_ARRAY_RCU_H_
@@ -0,0 +1,277 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief avl_array_seqlock class
+// Thread safe wrapper of an avl_array for read mostly workloads. Readers call
+// find() lock free: they read a sequence counter, search the tree and check
+// that the counter hasn't changed meanwhile, else they retry. Writers
+// serialize on a lightweight spin lock and make the counter odd while they
+// modify the tree. Readers never block writers and never write a shared cache
+// line, so find() scales with the number of reader threads.
+// A reader can see a tree which is modified concurrently. Because nodes are
+// linked by index, such a torn read is harmless: avl_array::find_bounded()
+// reads every index once, range checks it and bounds the descent by the
+// maximum tree height, the result is discarded if the counter changed.
+// Key and value types must be trivially copyable (a torn copy must be harmless
+// as well). The node arrays are reserved completely at construction, so they
+// are never reallocated. If a growing allocation policy can't reserve them,
+// capacity() is less than max_size() and insert() refuses to grow beyond it.
+// The key and value reads of find() remain a formal data race with the writer
+// (like in every seqlock without atomic payload). ThreadSanitizer reports
+// them, suppress them by a 'race:avl_array_seqlock' entry in the suppression
+// file. Under ThreadSanitizer the fences, which it doesn't support, are
+// replaced by read-modify-write operations of the counter.
+//
+// usage:
+// #include "avl_array_seqlock.h"
+// avl_array_seqlock<int, int, int, 1024> avl;
+// avl.insert(1, 1);        // writer thread
+// int val;
+// avl.find(1, val);        // any number of reader threads
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AVL_ARRAY_SEQLOCK_H_
+#define _AVL_ARRAY_SEQLOCK_H_
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include "avl_array.h"
+
+#if defined(__SANITIZE_THREAD__)
+#define AVL_ARRAY_SEQLOCK_TSAN
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define AVL_ARRAY_SEQLOCK_TSAN
+#endif
+#endif
+
+
+/**
+ * \param Key The key type, must be trivially copyable
+ * \param T The Data type, must be trivially copyable
+ * \param size_type Container size type
+ * \param Size Container size
+ * \param Fast, Layout, Ranked, Alloc See avl_array
+ */
+template<typename Key, typename T, typename size_type, const size_type Size, const bool Fast = true, typename Layout = avl_array_layout_soa, const bool Ranked = false, typename Alloc = avl_array_alloc_static>
+class avl_array_seqlock
+{
+public:
+  typedef avl_array<Key, T, size_type, Size, Fast, Layout, Ranked, Alloc> container_type;
+  typedef T                                                               value_type;
+  typedef Key                                                             key_type;
+
+private:
+  static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                "avl_array_seqlock needs trivially copyable key and value types");
+
+  container_type                     avl_;      // the protected container
+  mutable std::atomic<std::uint64_t> seq_;      // sequence counter, odd while a writer modifies the container
+  std::atomic<bool>                  locked_;   // writer lock
+
+  // number of busy wait rounds before the thread yields
+  static const unsigned SPIN_LIMIT = 64U;
+
+public:
+
+  // ctor, reserves the arrays for Size nodes, see capacity()
+  avl_array_seqlock()
+    : seq_(0U)
+    , locked_(false)
+  {
+    (void)avl_.reserve(avl_.max_size());
+  }
+
+
+  /**
+   * Number of elements the container can hold, the arrays are never reallocated beyond it
+   * \return max_size() or less if the arrays couldn't be reserved completely
+   */
+  size_type capacity() const
+  { return avl_.capacity(); }
+
+
+  /**
+   * Find an element, lock free
+   * Retries if a writer modified the container meanwhile
+   * \param key The key to find
+   * \param val If key is found, the value of the element is set (val may be changed even if key is not found)
+   * \return True if key was found
+   */
+  bool find(const key_type& key, value_type& val) const
+  {
+    for (unsigned spins = 0U;; backoff(spins)) {
+      const std::uint64_t seq = seq_.load(std::memory_order_acquire);
+      if (seq & 1U) {
+        // writer active
+        continue;
+      }
+      const bool found = avl_.find_bounded(key, val);
+      if (unchanged(seq)) {
+        return found;
+      }
+    }
+  }
+
+
+  /**
+   * Number of elements, lock free
+   * \return Actual size
+   */
+  size_type size() const
+  {
+    for (unsigned spins = 0U;; backoff(spins)) {
+      const std::uint64_t seq = seq_.load(std::memory_order_acquire);
+      if (!(seq & 1U)) {
+        const size_type size = avl_.size();
+        if (unchanged(seq)) {
+          return size;
+        }
+      }
+    }
+  }
+
+
+  /**
+   * Insert or update an element, serialized with other writers
+   * \param key The key to insert
+   * \param val The value to insert
+   * \return True if the element was inserted or updated, false if the container is full (see capacity())
+   */
+  bool insert(const key_type& key, const value_type& val)
+  {
+    write_begin();
+    // a new element must not grow the arrays, readers may walk them
+    const bool result = ((avl_.size() < avl_.capacity()) || avl_.count(key)) && avl_.insert(key, val);
+    write_end();
+    return result;
+  }
+
+
+  /**
+   * Remove an element, serialized with other writers
+   * \param key The key of the element to remove
+   * \return True if the element was removed, false if key was not found
+   */
+  bool erase(const key_type& key)
+  {
+    write_begin();
+    const bool result = avl_.erase(key);
+    write_end();
+    return result;
+  }
+
+
+  /**
+   * Remove all elements, serialized with other writers
+   */
+  void clear()
+  {
+    write_begin();
+    avl_.clear();
+    write_end();
+  }
+
+
+  /**
+   * Any modification of the container in one write section, e.g. a batch of inserts
+   * Readers retry until the section is finished. Don't call shrink_to_fit() and don't insert more than
+   * capacity() elements, the arrays must not be reallocated.
+   * \param f Function called with the container, f(container_type&)
+   */
+  template<typename Function>
+  void write(Function f)
+  {
+    write_begin();
+    f(avl_);
+    write_end();
+  }
+
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Helper functions
+private:
+
+  // busy wait a little, yield the CPU if it takes longer (the writer may be preempted)
+  static inline void backoff(unsigned& spins)
+  {
+    if (++spins < SPIN_LIMIT) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      __builtin_ia32_pause();
+#endif
+    }
+    else {
+      spins = 0U;
+      std::this_thread::yield();
+    }
+  }
+
+
+  // true if the counter still has the value seq, the preceding reads of the container are ordered before
+  inline bool unchanged(std::uint64_t seq) const
+  {
+#if defined(AVL_ARRAY_SEQLOCK_TSAN)
+    return seq_.fetch_add(0U, std::memory_order_release) == seq;
+#else
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq_.load(std::memory_order_relaxed) == seq;
+#endif
+  }
+
+
+  // take the writer lock and make the sequence counter odd
+  inline void write_begin()
+  {
+    for (unsigned spins = 0U; locked_.exchange(true, std::memory_order_acquire);) {
+      while (locked_.load(std::memory_order_relaxed)) {
+        backoff(spins);
+      }
+    }
+    // the odd counter must be visible before any modification
+#if defined(AVL_ARRAY_SEQLOCK_TSAN)
+    (void)seq_.fetch_add(1U, std::memory_order_acq_rel);
+#else
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+#endif
+  }
+
+
+  // make the sequence counter even again and release the writer lock
+  inline void write_end()
+  {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1U, std::memory_order_release);
+    locked_.store(false, std::memory_order_release);
+  }
+
+
+  // not copyable
+  avl_array_seqlock(const avl_array_seqlock&);
+  avl_array_seqlock& operator=(const avl_array_seqlock&);
+};
+
+#endif  // _AVL_ARRAY_SEQLOCK_H_
@@ -0,0 +1,361 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief avl_array_sharded class
+// Thread safe container which partitions the keys over 'Shards' independent
+// avl_array trees, each guarded by its own lock. Writers of different shards
+// don't contend, so the insert/erase throughput grows with the number of cores.
+// The partition policy maps a key to its shard: avl_array_partition_hash
+// spreads any key type evenly, avl_array_partition_range keeps integral keys
+// in ascending shard order (contiguous key ranges per shard).
+// Ordered iteration merges the sorted shards (k-way merge), so the elements
+// are visited in ascending key order with both partition policies.
+// Every shard has a capacity of 'SizePerShard' elements, an insert fails if
+// the shard of the key is full.
+//
+// usage:
+// #include "avl_array_sharded.h"
+// avl_array_sharded<int, int, int, 1024, 16> avl;
+// avl.insert(1, 1);      // any thread
+// int val;
+// avl.find(1, val);      // any thread
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AVL_ARRAY_SHARDED_H_
+#define _AVL_ARRAY_SHARDED_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include "avl_array.h"
+
+
+/**
+ * Hash partition
+ * Any key type with std::hash support. The hash is multiplied by the 64 bit golden ratio,
+ * so identity hashes of integral keys are spread evenly as well.
+ */
+struct avl_array_partition_hash
+{
+  template<typename Key>
+  static inline std::size_t shard(const Key& key, std::size_t shards)
+  {
+    const std::uint64_t h = static_cast<std::uint64_t>(std::hash<Key>()(key)) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<std::size_t>((h >> 32U) % shards);
+  }
+};
+
+
+/**
+ * Range partition
+ * Integral keys only. The key range of the type is split into 'shards' equal parts in ascending
+ * order, keys are only spread evenly if they are spread evenly over the whole range of the type.
+ */
+struct avl_array_partition_range
+{
+  template<typename Key>
+  static inline std::size_t shard(const Key& key, std::size_t shards)
+  {
+    static_assert(std::is_integral<Key>::value, "avl_array_partition_range needs an integral key type");
+    // map to an unsigned value with the same order, scaled to 64 bit
+    typedef typename std::make_unsigned<Key>::type unsigned_type;
+    const unsigned_type offset = std::is_signed<Key>::value ? static_cast<unsigned_type>(static_cast<unsigned_type>(1U) << (8U * sizeof(Key) - 1U)) : 0U;
+    const std::uint64_t u = static_cast<std::uint64_t>(static_cast<unsigned_type>(static_cast<unsigned_type>(key) ^ offset)) << (64U - 8U * sizeof(Key));
+    // scale the upper 32 bit to [0, shards) by a multiplication, max / shards + 1 would overflow for one shard
+    return static_cast<std::size_t>(((u >> 32U) * static_cast<std::uint64_t>(shards)) >> 32U);
+  }
+};
+
+
+/**
+ * \param Key The key type. The type (class) must provide a 'less than' and 'equal to' operator
+ * \param T The Data type
+ * \param size_type Container size type
+ * \param SizePerShard Capacity of every shard
+ * \param Shards Number of shards
+ * \param Partition Partition policy, avl_array_partition_hash (default) or avl_array_partition_range
+ * \param Fast, Layout, Alloc See avl_array
+ */
+template<typename Key, typename T, typename size_type, const size_type SizePerShard, const std::size_t Shards, typename Partition = avl_array_partition_hash, const bool Fast = true, typename Layout = avl_array_layout_soa, typename Alloc = avl_array_alloc_static>
+class avl_array_sharded
+{
+public:
+  typedef avl_array<Key, T, size_type, SizePerShard, Fast, Layout, false, Alloc> container_type;
+  typedef T                                                                      value_type;
+  typedef Key                                                                    key_type;
+
+private:
+  static_assert(Shards > 0U, "avl_array_sharded needs at least one shard");
+
+  // assumed cache line size, hot members of different shards are at least this far apart
+  static const std::size_t CACHE_LINE = 64U;
+
+  // shard, cache line aligned, so the lock and the tree metadata of neighbour shards never share a cache line
+  typedef struct alignas(CACHE_LINE) tag_shard_type {
+    mutable std::mutex mutex;                 // shard lock, mutable for the const readers
+    container_type     tree;                  // shard tree
+  } shard_type;
+
+  shard_type shard_[Shards];
+
+  inline shard_type& shard_of(const key_type& key)
+  { return shard_[Partition::shard(key, Shards)]; }
+
+  inline const shard_type& shard_of(const key_type& key) const
+  { return shard_[Partition::shard(key, Shards)]; }
+
+  // merge iterator class, visits the elements of all shards in ascending key order
+  typedef class tag_avl_array_sharded_iterator
+  {
+    typedef typename container_type::const_iterator shard_iterator;
+
+    const avl_array_sharded* instance_;     // sharded instance
+    shard_iterator           it_[Shards];   // actual position in every shard
+    std::size_t              min_;          // shard with the smallest actual key, Shards at the end
+
+    friend avl_array_sharded;
+
+  public:
+    // ctor, begin() if instance is given, else end()
+    tag_avl_array_sharded_iterator(const avl_array_sharded* instance = nullptr)
+      : instance_(instance)
+      , min_(Shards)
+    {
+      if (instance_) {
+        for (std::size_t s = 0U; s < Shards; ++s) {
+          it_[s] = instance_->shard_[s].tree.begin();
+        }
+        select();
+      }
+    }
+
+    inline bool operator==(const tag_avl_array_sharded_iterator& rhs) const
+    { return (min_ == rhs.min_) && ((min_ == Shards) || (it_[min_] == rhs.it_[rhs.min_])); }
+
+    inline bool operator!=(const tag_avl_array_sharded_iterator& rhs) const
+    { return !(*this == rhs); }
+
+    // dereference - access value
+    inline const T& operator*() const
+    { return val(); }
+
+    // access value
+    inline const T& val() const
+    { return it_[min_].val(); }
+
+    // access key
+    inline const Key& key() const
+    { return it_[min_].key(); }
+
+    // preincrement
+    tag_avl_array_sharded_iterator& operator++()
+    {
+      ++it_[min_];
+      select();
+      return *this;
+    }
+
+    // postincrement
+    inline tag_avl_array_sharded_iterator operator++(int)
+    {
+      tag_avl_array_sharded_iterator _copy = *this;
+      ++(*this);
+      return _copy;
+    }
+
+  private:
+    // find the shard with the smallest actual key
+    void select()
+    {
+      min_ = Shards;
+      for (std::size_t s = 0U; s < Shards; ++s) {
+        if ((it_[s] != instance_->shard_[s].tree.end()) && ((min_ == Shards) || (it_[s].key() < it_[min_].key()))) {
+          min_ = s;
+        }
+      }
+    }
+  } avl_array_sharded_iterator;
+
+
+public:
+
+  typedef avl_array_sharded_iterator const_iterator;
+
+
+  // ctor
+  avl_array_sharded()
+  { }
+
+
+  // heap allocation keeps the shards cache line aligned, the global new only aligns to alignof(std::max_align_t) before C++17
+  static void* operator new(std::size_t bytes)
+  {
+    void* raw = ::operator new(bytes + CACHE_LINE);
+    // the aligned block starts at least one pointer behind raw, the raw address is stored in front of it
+    void* addr = reinterpret_cast<void*>((reinterpret_cast<std::uintptr_t>(raw) + CACHE_LINE) & ~static_cast<std::uintptr_t>(CACHE_LINE - 1U));
+    static_cast<void**>(addr)[-1] = raw;
+    return addr;
+  }
+
+  static void operator delete(void* addr)
+  {
+    if (addr) {
+      ::operator delete(static_cast<void**>(addr)[-1]);
+    }
+  }
+
+
+  /**
+   * Merge iterators in ascending key order
+   * The iteration doesn't lock the shards, no writer may modify the container meanwhile.
+   * Use for_each_sorted() if writers may be active. Every step costs O(Shards) key comparisons.
+   */
+  inline const_iterator begin() const
+  { return const_iterator(this); }
+
+  inline const_iterator end() const
+  { return const_iterator(); }
+
+
+  /**
+   * Number of elements
+   * Locks one shard after the other, so the result is only exact if no writer is active
+   * \return Sum of all shard sizes
+   */
+  std::size_t size() const
+  {
+    std::size_t size = 0U;
+    for (std::size_t s = 0U; s < Shards; ++s) {
+      std::lock_guard<std::mutex> lock(shard_[s].mutex);
+      size += static_cast<std::size_t>(shard_[s].tree.size());
+    }
+    return size;
+  }
+
+  inline bool empty() const
+  { return size() == 0U; }
+
+  // maximum number of elements, if the keys are spread evenly
+  inline std::size_t max_size() const
+  { return static_cast<std::size_t>(SizePerShard) * Shards; }
+
+
+  /**
+   * Insert or update an element, only the shard of key is locked
+   * \param key The key to insert
+   * \param val The value to insert
+   * \return True if the element was inserted or updated, false if the shard of key is full
+   */
+  bool insert(const key_type& key, const value_type& val)
+  {
+    shard_type& shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.tree.insert(key, val);
+  }
+
+
+  /**
+   * Find an element, only the shard of key is locked
+   * \param key The key to find
+   * \param val If key is found, the value of the element is set
+   * \return True if key was found
+   */
+  bool find(const key_type& key, value_type& val) const
+  {
+    const shard_type& shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.tree.find(key, val);
+  }
+
+
+  /**
+   * Count elements with a specific key, only the shard of key is locked
+   * \param key The key to find/count
+   * \return 0 if key was not found, 1 if key was found
+   */
+  size_type count(const key_type& key) const
+  {
+    const shard_type& shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.tree.count(key);
+  }
+
+
+  /**
+   * Remove an element, only the shard of key is locked
+   * \param key The key of the element to remove
+   * \return True if the element was removed, false if key was not found
+   */
+  bool erase(const key_type& key)
+  {
+    shard_type& shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.tree.erase(key);
+  }
+
+
+  /**
+   * Remove all elements, locks one shard after the other
+   */
+  void clear()
+  {
+    for (std::size_t s = 0U; s < Shards; ++s) {
+      std::lock_guard<std::mutex> lock(shard_[s].mutex);
+      shard_[s].tree.clear();
+    }
+  }
+
+
+  /**
+   * Call f for every element in ascending key order (k-way merge of the shards)
+   * All shards are locked during the walk (in shard order, so concurrent calls can't deadlock),
+   * f must not call any member of this container.
+   * \param f Function called with key and value of every element, f(const Key&, const T&)
+   */
+  template<typename Function>
+  void for_each_sorted(Function f) const
+  {
+    for (std::size_t s = 0U; s < Shards; ++s) {
+      shard_[s].mutex.lock();
+    }
+    for (const_iterator it = begin(); it != end(); ++it) {
+      f(it.key(), it.val());
+    }
+    for (std::size_t s = Shards; s > 0U; --s) {
+      shard_[s - 1U].mutex.unlock();
+    }
+  }
+
+
+private:
+  // not copyable
+  avl_array_sharded(const avl_array_sharded&);
+  avl_array_sharded& operator=(const avl_array_sharded&);
+};
+
+#endif  // _AVL_ARRAY_SHARDED_H_
@@ -0,0 +1,369 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief avl_array_snapshot class
+// This is an immutable, read only search array which is built from the actual
+// content of an avl_array. The keys are stored in Eytzinger order (breadth-first
+// order of a complete binary tree, see readme). A search step needs no child
+// index, the children of position i are located at 2i and 2i+1. The top levels of
+// the tree share a few cache lines, and the search loop is branch free and
+// prefetches the 16 (4 byte keys) descendants four levels ahead. The keys start
+// at a cache line, so these descendants share one cache line.
+// Use it for trees which are rebuilt rarely but searched very often.
+//
+// usage:
+// #include "avl_array_snapshot.h"
+// avl_array<int, int, int, 1024> avl;
+// avl_array_snapshot<int, int, int, 1024> snap;
+// snap.freeze(avl);
+// int val;
+// snap.find(1, val);
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AVL_ARRAY_SNAPSHOT_H_
+#define _AVL_ARRAY_SNAPSHOT_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include "avl_array.h"
+
+
+/**
+ * \param Key The key type. The type (class) must provide a 'less than' and 'equal to' operator
+ * \param T The Data type
+ * \param size_type Container size type
+ * \param Size Container size
+ */
+template<typename Key, typename T, typename size_type, const size_type Size>
+class avl_array_snapshot
+{
+  // raw key and value storage, only the positions [1, size_] hold constructed elements
+  typedef typename std::aligned_storage<sizeof(Key), alignof(Key)>::type key_storage_type;
+  typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type     val_storage_type;
+
+  // node storage, position 0 is not used, it's the 'end' position
+  // the keys start at a cache line, so a prefetched block of PREFETCH_BLOCK keys is one cache line
+  alignas(avl_array_heap_aligned::CACHE_LINE)
+  key_storage_type  key_[Size + 1U];      // node key in Eytzinger order
+  val_storage_type  val_[Size + 1U];      // node value
+  std::size_t       size_;                // actual size
+
+  // number of keys in one cache line (rounded down to a power of 2), used as prefetch distance
+  static const std::size_t PREFETCH_BLOCK = sizeof(Key) <= 4U ? 16U : sizeof(Key) <= 8U ? 8U : sizeof(Key) <= 16U ? 4U : sizeof(Key) <= 32U ? 2U : 1U;
+
+  // iterator class
+  typedef class tag_avl_array_snapshot_iterator
+  {
+    const avl_array_snapshot* instance_;  // snapshot instance
+    std::size_t               pos_;       // actual position, 0 is end
+
+    friend avl_array_snapshot;            // avl_array_snapshot may access the position
+
+  public:
+    // ctor
+    tag_avl_array_snapshot_iterator(const avl_array_snapshot* instance = nullptr, std::size_t pos = 0U)
+      : instance_(instance)
+      , pos_(pos)
+    { }
+
+    inline bool operator==(const tag_avl_array_snapshot_iterator& rhs) const
+    { return pos_ == rhs.pos_; }
+
+    inline bool operator!=(const tag_avl_array_snapshot_iterator& rhs) const
+    { return !(*this == rhs); }
+
+    // dereference - access value
+    inline const T& operator*() const
+    { return val(); }
+
+    // access value
+    inline const T& val() const
+    { return instance_->val(pos_); }
+
+    // access key
+    inline const Key& key() const
+    { return instance_->key(pos_); }
+
+    // preincrement
+    tag_avl_array_snapshot_iterator& operator++()
+    {
+      pos_ = instance_->next(pos_);
+      return *this;
+    }
+
+    // postincrement
+    inline tag_avl_array_snapshot_iterator operator++(int)
+    {
+      tag_avl_array_snapshot_iterator _copy = *this;
+      ++(*this);
+      return _copy;
+    }
+  } avl_array_snapshot_iterator;
+
+
+public:
+
+  typedef T                           value_type;
+  typedef Key                         key_type;
+  typedef avl_array_snapshot_iterator const_iterator;
+
+
+  // ctor, no element is constructed
+  avl_array_snapshot()
+    : size_(0U)
+  { }
+
+
+  // copy ctor, only the actual elements are copied
+  avl_array_snapshot(const avl_array_snapshot& other)
+    : size_(0U)
+  { copy_from(other); }
+
+
+  // dtor, destroys the actual elements
+  ~avl_array_snapshot()
+  { clear(); }
+
+
+  // heap allocation keeps the keys cache line aligned, the global new only aligns to alignof(std::max_align_t) before C++17
+  static void* operator new(std::size_t bytes)
+  { return avl_array_heap_aligned::allocate(bytes); }
+
+  static void operator delete(void* addr)
+  { avl_array_heap_aligned::deallocate(addr); }
+
+
+  avl_array_snapshot& operator=(const avl_array_snapshot& other)
+  {
+    if (this != &other) {
+      clear();
+      copy_from(other);
+    }
+    return *this;
+  }
+
+
+  // iterators
+  inline const_iterator begin() const
+  {
+    // smallest element is the farthest position left from root
+    std::size_t i = 0U;
+    if (size_) {
+      for (i = 1U; 2U * i <= size_; i *= 2U);
+    }
+    return const_iterator(this, i);
+  }
+
+  inline const_iterator end() const
+  { return const_iterator(this, 0U); }
+
+
+  // capacity
+  inline size_type size() const
+  { return static_cast<size_type>(size_); }
+
+  inline bool empty() const
+  { return size_ == 0U; }
+
+  inline size_type max_size() const
+  { return Size; }
+
+
+  // destroy all elements
+  inline void clear()
+  {
+    for (std::size_t i = 1U; i <= size_; ++i) {
+      key(i).~Key();
+      val(i).~T();
+    }
+    size_ = 0U;
+  }
+
+
+  /**
+   * Build the snapshot from the actual content of a container
+   * The container is traversed in order once, the former snapshot content is discarded.
+   * Only the size() elements of the container are constructed.
+   * \param avl The avl_array (or any container with sorted key/value iterators) to freeze
+   * \return True if the snapshot was built, false if the container has more elements than the snapshot can hold
+   */
+  template<typename Container>
+  bool freeze(const Container& avl)
+  {
+    if (static_cast<std::size_t>(avl.size()) > static_cast<std::size_t>(Size)) {
+      return false;
+    }
+    clear();
+    size_ = static_cast<std::size_t>(avl.size());
+
+    // in order traversal of the implicit tree, constructing the sorted elements
+    std::size_t i = begin().pos_;
+    for (typename Container::const_iterator it = avl.begin(); it != avl.end(); ++it) {
+      ::new (static_cast<void*>(key_ + i)) Key(it.key());
+      ::new (static_cast<void*>(val_ + i)) T(it.val());
+      i = next(i);
+    }
+    return true;
+  }
+
+
+  /**
+   * Find an element
+   * \param key The key to find
+   * \param val If key is found, the value of the element is set
+   * \return True if key was found
+   */
+  inline bool find(const key_type& key, value_type& val) const
+  {
+    const std::size_t i = lower_bound_pos(key);
+    if (i && (this->key(i) == key)) {
+      val = this->val(i);
+      return true;
+    }
+    return false;
+  }
+
+
+  /**
+   * Find an element and return an iterator as result
+   * \param key The key to find
+   * \return Iterator if key was found, else end() is returned
+   */
+  inline const_iterator find(const key_type& key) const
+  {
+    const std::size_t i = lower_bound_pos(key);
+    return const_iterator(this, (i && (this->key(i) == key)) ? i : 0U);
+  }
+
+
+  /**
+   * Find the first element whose key is not less than the given key
+   * \param key The key to compare
+   * \return Iterator to the first element not less than key, end() if there is none
+   */
+  inline const_iterator lower_bound(const key_type& key) const
+  {
+    return const_iterator(this, lower_bound_pos(key));
+  }
+
+
+  /**
+   * Find the first element whose key is greater than the given key
+   * \param key The key to compare
+   * \return Iterator to the first element greater than key, end() if there is none
+   */
+  inline const_iterator upper_bound(const key_type& key) const
+  {
+    std::size_t i = 1U;
+    while (i <= size_) {
+      prefetch(i);
+      i = 2U * i + !(key < this->key(i));
+    }
+    return const_iterator(this, ascend(i));
+  }
+
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Helper functions
+private:
+
+  // element access of a constructed position
+  inline const Key& key(std::size_t pos) const
+  { return *reinterpret_cast<const Key*>(key_ + pos); }
+
+  inline Key& key(std::size_t pos)
+  { return *reinterpret_cast<Key*>(key_ + pos); }
+
+  inline const T& val(std::size_t pos) const
+  { return *reinterpret_cast<const T*>(val_ + pos); }
+
+  inline T& val(std::size_t pos)
+  { return *reinterpret_cast<T*>(val_ + pos); }
+
+
+  // copy the elements of other, the snapshot must be empty
+  void copy_from(const avl_array_snapshot& other)
+  {
+    for (std::size_t i = 1U; i <= other.size_; ++i) {
+      ::new (static_cast<void*>(key_ + i)) Key(other.key(i));
+      ::new (static_cast<void*>(val_ + i)) T(other.val(i));
+    }
+    size_ = other.size_;
+  }
+
+
+  // branch free descent, every step goes left if key_[i] is not less than key
+  inline std::size_t lower_bound_pos(const key_type& key) const
+  {
+    std::size_t i = 1U;
+    while (i <= size_) {
+      prefetch(i);
+      i = 2U * i + (this->key(i) < key);
+    }
+    return ascend(i);
+  }
+
+
+  // the search result is the last position where the descent went left:
+  // strip all trailing right turns (1 bits) and the final left turn
+  static inline std::size_t ascend(std::size_t i)
+  {
+#if defined(__GNUC__)
+    return i >> __builtin_ffsll(static_cast<long long>(~i));
+#else
+    while (i & 1U) {
+      i >>= 1U;
+    }
+    return i >> 1U;
+#endif
+  }
+
+
+  // prefetch the cache line holding the descendants of position i four levels ahead
+  inline void prefetch(std::size_t i) const
+  {
+#if defined(__GNUC__)
+    __builtin_prefetch(key_ + (PREFETCH_BLOCK * i < Size + 1U ? PREFETCH_BLOCK * i : 0U));
+#else
+    (void)i;
+#endif
+  }
+
+
+  // in order successor position, 0 if pos is the last element
+  inline std::size_t next(std::size_t pos) const
+  {
+    if (2U * pos + 1U <= size_) {
+      // successor is the furthest left position of right subtree
+      for (pos = 2U * pos + 1U; 2U * pos <= size_; pos *= 2U);
+      return pos;
+    }
+    // move up until pos is a left child, its parent is the successor
+    return ascend(pos);
+  }
+};
+
+#endif  // _AVL_ARRAY_SNAPSHOT_H_
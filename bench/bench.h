@@ -0,0 +1,292 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief avl_array benchmark helpers
+// Timer, random generator and hardware cache / TLB miss counters used by the
+// benchmarks in this directory. The cache miss counters use the Linux perf
+// events interface. If it's not available (other OS, missing permissions,
+// virtual machine without PMU) the counters report themselves as invalid and
+// the benchmarks print 'n/a' instead of a number.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AVL_ARRAY_BENCH_H_
+#define _AVL_ARRAY_BENCH_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace bench {
+
+
+/**
+ * Monotonic time stamp
+ * \return Actual time in nanoseconds
+ */
+inline std::uint64_t now_ns()
+{
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+/**
+ * xorshift64* pseudo random generator
+ * Fast and deterministic, so every run and every container under test sees the same key sequence
+ */
+class random
+{
+  std::uint64_t state_;
+
+public:
+  explicit random(std::uint64_t seed = 0x9E3779B97F4A7C15ULL)
+    : state_(seed ? seed : 1U)
+  { }
+
+  inline std::uint64_t next()
+  {
+    state_ ^= state_ >> 12U;
+    state_ ^= state_ << 25U;
+    state_ ^= state_ >> 27U;
+    return state_ * 0x2545F4914F6CDD1DULL;
+  }
+
+  // uniform value in range [0, n)
+  inline std::uint64_t next(std::uint64_t n)
+  {
+    return next() % n;
+  }
+};
+
+
+/**
+ * Zipfian distributed random generator
+ * Returns ranks in range [0, n), rank 0 is the most frequent one. The probability of rank k is
+ * proportional to 1 / (k + 1)^s. Sampling is a binary search over the precomputed distribution.
+ */
+class zipf
+{
+  std::vector<double> cdf_;
+
+public:
+  zipf(std::size_t n, double s = 0.99)
+    : cdf_(n)
+  {
+    double sum = 0.0;
+    for (std::size_t k = 0U; k < n; ++k) {
+      sum += 1.0 / std::pow(static_cast<double>(k + 1U), s);
+      cdf_[k] = sum;
+    }
+    for (std::size_t k = 0U; k < n; ++k) {
+      cdf_[k] /= sum;
+    }
+  }
+
+  inline std::size_t next(random& rnd) const
+  {
+    const double u = static_cast<double>(rnd.next() >> 11U) * (1.0 / 9007199254740992.0);
+    const std::size_t k = static_cast<std::size_t>(std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin());
+    return k < cdf_.size() ? k : cdf_.size() - 1U;
+  }
+};
+
+
+/**
+ * Hardware event counter
+ * Counts the given perf event of the calling thread (user space only) between start() and stop()
+ */
+class perf_counter
+{
+  int fd_;
+
+public:
+  enum event_type {
+    L1D_READ_MISS,    // L1 data cache read misses
+    LLC_MISS,         // last level cache misses
+    DTLB_READ_MISS    // data TLB read misses
+  };
+
+  explicit perf_counter(event_type event)
+    : fd_(-1)
+  {
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    if (event == L1D_READ_MISS) {
+      attr.type   = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8U) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16U);
+    }
+    else if (event == DTLB_READ_MISS) {
+      attr.type   = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8U) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16U);
+    }
+    else {
+      attr.type   = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    }
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+    (void)event;
+#endif
+  }
+
+  ~perf_counter()
+  {
+#if defined(__linux__)
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+#endif
+  }
+
+  // true if the counter is available
+  inline bool valid() const
+  { return fd_ >= 0; }
+
+  inline void start()
+  {
+#if defined(__linux__)
+    if (valid()) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  inline void stop()
+  {
+#if defined(__linux__)
+    if (valid()) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+  }
+
+  // counted events since last start()
+  inline std::uint64_t value() const
+  {
+    std::uint64_t count = 0U;
+#if defined(__linux__)
+    if (valid() && (read(fd_, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count)))) {
+      count = 0U;
+    }
+#endif
+    return count;
+  }
+
+private:
+  perf_counter(const perf_counter&);
+  perf_counter& operator=(const perf_counter&);
+};
+
+
+/**
+ * Bytes actually allocated by all counting_allocator instances
+ */
+inline std::size_t& allocated_bytes()
+{
+  static std::size_t bytes = 0U;
+  return bytes;
+}
+
+
+/**
+ * Allocator which counts the allocated bytes in allocated_bytes()
+ * Used to measure the heap footprint of standard containers
+ */
+template<typename T>
+class counting_allocator
+{
+public:
+  typedef T value_type;
+
+  counting_allocator()
+  { }
+
+  template<typename U>
+  counting_allocator(const counting_allocator<U>&)
+  { }
+
+  inline T* allocate(std::size_t n)
+  {
+    allocated_bytes() += n * sizeof(T);
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  inline void deallocate(T* p, std::size_t n)
+  {
+    allocated_bytes() -= n * sizeof(T);
+    ::operator delete(p);
+  }
+};
+
+template<typename T, typename U>
+inline bool operator==(const counting_allocator<T>&, const counting_allocator<U>&)
+{ return true; }
+
+template<typename T, typename U>
+inline bool operator!=(const counting_allocator<T>&, const counting_allocator<U>&)
+{ return false; }
+
+
+/**
+ * Format a per operation event count, 'n/a' if the counter is not available
+ * \param buf Output buffer
+ * \param size Size of output buffer
+ * \param counter The (stopped) counter
+ * \param ops Number of operations the counter ran for
+ * \return buf
+ */
+inline const char* per_op(char* buf, std::size_t size, const perf_counter& counter, std::uint64_t ops)
+{
+  if (counter.valid() && ops) {
+    std::snprintf(buf, size, "%.2f", static_cast<double>(counter.value()) / static_cast<double>(ops));
+  }
+  else {
+    std::snprintf(buf, size, "n/a");
+  }
+  return buf;
+}
+
+
+} // namespace bench
+
+#endif  // _AVL_ARRAY_BENCH_H_
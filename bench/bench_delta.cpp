@@ -0,0 +1,115 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief delta file benchmark
+// Builds a 4M node tree with dirty node tracking, then inserts 0.1%, 1% and
+// 10% new keys (rebalancing marks more nodes than inserted) and compares
+// write_delta() with a full save() (time and bytes written) and apply_delta()
+// on a replica.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../avl_array_image.h"
+
+
+static const std::uint32_t TREE_SIZE = 4U * 1024U * 1024U;
+static const std::uint32_t MAX_SIZE  = 8U * 1024U * 1024U;
+
+typedef avl_array<std::uint32_t, std::uint32_t, std::uint32_t, MAX_SIZE, true, avl_array_layout_soa, false, avl_array_alloc_dynamic, true> tree_type;
+typedef avl_array<std::uint32_t, std::uint32_t, std::uint32_t, MAX_SIZE, true, avl_array_layout_soa, false, avl_array_alloc_dynamic> replica_type;
+
+
+static double ms_since(std::uint64_t start)
+{
+  return static_cast<double>(bench::now_ns() - start) / 1e6;
+}
+
+
+static long long kb(off_t bytes)
+{
+  return static_cast<long long>(bytes / 1024);
+}
+
+
+int main()
+{
+  char path[] = "/tmp/avl_array_bench_XXXXXX";
+  const int fd = mkstemp(path);
+  const int in = open(path, O_RDONLY);
+  if ((fd < 0) || (in < 0)) {
+    std::printf("can't create delta file\n");
+    return 1;
+  }
+
+  tree_type* avl = new tree_type;
+  replica_type* replica = new replica_type;
+  avl->reserve(MAX_SIZE);       // no relocation during the measurements
+  replica->reserve(MAX_SIZE);
+  bench::random rnd;
+  for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+    avl->insert(static_cast<std::uint32_t>(rnd.next()), n);
+  }
+  // initial delta holds all nodes
+  avl->write_delta(fd);
+  replica->apply_delta(in);
+
+  static const std::uint32_t PERMILLE[] = { 1U, 10U, 100U };
+  for (std::size_t p = 0U; p < sizeof(PERMILLE) / sizeof(PERMILLE[0]); ++p) {
+    const std::uint32_t ops = TREE_SIZE / 1000U * PERMILLE[p];
+    for (std::uint32_t n = 0U; n < ops; ++n) {
+      avl->insert(static_cast<std::uint32_t>(rnd.next()), n);   // mostly new keys, rebalancing touches more nodes
+    }
+    std::printf("%u inserts, %u dirty nodes\n", ops, static_cast<std::uint32_t>(avl->dirty_count()));
+
+    const off_t pos = lseek(fd, 0, SEEK_END);
+    std::uint64_t start = bench::now_ns();
+    avl->write_delta(fd);
+    std::printf("  %-20s %10.1f ms  (%lld kB)\n", "write_delta", ms_since(start), kb(lseek(fd, 0, SEEK_END) - pos));
+
+    start = bench::now_ns();
+    const bool ok = replica->apply_delta(in);
+    std::printf("  %-20s %10.1f ms  (%s)\n", "apply_delta", ms_since(start), ok && (replica->size() == avl->size()) ? "ok" : "failed");
+
+    char save_path[] = "/tmp/avl_array_bench_XXXXXX";
+    const int save_fd = mkstemp(save_path);
+    start = bench::now_ns();
+    avl->save(save_fd);
+    std::printf("  %-20s %10.1f ms  (%lld kB)\n", "save", ms_since(start), kb(lseek(save_fd, 0, SEEK_END)));
+    close(save_fd);
+    unlink(save_path);
+  }
+
+  delete replica;
+  delete avl;
+  close(in);
+  close(fd);
+  unlink(path);
+  return 0;
+}
@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief find benchmark
+// Compares find() against the branch free, prefetching find_branchless() and
+// the batched find_batch() (32 keys per call) for uniform and Zipfian
+// distributed key streams, each on a full tree of 64K and 1M nodes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array.h"
+
+
+static const std::uint32_t LOOKUPS = 4U * 1024U * 1024U;
+static const std::size_t   BATCH   = 32U;
+
+
+template<typename Tree>
+static void measure(const Tree& avl, const std::vector<std::uint32_t>& lookup, const char* stream)
+{
+  std::uint64_t sum_find = 0U, sum_branchless = 0U, val;
+
+  std::uint64_t start = bench::now_ns();
+  for (std::size_t n = 0U; n < lookup.size(); ++n) {
+    if (avl.find(lookup[n], val)) {
+      sum_find += val;
+    }
+  }
+  const std::uint64_t find_ns = bench::now_ns() - start;
+
+  start = bench::now_ns();
+  for (std::size_t n = 0U; n < lookup.size(); ++n) {
+    if (avl.find_branchless(lookup[n], val)) {
+      sum_branchless += val;
+    }
+  }
+  const std::uint64_t branchless_ns = bench::now_ns() - start;
+
+  std::uint64_t sum_batch = 0U, out[BATCH];
+  bool found[BATCH];
+  start = bench::now_ns();
+  for (std::size_t n = 0U; n + BATCH <= lookup.size(); n += BATCH) {
+    avl.find_batch(&lookup[n], BATCH, out, found);
+    for (std::size_t b = 0U; b < BATCH; ++b) {
+      if (found[b]) {
+        sum_batch += out[b];
+      }
+    }
+  }
+  const std::uint64_t batch_ns = bench::now_ns() - start;
+
+  std::printf("%8u nodes  %-8s  find %7.1f ns  find_branchless %7.1f ns  find_batch %7.1f ns  (checksum %s)\n",
+              static_cast<unsigned>(avl.size()),
+              stream,
+              static_cast<double>(find_ns) / static_cast<double>(lookup.size()),
+              static_cast<double>(branchless_ns) / static_cast<double>(lookup.size()),
+              static_cast<double>(batch_ns) / static_cast<double>(lookup.size()),
+              (sum_find == sum_branchless) && (sum_find == sum_batch) ? "ok" : "ERROR");
+}
+
+
+template<std::uint32_t Size>
+static void run()
+{
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, Size> tree_type;
+  tree_type* avl = new tree_type;
+
+  // fill the tree completely with random unique keys
+  bench::random rnd;
+  std::vector<std::uint32_t> keys;
+  keys.reserve(Size);
+  while (avl->size() < Size) {
+    const std::uint32_t key = static_cast<std::uint32_t>(rnd.next());
+    if (avl->find(key) == avl->end()) {
+      avl->insert(key, key);
+      keys.push_back(key);
+    }
+  }
+
+  // uniform stream, including 1/8 missing keys
+  std::vector<std::uint32_t> lookup(LOOKUPS);
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    lookup[n] = (n & 7U) ? keys[rnd.next(Size)] : static_cast<std::uint32_t>(rnd.next());
+  }
+  measure(*avl, lookup, "uniform");
+
+  // zipfian stream, the rank is mapped to the (random) insertion order
+  bench::zipf zipf(Size);
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    lookup[n] = keys[zipf.next(rnd)];
+  }
+  measure(*avl, lookup, "zipfian");
+
+  delete avl;
+}
+
+
+int main()
+{
+  std::printf("%u lookups per stream\n", LOOKUPS);
+  run<64U * 1024U>();
+  run<1024U * 1024U>();
+  return 0;
+}
@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief image file benchmark
+// Saves a 4M node tree as image file and compares the startup time of
+// load_mmap() (with and without verification) with replaying all
+// inserts into an empty tree. Also reports the time of the first 1M find()
+// calls on the mapped tree, which read the pages of the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../avl_array_image.h"
+
+
+static const std::uint32_t TREE_SIZE = 4U * 1024U * 1024U;
+
+typedef avl_array<std::uint32_t, std::uint32_t, std::uint32_t, TREE_SIZE, true, avl_array_layout_soa, false, avl_array_alloc_image> tree_type;
+
+
+static double ms_since(std::uint64_t start)
+{
+  return static_cast<double>(bench::now_ns() - start) / 1e6;
+}
+
+
+int main()
+{
+  char path[] = "/tmp/avl_array_bench_XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    std::printf("can't create image file\n");
+    return 1;
+  }
+
+  tree_type* avl = new tree_type;
+  bench::random rnd;
+  std::uint64_t start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+    avl->insert(static_cast<std::uint32_t>(rnd.next()), n);
+  }
+  std::printf("%-22s %10.1f ms  (%u nodes)\n", "replay insert", ms_since(start), avl->size());
+
+  start = bench::now_ns();
+  avl->save(fd);
+  std::printf("%-22s %10.1f ms  (%lld MB)\n", "save", ms_since(start), static_cast<long long>(lseek(fd, 0, SEEK_END) / (1024 * 1024)));
+
+  tree_type* load = new tree_type;
+  start = bench::now_ns();
+  const bool ok = load->load_mmap(path, false);
+  std::printf("%-22s %10.1f ms  (%s)\n", "load_mmap, trusted", ms_since(start), ok ? "ok" : "failed");
+
+  bench::random keys(7U);
+  std::uint32_t val, hits = 0U;
+  start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < 1024U * 1024U; ++n) {
+    hits += load->find(static_cast<std::uint32_t>(keys.next()), val) ? 1U : 0U;
+  }
+  std::printf("%-22s %10.1f ms  (hits %u)\n", "first 1M find", ms_since(start), hits);
+
+  start = bench::now_ns();
+  const bool verified = load->load_mmap(path);
+  std::printf("%-22s %10.1f ms  (%s)\n", "load_mmap, verify", ms_since(start), verified ? "ok" : "failed");
+
+  delete load;
+  delete avl;
+  close(fd);
+  unlink(path);
+  return 0;
+}
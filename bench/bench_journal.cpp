@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief journal benchmark
+// Compares the insert throughput of avl_array_journal with one fsync per
+// insert, with group commit of 8 writer threads which need every insert
+// durable, and with batches synced in the background of the writer. Also
+// reports the recovery time (replay of 1M records). The files are created in
+// /tmp or in the directory given as first argument, use a directory on the
+// disk of interest (tmpfs doesn't sync at all).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array_journal.h"
+
+
+static const std::uint32_t TREE_SIZE = 4U * 1024U * 1024U;
+static const std::uint32_t THREADS   = 8U;
+
+typedef avl_array_journal<std::uint32_t, std::uint32_t, std::uint32_t, TREE_SIZE> journal_type;
+
+
+static void report(const char* name, std::uint32_t ops, std::uint64_t start, const journal_type& journal)
+{
+  const double s = static_cast<double>(bench::now_ns() - start) / 1e9;
+  std::printf("%-26s %10.0f ops/s  (%u ops, %llu fsync)\n", name, ops / s, ops, static_cast<unsigned long long>(journal.syncs()));
+}
+
+
+static void remove_files(const std::string& path)
+{
+  unlink((path + ".img").c_str());
+  unlink((path + ".log").c_str());
+}
+
+
+int main(int argc, char* argv[])
+{
+  std::string dir = (argc > 1) ? argv[1] : "/tmp";
+  const std::string path = dir + "/avl_array_bench_journal";
+  remove_files(path);
+
+  // one fsync per insert
+  {
+    journal_type journal;
+    if (!journal.open(path.c_str())) {
+      std::printf("can't open journal in %s\n", dir.c_str());
+      return 1;
+    }
+    bench::random rnd;
+    const std::uint32_t ops = 20000U;
+    const std::uint64_t start = bench::now_ns();
+    for (std::uint32_t n = 0U; n < ops; ++n) {
+      journal.insert(static_cast<std::uint32_t>(rnd.next()), n, true);
+    }
+    report("durable, 1 thread", ops, start, journal);
+  }
+  remove_files(path);
+
+  // group commit, every insert durable
+  {
+    journal_type journal;
+    journal.open(path.c_str());
+    const std::uint32_t ops = 20000U;
+    std::vector<std::thread> threads;
+    const std::uint64_t start = bench::now_ns();
+    for (std::uint32_t t = 0U; t < THREADS; ++t) {
+      threads.push_back(std::thread([&journal, t, ops]() {
+        bench::random rnd(t + 1U);
+        for (std::uint32_t n = 0U; n < ops; ++n) {
+          journal.insert(static_cast<std::uint32_t>(rnd.next()), n, true);
+        }
+      }));
+    }
+    for (std::uint32_t t = 0U; t < THREADS; ++t) {
+      threads[t].join();
+    }
+    report("durable, 8 threads", ops * THREADS, start, journal);
+  }
+  remove_files(path);
+
+  // batches, synced when full
+  {
+    journal_type journal;
+    journal.open(path.c_str());
+    bench::random rnd;
+    const std::uint32_t ops = 1024U * 1024U;
+    const std::uint64_t start = bench::now_ns();
+    for (std::uint32_t n = 0U; n < ops; ++n) {
+      journal.insert(static_cast<std::uint32_t>(rnd.next()), n);
+    }
+    journal.sync();
+    report("batched (64K), 1 thread", ops, start, journal);
+  }
+
+  // recovery of the last run
+  {
+    journal_type journal;
+    const std::uint64_t start = bench::now_ns();
+    const bool ok = journal.open(path.c_str());
+    std::printf("%-26s %10.1f ms  (%u elements, %s)\n", "replay 1M records", static_cast<double>(bench::now_ns() - start) / 1e6, journal.size(), ok ? "ok" : "failed");
+  }
+  remove_files(path);
+  return 0;
+}
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief node layout benchmark
+// Compares find() of the default structure of arrays layout against the cache
+// line blocked and the compact layout on a completely filled 1M node tree.
+// Reports time and L1D / last level cache misses per lookup.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array.h"
+
+
+static const std::uint32_t TREE_SIZE = 1024U * 1024U;
+static const std::uint32_t LOOKUPS   = 4U * 1024U * 1024U;
+
+
+template<typename Layout>
+static void run(const char* name)
+{
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, TREE_SIZE, true, Layout> tree_type;
+  tree_type* avl = new tree_type;
+
+  // fill the tree completely with random unique keys
+  bench::random rnd;
+  std::vector<std::uint32_t> keys;
+  keys.reserve(TREE_SIZE);
+  while (avl->size() < TREE_SIZE) {
+    const std::uint32_t key = static_cast<std::uint32_t>(rnd.next());
+    if (avl->find(key) == avl->end()) {
+      avl->insert(key, key);
+      keys.push_back(key);
+    }
+  }
+
+  // random lookup sequence of existing keys
+  std::vector<std::uint32_t> lookup(LOOKUPS);
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    lookup[n] = keys[rnd.next(TREE_SIZE)];
+  }
+
+  bench::perf_counter l1d(bench::perf_counter::L1D_READ_MISS);
+  bench::perf_counter llc(bench::perf_counter::LLC_MISS);
+  std::uint64_t sum = 0U, val;
+
+  l1d.start();
+  llc.start();
+  const std::uint64_t start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    if (avl->find(lookup[n], val)) {
+      sum += val;
+    }
+  }
+  const std::uint64_t stop = bench::now_ns();
+  l1d.stop();
+  llc.stop();
+
+  char l1d_buf[16], llc_buf[16];
+  std::printf("%-10s %8.1f ns/find  %10s L1D miss/find  %10s LLC miss/find  %6.1f MB  (checksum %llu)\n",
+              name,
+              static_cast<double>(stop - start) / LOOKUPS,
+              bench::per_op(l1d_buf, sizeof(l1d_buf), l1d, LOOKUPS),
+              bench::per_op(llc_buf, sizeof(llc_buf), llc, LOOKUPS),
+              static_cast<double>(sizeof(tree_type)) / (1024.0 * 1024.0),
+              static_cast<unsigned long long>(sum));
+
+  delete avl;
+}
+
+
+int main()
+{
+  std::printf("find() on a full tree of %u nodes, %u random lookups\n", TREE_SIZE, LOOKUPS);
+  run<avl_array_layout_soa>("soa");
+  run<avl_array_layout_blocked>("blocked");
+  run<avl_array_layout_compact>("compact");
+  return 0;
+}
@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief lazy commit benchmark
+// Shows the resident memory of an avl_array with 16M nodes using the
+// avl_array_alloc_mmap allocation policy: after creation, after inserting 4M
+// elements, after erasing 3M of them and after shrink_to_fit(). Linux only,
+// the resident memory is read from /proc/self/statm.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../avl_array_mmap.h"
+
+
+static const std::uint32_t TREE_SIZE = 16U * 1024U * 1024U;
+static const std::uint32_t ELEMENTS  = 4U * 1024U * 1024U;
+
+// 64 byte payload
+struct record
+{
+  std::uint64_t data[8];
+};
+
+typedef avl_array<std::uint64_t, record, std::uint32_t, TREE_SIZE, true, avl_array_layout_soa, false, avl_array_alloc_mmap<> > tree_type;
+
+
+// resident memory of the process in MB
+static double resident_mb()
+{
+  unsigned long size = 0U, resident = 0U;
+  std::FILE* f = std::fopen("/proc/self/statm", "r");
+  if (f) {
+    if (std::fscanf(f, "%lu %lu", &size, &resident) != 2) {
+      resident = 0U;
+    }
+    std::fclose(f);
+  }
+  return static_cast<double>(resident) * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+}
+
+
+int main()
+{
+  const double base = resident_mb();
+  std::printf("%u nodes reserved, %.0f MB address space\n", TREE_SIZE, static_cast<double>(sizeof(std::uint64_t) + sizeof(record) + 1U + 3U * sizeof(std::uint32_t)) * TREE_SIZE / (1024.0 * 1024.0));
+
+  tree_type* avl = new tree_type;
+  if (!avl->max_size()) {
+    std::printf("mapping failed\n");
+    return 1;
+  }
+  std::printf("created          %8u elements  %8.1f MB resident\n", static_cast<unsigned>(avl->size()), resident_mb() - base);
+
+  bench::random rnd;
+  record rec = record();
+  std::uint64_t start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < ELEMENTS; ++n) {
+    rec.data[0] = n;
+    avl->insert(rnd.next(), rec);
+  }
+  std::uint64_t ns = bench::now_ns() - start;
+  std::printf("inserted         %8u elements  %8.1f MB resident  (%.1f ns/insert)\n", static_cast<unsigned>(avl->size()), resident_mb() - base, static_cast<double>(ns) / ELEMENTS);
+
+  while (avl->size() > ELEMENTS / 4U) {
+    avl->erase(avl->begin());
+  }
+  std::printf("erased           %8u elements  %8.1f MB resident\n", static_cast<unsigned>(avl->size()), resident_mb() - base);
+
+  start = bench::now_ns();
+  avl->shrink_to_fit();
+  ns = bench::now_ns() - start;
+  std::printf("shrink_to_fit()  %8u elements  %8.1f MB resident  (%.1f ms)\n", static_cast<unsigned>(avl->size()), resident_mb() - base, static_cast<double>(ns) / 1e6);
+
+  delete avl;
+  return 0;
+}
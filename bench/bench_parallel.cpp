@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief parallel bulk operation benchmark
+// Builds a 4M node tree from unsorted random records by inserting them one by
+// one and by avl_array_bulk_load() with 1, 2, 4 ... threads, then searches 4M
+// random keys by find_batch() with the same numbers of threads.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array_parallel.h"
+
+
+static const std::uint32_t TREE_SIZE = 4U * 1024U * 1024U;
+
+typedef avl_array<std::uint32_t, std::uint32_t, std::uint32_t, TREE_SIZE> tree_type;
+
+
+int main()
+{
+  const unsigned hw = std::thread::hardware_concurrency() > 1U ? std::thread::hardware_concurrency() : 1U;
+  std::printf("tree of %u nodes, %u hardware threads\n", TREE_SIZE, hw);
+
+  std::vector<std::pair<std::uint32_t, std::uint32_t> > records(TREE_SIZE);
+  std::vector<std::uint32_t> keys(TREE_SIZE), out(TREE_SIZE);
+  bool* found = new bool[TREE_SIZE];
+  bench::random rnd;
+  for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+    records[n] = std::pair<std::uint32_t, std::uint32_t>(static_cast<std::uint32_t>(rnd.next()), n);
+  }
+  // half of the keys are hits
+  for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+    keys[n] = rnd.next(2U) ? records[rnd.next(TREE_SIZE)].first : static_cast<std::uint32_t>(rnd.next());
+  }
+
+  tree_type* avl = new tree_type;
+  std::uint64_t start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+    avl->insert(records[n].first, records[n].second);
+  }
+  std::printf("%-12s            %8.1f ms\n", "insert", static_cast<double>(bench::now_ns() - start) / 1e6);
+
+  for (unsigned threads = 1U; threads <= hw; threads *= 2U) {
+    avl_array_thread_pool pool(threads);
+    start = bench::now_ns();
+    avl_array_bulk_load(*avl, records.begin(), records.end(), pool);
+    std::printf("%-12s %2u threads %8.1f ms\n", "bulk_load", threads, static_cast<double>(bench::now_ns() - start) / 1e6);
+  }
+
+  for (unsigned threads = 1U; threads <= hw; threads *= 2U) {
+    avl_array_thread_pool pool(threads);
+    start = bench::now_ns();
+    const std::size_t count = avl->find_batch(keys.data(), keys.size(), out.data(), found, pool);
+    std::printf("%-12s %2u threads %8.1f ms  (found %llu)\n", "find_batch", threads, static_cast<double>(bench::now_ns() - start) / 1e6, static_cast<unsigned long long>(count));
+  }
+
+  delete avl;
+  delete[] found;
+  return 0;
+}
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief huge page and NUMA placement benchmark
+// Compares find() on a 4M node tree whose arrays are mapped by
+// avl_array_alloc_placed with regular pages, transparent huge pages, 2MB
+// hugetlb pages and NUMA interleaving. Prints the placement which actually
+// happened (a missing hugetlb pool falls back to transparent huge pages), the
+// time and the data TLB misses per lookup. Linux only.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array_mmap.h"
+
+
+static const std::uint32_t TREE_SIZE = 4U * 1024U * 1024U;
+static const std::uint32_t LOOKUPS   = 4U * 1024U * 1024U;
+
+
+static const char* page_name(avl_array_placement::page_type page)
+{
+  switch (page) {
+    case avl_array_placement::PAGE_TRANSPARENT_HUGE : return "thp";
+    case avl_array_placement::PAGE_HUGE_2MB :         return "2MB";
+    case avl_array_placement::PAGE_HUGE_1GB :         return "1GB";
+    default :                                         return "4KB";
+  }
+}
+
+static const char* numa_name(avl_array_placement::numa_type numa)
+{
+  switch (numa) {
+    case avl_array_placement::NUMA_BIND :       return "bind";
+    case avl_array_placement::NUMA_INTERLEAVE : return "interleave";
+    default :                                   return "default";
+  }
+}
+
+
+// remembers the placement of the last mapped array
+template<avl_array_placement::page_type Page, avl_array_placement::numa_type Numa>
+struct report : avl_array_placement_fixed<Page, Numa>
+{
+  static avl_array_placement& actual()
+  {
+    static avl_array_placement placement;
+    return placement;
+  }
+
+  static void placed(const void* addr, std::size_t bytes, const avl_array_placement& placement)
+  {
+    (void)addr; (void)bytes;
+    actual() = placement;
+  }
+};
+
+
+template<typename Hook>
+static void run(const char* name)
+{
+  typedef avl_array<std::uint64_t, std::uint64_t, std::uint32_t, TREE_SIZE, true, avl_array_layout_soa, false, avl_array_alloc_placed<Hook> > tree_type;
+  tree_type* avl = new tree_type;
+  if (!avl->reserve(TREE_SIZE)) {
+    std::printf("%-12s mapping failed\n", name);
+    delete avl;
+    return;
+  }
+  for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+    avl->insert(n, n);
+  }
+
+  bench::random rnd;
+  std::vector<std::uint64_t> lookup(LOOKUPS);
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    lookup[n] = rnd.next(TREE_SIZE);
+  }
+
+  bench::perf_counter dtlb(bench::perf_counter::DTLB_READ_MISS);
+  std::uint64_t sum = 0U, val;
+
+  dtlb.start();
+  const std::uint64_t start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    if (avl->find(lookup[n], val)) {
+      sum += val;
+    }
+  }
+  const std::uint64_t stop = bench::now_ns();
+  dtlb.stop();
+
+  char dtlb_buf[16];
+  const avl_array_placement& actual = Hook::actual();
+  std::printf("%-12s %4s pages  %-10s  %8.1f ns/find  %10s dTLB miss/find  (checksum %llu)\n",
+              name,
+              page_name(actual.page),
+              numa_name(actual.numa),
+              static_cast<double>(stop - start) / LOOKUPS,
+              bench::per_op(dtlb_buf, sizeof(dtlb_buf), dtlb, LOOKUPS),
+              static_cast<unsigned long long>(sum));
+
+  delete avl;
+}
+
+
+int main()
+{
+  std::printf("find() on a tree of %u nodes, %u random lookups\n", TREE_SIZE, LOOKUPS);
+  run<report<avl_array_placement::PAGE_DEFAULT,          avl_array_placement::NUMA_DEFAULT> >("default");
+  run<report<avl_array_placement::PAGE_TRANSPARENT_HUGE, avl_array_placement::NUMA_DEFAULT> >("thp");
+  run<report<avl_array_placement::PAGE_HUGE_2MB,         avl_array_placement::NUMA_DEFAULT> >("hugetlb 2MB");
+  run<report<avl_array_placement::PAGE_TRANSPARENT_HUGE, avl_array_placement::NUMA_INTERLEAVE> >("interleave");
+  return 0;
+}
@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief read latency benchmark during batch updates
+// One writer thread applies batches of 10K updates to a 1M node tree while
+// reader threads call find() for one second and record the latency of every
+// call. Compares avl_array_rcu (readers never wait) with avl_array_seqlock
+// (readers retry while a batch is written) and reports the p50 / p99 / p99.9
+// and maximum find() latency. The number of readers is the number of hardware
+// threads minus one.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array_rcu.h"
+#include "../avl_array_seqlock.h"
+
+
+static const std::uint32_t TREE_SIZE = 1024U * 1024U;
+static const std::uint32_t BATCH     = 10000U;
+static const std::uint64_t RUN_NS    = 1000000000ULL;
+static const std::size_t   SAMPLES   = 4U * 1024U * 1024U;   // max recorded latencies per reader
+
+typedef avl_array_rcu<std::uint32_t, std::uint32_t, std::uint32_t, TREE_SIZE>     rcu_type;
+typedef avl_array_seqlock<std::uint32_t, std::uint32_t, std::uint32_t, TREE_SIZE> seqlock_type;
+
+
+// find() of both containers with the same signature
+struct rcu_reader
+{
+  rcu_type::reader reader_;
+  explicit rcu_reader(rcu_type& tree) : reader_(tree) { }
+  inline bool find(std::uint32_t key, std::uint32_t& val) { return reader_.find(key, val); }
+};
+
+struct seqlock_reader
+{
+  seqlock_type& tree_;
+  explicit seqlock_reader(seqlock_type& tree) : tree_(tree) { }
+  inline bool find(std::uint32_t key, std::uint32_t& val) { return tree_.find(key, val); }
+};
+
+
+template<typename Tree, typename Reader>
+static void run(const char* name, unsigned readers)
+{
+  Tree* tree = new Tree;
+  tree->write([](typename Tree::container_type& c) {
+    for (std::uint32_t k = 0U; k < TREE_SIZE; k += 2U) {
+      c.insert(k, k);
+    }
+  });
+
+  std::atomic<bool> stop(false);
+  std::vector<std::vector<std::uint32_t> > latency(readers);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0U; t < readers; ++t) {
+    threads.push_back(std::thread([tree, t, &stop, &latency]() {
+      Reader reader(*tree);
+      bench::random rnd(t + 1U);
+      std::vector<std::uint32_t>& samples = latency[t];
+      samples.reserve(SAMPLES);
+      std::uint32_t val;
+      while (!stop.load(std::memory_order_relaxed) && (samples.size() < SAMPLES)) {
+        const std::uint32_t key = static_cast<std::uint32_t>(rnd.next(TREE_SIZE));
+        const std::uint64_t start = bench::now_ns();
+        (void)reader.find(key, val);
+        samples.push_back(static_cast<std::uint32_t>(bench::now_ns() - start));
+      }
+    }));
+  }
+
+  // the writer toggles batches of odd keys
+  bench::random rnd(0x1234U);
+  std::uint64_t batches = 0U;
+  const std::uint64_t start = bench::now_ns();
+  while (bench::now_ns() - start < RUN_NS) {
+    const std::uint64_t seed = rnd.next();
+    tree->write([seed](typename Tree::container_type& c) {
+      bench::random keys(seed);
+      for (std::uint32_t i = 0U; i < BATCH; ++i) {
+        const std::uint32_t k = static_cast<std::uint32_t>(keys.next(TREE_SIZE / 2U)) * 2U + 1U;
+        if (!c.erase(k)) {
+          c.insert(k, k);
+        }
+      }
+    });
+    ++batches;
+  }
+  stop = true;
+  for (std::size_t t = 0U; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+
+  std::vector<std::uint32_t> all;
+  for (std::size_t t = 0U; t < latency.size(); ++t) {
+    all.insert(all.end(), latency[t].begin(), latency[t].end());
+  }
+  std::sort(all.begin(), all.end());
+  if (all.empty()) {
+    all.push_back(0U);
+  }
+  std::printf("%-8s %6llu batches  %9llu finds  p50 %7u ns  p99 %7u ns  p99.9 %9u ns  max %10u ns\n",
+              name,
+              static_cast<unsigned long long>(batches),
+              static_cast<unsigned long long>(all.size()),
+              all[all.size() / 2U],
+              all[all.size() * 99U / 100U],
+              all[all.size() * 999U / 1000U],
+              all.back());
+  delete tree;
+}
+
+
+int main()
+{
+  const unsigned hw = std::thread::hardware_concurrency();
+  const unsigned readers = hw > 1U ? hw - 1U : 1U;
+  std::printf("1 writer with batches of %u updates, %u readers, tree of %u nodes\n", BATCH, readers, TREE_SIZE);
+  run<rcu_type, rcu_reader>("rcu", readers);
+  run<seqlock_type, seqlock_reader>("seqlock", readers);
+  return 0;
+}
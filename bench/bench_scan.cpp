@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief full scan benchmark
+// Sums all values of a full 1M node tree, which was filled in random key order,
+// by iterating with operator++, by for_each_sorted() and by for_each_unordered().
+// Reports time and L1D / last level cache misses per element.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+
+#include "bench.h"
+#include "../avl_array.h"
+
+
+static const std::uint32_t TREE_SIZE = 1024U * 1024U;
+static const std::uint32_t ROUNDS    = 8U;
+
+typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, TREE_SIZE> tree_type;
+
+
+struct scan_iterator
+{
+  static std::uint64_t run(const tree_type& avl)
+  {
+    std::uint64_t sum = 0U;
+    for (tree_type::const_iterator it = avl.begin(); it != avl.end(); ++it) {
+      sum += *it;
+    }
+    return sum;
+  }
+};
+
+
+struct scan_sorted
+{
+  static std::uint64_t run(const tree_type& avl)
+  {
+    std::uint64_t sum = 0U;
+    avl.for_each_sorted([&sum](const std::uint32_t&, const std::uint64_t& val) { sum += val; });
+    return sum;
+  }
+};
+
+
+struct scan_unordered
+{
+  static std::uint64_t run(const tree_type& avl)
+  {
+    std::uint64_t sum = 0U;
+    avl.for_each_unordered([&sum](const std::uint32_t&, const std::uint64_t& val) { sum += val; });
+    return sum;
+  }
+};
+
+
+template<typename Scan>
+static void run(const char* name, const tree_type& avl)
+{
+  bench::perf_counter l1d(bench::perf_counter::L1D_READ_MISS);
+  bench::perf_counter llc(bench::perf_counter::LLC_MISS);
+  std::uint64_t sum = 0U;
+
+  l1d.start();
+  llc.start();
+  const std::uint64_t start = bench::now_ns();
+  for (std::uint32_t r = 0U; r < ROUNDS; ++r) {
+    sum += Scan::run(avl);
+  }
+  const std::uint64_t stop = bench::now_ns();
+  l1d.stop();
+  llc.stop();
+
+  const std::uint64_t elements = static_cast<std::uint64_t>(ROUNDS) * avl.size();
+  char l1d_buf[16], llc_buf[16];
+  std::printf("%-20s %6.2f ns/element  %10s L1D miss/element  %10s LLC miss/element  (checksum %llu)\n",
+              name,
+              static_cast<double>(stop - start) / static_cast<double>(elements),
+              bench::per_op(l1d_buf, sizeof(l1d_buf), l1d, elements),
+              bench::per_op(llc_buf, sizeof(llc_buf), llc, elements),
+              static_cast<unsigned long long>(sum));
+}
+
+
+int main()
+{
+  tree_type* avl = new tree_type;
+
+  // fill the tree completely with random unique keys, so key order and storage order differ
+  bench::random rnd;
+  while (avl->size() < TREE_SIZE) {
+    const std::uint32_t key = static_cast<std::uint32_t>(rnd.next());
+    avl->insert(key, key);
+  }
+
+  std::printf("full scan of a tree with %u nodes, %u rounds\n", TREE_SIZE, ROUNDS);
+  run<scan_iterator>("operator++", *avl);
+  run<scan_sorted>("for_each_sorted", *avl);
+  run<scan_unordered>("for_each_unordered", *avl);
+
+  delete avl;
+  return 0;
+}
@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief concurrent reader benchmark
+// One writer thread updates a 1M node tree in short bursts while reader threads
+// call find() for one second. Compares avl_array_seqlock (lock free readers) against an
+// avl_array guarded by a std::mutex and reports the total find() and update
+// throughput. The number of readers is the number of hardware threads minus one.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array_seqlock.h"
+
+
+static const std::uint32_t TREE_SIZE = 1024U * 1024U;
+static const std::uint64_t RUN_NS    = 1000000000ULL;
+
+
+// avl_array guarded by a mutex, same interface as avl_array_seqlock
+class mutex_tree
+{
+  avl_array<std::uint32_t, std::uint32_t, std::uint32_t, TREE_SIZE> avl_;
+  mutable std::mutex                                                mutex_;
+
+public:
+  inline bool find(std::uint32_t key, std::uint32_t& val) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return avl_.find(key, val);
+  }
+
+  inline bool insert(std::uint32_t key, std::uint32_t val)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return avl_.insert(key, val);
+  }
+
+  inline bool erase(std::uint32_t key)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return avl_.erase(key);
+  }
+};
+
+
+template<typename Tree>
+static void run(const char* name, unsigned readers)
+{
+  Tree* tree = new Tree;
+  for (std::uint32_t k = 0U; k < TREE_SIZE; k += 2U) {
+    tree->insert(k, k);
+  }
+
+  std::atomic<bool>          stop(false);
+  std::atomic<std::uint64_t> finds(0U), hits(0U);
+  std::vector<std::thread>   threads;
+  for (unsigned t = 0U; t < readers; ++t) {
+    threads.push_back(std::thread([tree, t, &stop, &finds, &hits]() {
+      bench::random rnd(t + 1U);
+      std::uint64_t n = 0U, found = 0U;
+      std::uint32_t val;
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (unsigned i = 0U; i < 256U; ++i, ++n) {
+          found += tree->find(static_cast<std::uint32_t>(rnd.next(TREE_SIZE)), val) ? 1U : 0U;
+        }
+      }
+      finds += n;
+      hits  += found;
+    }));
+  }
+
+  // the writer toggles the odd keys, in bursts of 16 updates every 100us (read mostly workload)
+  bench::random rnd(0x1234U);
+  std::uint64_t updates = 0U;
+  const std::uint64_t start = bench::now_ns();
+  while (bench::now_ns() - start < RUN_NS) {
+    for (unsigned i = 0U; i < 16U; ++i, ++updates) {
+      const std::uint32_t k = static_cast<std::uint32_t>(rnd.next(TREE_SIZE / 2U)) * 2U + 1U;
+      if (!tree->erase(k)) {
+        tree->insert(k, k);
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  stop = true;
+  for (std::size_t t = 0U; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+  const double sec = static_cast<double>(bench::now_ns() - start) / 1e9;
+
+  std::printf("%-8s %2u readers  %8.2f M find/s  %8.2f M update/s  (hits %llu)\n",
+              name, readers,
+              static_cast<double>(finds.load()) / sec / 1e6,
+              static_cast<double>(updates) / sec / 1e6,
+              static_cast<unsigned long long>(hits.load()));
+  delete tree;
+}
+
+
+int main()
+{
+  const unsigned hw = std::thread::hardware_concurrency();
+  const unsigned readers = hw > 1U ? hw - 1U : 1U;
+  std::printf("1 writer, %u readers, tree of %u nodes\n", readers, TREE_SIZE);
+  run<avl_array_seqlock<std::uint32_t, std::uint32_t, std::uint32_t, TREE_SIZE> >("seqlock", readers);
+  run<mutex_tree>("mutex", readers);
+  return 0;
+}
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief concurrent writer benchmark
+// 1, 2, 4 ... writer threads toggle random keys (erase if present, else insert)
+// of a half filled 1M key range for one second. Compares avl_array_sharded with
+// 16 shards against one avl_array guarded by a std::mutex and reports the total
+// update throughput for every number of writers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array_sharded.h"
+
+
+static const std::uint32_t KEY_RANGE = 1024U * 1024U;
+static const std::uint32_t SHARDS    = 16U;
+static const std::uint64_t RUN_NS    = 1000000000ULL;
+
+
+// avl_array guarded by one mutex, same interface as avl_array_sharded
+class mutex_tree
+{
+  avl_array<std::uint32_t, std::uint32_t, std::uint32_t, KEY_RANGE> avl_;
+  std::mutex                                                        mutex_;
+
+public:
+  inline bool insert(std::uint32_t key, std::uint32_t val)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return avl_.insert(key, val);
+  }
+
+  inline bool erase(std::uint32_t key)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return avl_.erase(key);
+  }
+};
+
+// every shard has room for twice its average share of the key range
+typedef avl_array_sharded<std::uint32_t, std::uint32_t, std::uint32_t, 2U * KEY_RANGE / SHARDS, SHARDS> sharded_tree;
+
+
+template<typename Tree>
+static void run(const char* name, unsigned writers)
+{
+  Tree* tree = new Tree;
+  for (std::uint32_t k = 0U; k < KEY_RANGE; k += 2U) {
+    tree->insert(k, k);
+  }
+
+  std::atomic<bool>          stop(false);
+  std::atomic<std::uint64_t> updates(0U);
+  std::vector<std::thread>   threads;
+  const std::uint64_t start = bench::now_ns();
+  for (unsigned t = 0U; t < writers; ++t) {
+    threads.push_back(std::thread([tree, t, &stop, &updates]() {
+      bench::random rnd(t + 1U);
+      std::uint64_t n = 0U;
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (unsigned i = 0U; i < 256U; ++i, ++n) {
+          const std::uint32_t k = static_cast<std::uint32_t>(rnd.next(KEY_RANGE));
+          if (!tree->erase(k)) {
+            tree->insert(k, k);
+          }
+        }
+      }
+      updates += n;
+    }));
+  }
+  while (bench::now_ns() - start < RUN_NS) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  stop = true;
+  for (std::size_t t = 0U; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+  const double sec = static_cast<double>(bench::now_ns() - start) / 1e9;
+
+  std::printf("%-8s %2u writers  %8.2f M update/s\n", name, writers, static_cast<double>(updates.load()) / sec / 1e6);
+  delete tree;
+}
+
+
+int main()
+{
+  const unsigned hw = std::thread::hardware_concurrency();
+  std::printf("key range %u, %u shards, %u hardware threads\n", KEY_RANGE, SHARDS, hw);
+  for (unsigned writers = 1U; writers <= (hw > 1U ? hw : 1U); writers *= 2U) {
+    run<mutex_tree>("mutex", writers);
+    run<sharded_tree>("sharded", writers);
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief snapshot benchmark
+// Compares find() of avl_array against find() and lower_bound() of an
+// avl_array_snapshot built from it, for trees smaller and larger than L2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array_snapshot.h"
+
+
+static const std::uint32_t LOOKUPS = 4U * 1024U * 1024U;
+
+
+template<std::uint32_t Size>
+static void run()
+{
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, Size> tree_type;
+  typedef avl_array_snapshot<std::uint32_t, std::uint64_t, std::uint32_t, Size> snapshot_type;
+  tree_type* avl = new tree_type;
+  snapshot_type* snap = new snapshot_type;
+
+  // fill the tree completely with random unique keys
+  bench::random rnd;
+  std::vector<std::uint32_t> keys;
+  keys.reserve(Size);
+  while (avl->size() < Size) {
+    const std::uint32_t key = static_cast<std::uint32_t>(rnd.next());
+    if (avl->find(key) == avl->end()) {
+      avl->insert(key, key);
+      keys.push_back(key);
+    }
+  }
+
+  std::uint64_t start = bench::now_ns();
+  snap->freeze(*avl);
+  const std::uint64_t freeze_ns = bench::now_ns() - start;
+
+  // random lookup sequence of existing keys
+  std::vector<std::uint32_t> lookup(LOOKUPS);
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    lookup[n] = keys[rnd.next(Size)];
+  }
+
+  std::uint64_t sum_avl = 0U, sum_snap = 0U, sum_lb = 0U, val;
+
+  start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    if (avl->find(lookup[n], val)) {
+      sum_avl += val;
+    }
+  }
+  const std::uint64_t avl_ns = bench::now_ns() - start;
+
+  start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    if (snap->find(lookup[n], val)) {
+      sum_snap += val;
+    }
+  }
+  const std::uint64_t snap_ns = bench::now_ns() - start;
+
+  start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < LOOKUPS; ++n) {
+    sum_lb += *snap->lower_bound(lookup[n]);
+  }
+  const std::uint64_t lb_ns = bench::now_ns() - start;
+
+  std::printf("%8u nodes  avl find %7.1f ns  snapshot find %7.1f ns  snapshot lower_bound %7.1f ns  freeze %6.1f ms  (checksum %s)\n",
+              Size,
+              static_cast<double>(avl_ns) / LOOKUPS,
+              static_cast<double>(snap_ns) / LOOKUPS,
+              static_cast<double>(lb_ns) / LOOKUPS,
+              static_cast<double>(freeze_ns) / 1e6,
+              (sum_avl == sum_snap) && (sum_snap == sum_lb) ? "ok" : "ERROR");
+
+  delete snap;
+  delete avl;
+}
+
+
+int main()
+{
+  std::printf("%u random lookups of existing keys\n", LOOKUPS);
+  run<16U * 1024U>();
+  run<256U * 1024U>();
+  run<1024U * 1024U>();
+  run<4U * 1024U * 1024U>();
+  return 0;
+}
@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief statistics benchmark
+// Builds trees of 1M keys from different key distributions with the counting
+// statistics policy and prints the rotations by type, the rebalance path
+// lengths, the erase relocations and the find() depth histogram. Then compares
+// the find() time of the counting policy with the default policy (no counting).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.h"
+#include "../avl_array.h"
+
+
+static const std::uint32_t TREE_SIZE = 1024U * 1024U;
+
+typedef avl_array<std::uint32_t, std::uint32_t, std::uint32_t, TREE_SIZE, true, avl_array_layout_soa, false, avl_array_alloc_static, false, avl_array_stats_counting> counting_type;
+typedef avl_array<std::uint32_t, std::uint32_t, std::uint32_t, TREE_SIZE> plain_type;
+
+
+// key of the n-th insert
+static std::uint32_t make_key(int distribution, std::uint32_t n, bench::random& rnd)
+{
+  switch (distribution) {
+    case 0  : return n;                                                                       // ascending
+    case 1  : return static_cast<std::uint32_t>(rnd.next());                                  // uniform
+    default : return (n & ~1023U) * 16U + static_cast<std::uint32_t>(rnd.next() % 16384U);   // clusters of 1K keys
+  }
+}
+
+
+static void print_histogram(const char* name, const avl_array_stats_counting::histogram& h)
+{
+  std::printf("  %-12s mean %5.2f  p50 %2u  p99 %2u  max %2u  |", name, h.mean(),
+              static_cast<unsigned>(h.percentile(0.5)), static_cast<unsigned>(h.percentile(0.99)), static_cast<unsigned>(h.percentile(1.0)));
+  h.for_each_bucket([&h](std::size_t length, std::uint64_t samples) {
+    const double share = 100.0 * static_cast<double>(samples) / static_cast<double>(h.count);
+    if (share >= 0.1) {
+      std::printf(" %u:%.1f%%", static_cast<unsigned>(length), share);
+    }
+  });
+  std::printf("\n");
+}
+
+
+template<typename Tree>
+static double find_ms(const Tree& avl)
+{
+  bench::random rnd(3U);
+  std::uint32_t val, hits = 0U;
+  const std::uint64_t start = bench::now_ns();
+  for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+    hits += avl.find(static_cast<std::uint32_t>(rnd.next() % TREE_SIZE), val) ? 1U : 0U;
+  }
+  const double ms = static_cast<double>(bench::now_ns() - start) / 1e6;
+  return hits ? ms : -ms;
+}
+
+
+int main()
+{
+  static const char* NAMES[] = { "ascending", "uniform", "clustered" };
+  counting_type* avl = new counting_type;
+
+  for (int distribution = 0; distribution < 3; ++distribution) {
+    avl->clear();
+    avl->stats().reset();
+    bench::random rnd;
+    for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+      avl->insert(make_key(distribution, n, rnd), n);
+    }
+    // erase a quarter and look up all inserted keys
+    bench::random replay;
+    for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+      const std::uint32_t key = make_key(distribution, n, replay);
+      std::uint32_t val;
+      if ((n & 3U) == 0U) {
+        avl->erase(key);
+      }
+      else {
+        avl->find(key, val);
+      }
+    }
+
+    const avl_array_stats_counting& s = avl->stats();
+    std::printf("%s keys, %u elements\n", NAMES[distribution], avl->size());
+    std::printf("  rotations    L %llu  R %llu  LR %llu  RL %llu  (%.3f per insert)\n",
+                static_cast<unsigned long long>(s.left_rotations), static_cast<unsigned long long>(s.right_rotations),
+                static_cast<unsigned long long>(s.left_right_rotations), static_cast<unsigned long long>(s.right_left_rotations),
+                static_cast<double>(s.rotations()) / static_cast<double>(s.insert_path.count + 1U));
+    std::printf("  comparisons  %llu  relocations %llu\n", static_cast<unsigned long long>(s.comparisons), static_cast<unsigned long long>(s.relocations));
+    print_histogram("find depth", s.find_depth);
+    print_histogram("insert path", s.insert_path);
+    print_histogram("erase path", s.erase_path);
+  }
+
+  // overhead of counting
+  plain_type* plain = new plain_type;
+  avl->clear();
+  bench::random rnd;
+  for (std::uint32_t n = 0U; n < TREE_SIZE; ++n) {
+    const std::uint32_t key = static_cast<std::uint32_t>(rnd.next() % TREE_SIZE);
+    avl->insert(key, n);
+    plain->insert(key, n);
+  }
+  std::printf("find, 1M random keys: no statistics %.1f ms, counting %.1f ms\n", find_ms(*plain), find_ms(*avl));
+
+  delete plain;
+  delete avl;
+  return 0;
+}
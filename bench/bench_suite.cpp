@@ -0,0 +1,377 @@
+///////////////////////////////////////////////////////////////////////////////
+// \author (c) Marco Paland (info@paland.com)
+//             2017-2020, paland consult, Hannover, Germany
+//
+// \license The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// \brief benchmark suite
+// Measures insert, find (hit and miss) and erase of avl_array across Size,
+// size_type width, Fast mode, static or dynamic allocation, key type and key
+// distribution, compared with std::map and a sorted std::vector. Every row
+// reports time per operation, operations per second, L1D / last level cache
+// misses per operation (if perf counters are available) and the memory
+// footprint of the filled container.
+//
+// usage: bench_suite [filter]
+// Only benchmarks whose name contains filter are run,
+// e.g. 'bench_suite find_hit/' or 'bench_suite /zipf/'.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+#include "../avl_array.h"
+
+
+static const std::size_t LOOKUPS = 1024U * 1024U;
+
+
+// key streams
+enum distribution_type {
+  SEQUENTIAL,   // ascending insert, erase and lookup order
+  UNIFORM,      // random insert and erase order, uniform random lookups
+  ZIPF          // random insert and erase order, Zipfian distributed lookups
+};
+
+static const char* const distribution_name[] = { "sequential", "uniform", "zipf" };
+
+
+// bijective mix functions, i < n gives n unique keys, mix(i + n) keys are missing keys
+static inline void make_key(std::uint32_t& key, std::uint64_t i)
+{
+  std::uint32_t x = static_cast<std::uint32_t>(i) * 0x9E3779B1U;
+  key = x ^ (x >> 16U);
+}
+
+static inline void make_key(std::uint64_t& key, std::uint64_t i)
+{
+  std::uint64_t x = i * 0x9E3779B97F4A7C15ULL;
+  x ^= x >> 31U;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  key = x ^ (x >> 29U);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// container adapters
+
+template<typename Key, typename size_type, size_type Size, bool Fast, bool Dynamic = false>
+class avl_adapter
+{
+  typedef typename std::conditional<Dynamic, avl_array_alloc_dynamic, avl_array_alloc_static>::type alloc_type;
+  typedef avl_array<Key, std::uint64_t, size_type, Size, Fast, avl_array_layout_soa, false, alloc_type> container_type;
+  container_type* c_;
+
+  // bytes per node of the soa layout
+  static const std::size_t NODE_BYTES = sizeof(Key) + sizeof(std::uint64_t) + 1U + (Fast ? 3U : 2U) * sizeof(size_type);
+
+public:
+  avl_adapter() : c_(new container_type) { }
+  ~avl_adapter() { delete c_; }
+
+  inline bool insert(const Key& key, std::uint64_t val)  { return c_->insert(key, val); }
+  inline bool find(const Key& key, std::uint64_t& val)   { return c_->find(key, val); }
+  inline bool erase(const Key& key)                      { return c_->erase(key); }
+  inline std::size_t footprint() const                   { return sizeof(container_type) + (Dynamic ? c_->capacity() * NODE_BYTES : 0U); }
+
+  static void name(char* buf, std::size_t size)
+  {
+    std::snprintf(buf, size, "avl_array<u%u,u%u,%s%s>", static_cast<unsigned>(8U * sizeof(Key)), static_cast<unsigned>(8U * sizeof(size_type)), Fast ? "fast" : "slow", Dynamic ? ",dynamic" : "");
+  }
+};
+
+
+template<typename Key>
+class map_adapter
+{
+  typedef std::map<Key, std::uint64_t, std::less<Key>, bench::counting_allocator<std::pair<const Key, std::uint64_t> > > container_type;
+  container_type c_;
+
+public:
+  inline bool insert(const Key& key, std::uint64_t val)  { c_[key] = val; return true; }
+  inline bool erase(const Key& key)                      { return c_.erase(key) != 0U; }
+  inline std::size_t footprint() const                   { return sizeof(container_type) + bench::allocated_bytes(); }
+
+  inline bool find(const Key& key, std::uint64_t& val)
+  {
+    const typename container_type::const_iterator it = c_.find(key);
+    if (it == c_.end()) {
+      return false;
+    }
+    val = it->second;
+    return true;
+  }
+
+  static void name(char* buf, std::size_t size)
+  {
+    std::snprintf(buf, size, "std::map<u%u>", static_cast<unsigned>(8U * sizeof(Key)));
+  }
+};
+
+
+template<typename Key>
+class vector_adapter
+{
+  typedef std::pair<Key, std::uint64_t> value_type;
+  typedef std::vector<value_type, bench::counting_allocator<value_type> > container_type;
+  container_type c_;
+
+  static inline bool less(const value_type& lhs, const Key& rhs)
+  { return lhs.first < rhs; }
+
+public:
+  inline bool insert(const Key& key, std::uint64_t val)
+  {
+    const typename container_type::iterator it = std::lower_bound(c_.begin(), c_.end(), key, less);
+    if ((it != c_.end()) && (it->first == key)) {
+      it->second = val;
+    }
+    else {
+      c_.insert(it, value_type(key, val));
+    }
+    return true;
+  }
+
+  inline bool find(const Key& key, std::uint64_t& val)
+  {
+    const typename container_type::const_iterator it = std::lower_bound(c_.begin(), c_.end(), key, less);
+    if ((it == c_.end()) || !(it->first == key)) {
+      return false;
+    }
+    val = it->second;
+    return true;
+  }
+
+  inline bool erase(const Key& key)
+  {
+    const typename container_type::iterator it = std::lower_bound(c_.begin(), c_.end(), key, less);
+    if ((it == c_.end()) || !(it->first == key)) {
+      return false;
+    }
+    c_.erase(it);
+    return true;
+  }
+
+  inline std::size_t footprint() const
+  { return sizeof(container_type) + bench::allocated_bytes(); }
+
+  static void name(char* buf, std::size_t size)
+  {
+    std::snprintf(buf, size, "sorted std::vector<u%u>", static_cast<unsigned>(8U * sizeof(Key)));
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// measurement
+
+static const char* const op_name[] = { "insert", "find_hit", "find_miss", "erase" };
+
+
+// benchmark name is op/container/distribution/n
+static bool match(char* name, std::size_t size, const char* filter, const char* op, const char* container, distribution_type dist, std::size_t n)
+{
+  std::snprintf(name, size, "%s/%s/%s/%u", op, container, distribution_name[dist], static_cast<unsigned>(n));
+  return !filter || std::strstr(name, filter);
+}
+
+
+class measurement
+{
+  bench::perf_counter l1d_;
+  bench::perf_counter llc_;
+  std::uint64_t       start_;
+  const char*         filter_;
+
+public:
+  explicit measurement(const char* filter)
+    : l1d_(bench::perf_counter::L1D_READ_MISS)
+    , llc_(bench::perf_counter::LLC_MISS)
+    , start_(0U)
+    , filter_(filter)
+  { }
+
+  inline void start()
+  {
+    l1d_.start();
+    llc_.start();
+    start_ = bench::now_ns();
+  }
+
+  // stop and print one result row, if it matches the filter
+  void stop(const char* op, const char* container, distribution_type dist, std::size_t n, std::size_t ops, std::size_t footprint, bool ok)
+  {
+    const std::uint64_t ns = bench::now_ns() - start_;
+    l1d_.stop();
+    llc_.stop();
+
+    char name[96], l1d_buf[16], llc_buf[16];
+    if (!match(name, sizeof(name), filter_, op, container, dist, n)) {
+      return;
+    }
+    const double ns_op = static_cast<double>(ns) / static_cast<double>(ops);
+    std::printf("%-58s %9.1f %10.2fM %11s %11s %9.1f KB%s\n",
+                name,
+                ns_op,
+                1000.0 / ns_op,
+                bench::per_op(l1d_buf, sizeof(l1d_buf), l1d_, ops),
+                bench::per_op(llc_buf, sizeof(llc_buf), llc_, ops),
+                static_cast<double>(footprint) / 1024.0,
+                ok ? "" : "  ERROR");
+  }
+};
+
+
+// runs insert, find hit, find miss and erase of n elements for one container and distribution
+template<typename Adapter, typename Key>
+static void run(std::size_t n, distribution_type dist, const char* filter)
+{
+  char container[48], name[96];
+  Adapter::name(container, sizeof(container));
+  bool any = false;
+  for (std::size_t op = 0U; op < sizeof(op_name) / sizeof(op_name[0]); ++op) {
+    any = match(name, sizeof(name), filter, op_name[op], container, dist, n) || any;
+  }
+  if (!any) {
+    return;
+  }
+
+  // keys in insert order, the sequential stream is 0, 2, 4, ... so missing keys are the odd ones
+  bench::random rnd;
+  std::vector<Key> keys(n), lookup_hit(LOOKUPS), lookup_miss(LOOKUPS);
+  for (std::size_t i = 0U; i < n; ++i) {
+    if (dist == SEQUENTIAL) {
+      keys[i] = static_cast<Key>(2U * i);
+    }
+    else {
+      make_key(keys[i], i);
+    }
+  }
+  bench::zipf zipf(dist == ZIPF ? n : 1U);
+  for (std::size_t i = 0U; i < LOOKUPS; ++i) {
+    const std::size_t k = (dist == SEQUENTIAL) ? i % n : (dist == UNIFORM) ? static_cast<std::size_t>(rnd.next(n)) : zipf.next(rnd);
+    lookup_hit[i] = keys[k];
+    if (dist == SEQUENTIAL) {
+      lookup_miss[i] = static_cast<Key>(2U * k + 1U);
+    }
+    else {
+      make_key(lookup_miss[i], n + k);
+    }
+  }
+
+  bench::allocated_bytes() = 0U;
+  Adapter* c = new Adapter;
+  measurement m(filter);
+  bool ok = true;
+
+  m.start();
+  for (std::size_t i = 0U; i < n; ++i) {
+    ok = c->insert(keys[i], i) && ok;
+  }
+  m.stop("insert", container, dist, n, n, c->footprint(), ok);
+
+  std::uint64_t val, sum = 0U;
+  std::size_t found = 0U;
+  m.start();
+  for (std::size_t i = 0U; i < LOOKUPS; ++i) {
+    if (c->find(lookup_hit[i], val)) {
+      sum += val;
+      found++;
+    }
+  }
+  m.stop("find_hit", container, dist, n, LOOKUPS, c->footprint(), (found == LOOKUPS) && sum);
+
+  found = 0U;
+  m.start();
+  for (std::size_t i = 0U; i < LOOKUPS; ++i) {
+    found += c->find(lookup_miss[i], val) ? 1U : 0U;
+  }
+  m.stop("find_miss", container, dist, n, LOOKUPS, c->footprint(), found == 0U);
+
+  // erase in a different random order than insert
+  if (dist != SEQUENTIAL) {
+    for (std::size_t i = n - 1U; i > 0U; --i) {
+      std::swap(keys[i], keys[static_cast<std::size_t>(rnd.next(i + 1U))]);
+    }
+  }
+  const std::size_t footprint = c->footprint();
+  ok = true;
+  m.start();
+  for (std::size_t i = 0U; i < n; ++i) {
+    ok = c->erase(keys[i]) && ok;
+  }
+  m.stop("erase", container, dist, n, n, footprint, ok);
+
+  delete c;
+}
+
+
+// 16 bit size_type, only if N fits
+template<std::uint32_t N>
+static void run_narrow(distribution_type dist, const char* filter, std::true_type)
+{
+  run<avl_adapter<std::uint32_t, std::uint16_t, N, true>,  std::uint32_t>(N, dist, filter);
+  run<avl_adapter<std::uint32_t, std::uint16_t, N, false>, std::uint32_t>(N, dist, filter);
+}
+
+template<std::uint32_t N>
+static void run_narrow(distribution_type, const char*, std::false_type)
+{ }
+
+
+template<std::uint32_t N>
+static void run_size(const char* filter)
+{
+  for (int d = SEQUENTIAL; d <= ZIPF; ++d) {
+    const distribution_type dist = static_cast<distribution_type>(d);
+    run_narrow<N>(dist, filter, std::integral_constant<bool, (N < 65535U)>());
+    run<avl_adapter<std::uint32_t, std::uint32_t, N, true>,  std::uint32_t>(N, dist, filter);
+    run<avl_adapter<std::uint32_t, std::uint32_t, N, false>, std::uint32_t>(N, dist, filter);
+    run<avl_adapter<std::uint32_t, std::uint32_t, N, true, true>, std::uint32_t>(N, dist, filter);
+    run<avl_adapter<std::uint64_t, std::uint32_t, N, true>,  std::uint64_t>(N, dist, filter);
+    run<map_adapter<std::uint32_t>, std::uint32_t>(N, dist, filter);
+    run<map_adapter<std::uint64_t>, std::uint64_t>(N, dist, filter);
+    // random insert into a sorted vector is O(n), too slow for big containers
+    if (N <= 65536U) {
+      run<vector_adapter<std::uint32_t>, std::uint32_t>(N, dist, filter);
+    }
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  const char* filter = (argc > 1) ? argv[1] : nullptr;
+
+  std::printf("%-58s %9s %11s %11s %11s %12s\n", "benchmark", "ns/op", "ops/s", "L1D miss/op", "LLC miss/op", "footprint");
+  std::printf("%-58s %9s %11s %11s %11s %12s\n", "---------", "-----", "-----", "-----------", "-----------", "---------");
+  run_size<1024U>(filter);
+  run_size<32768U>(filter);
+  run_size<1024U * 1024U>(filter);
+  return 0;
+}
@@ -30,8 +30,32 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "../avl_array.h"
+#include "../avl_array_parallel.h"
+#include "../avl_array_rcu.h"
+#include "../avl_array_seqlock.h"
+#include "../avl_array_sharded.h"
+#include "../avl_array_snapshot.h"
+#if defined(__unix__)
+#include <csignal>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "../avl_array_image.h"
+#include "../avl_array_journal.h"
+#include "../avl_array_mmap.h"
+#endif
 
 
 
@@ -88,6 +112,58 @@ TEST_CASE("Reverse insert", "[insert]" ) {
 }
 
 
+TEST_CASE("Assign sorted", "[insert]" ) {
+  avl_array<int, int, std::uint16_t, 1024> avl;
+  avl_array<int, int, std::uint16_t, 1024, false, avl_array_layout_blocked, true> avl_slow;
+  std::vector<std::pair<int, int> > v;
+  for (int size = 0; size <= 1024; size += (size < 70) ? 1 : 51) {
+    v.clear();
+    for (int n = 0; n < size; n++) {
+      v.push_back(std::pair<int, int>(3 * n, n));
+    }
+    avl.insert(-1, -1);   // former content is discarded
+    REQUIRE(avl.assign_sorted(v.begin(), v.end()));
+    REQUIRE(avl_slow.assign_sorted(v.begin(), v.end()));
+    REQUIRE(avl.size() == size);
+    REQUIRE(avl_slow.size() == size);
+    REQUIRE(avl.check());
+    REQUIRE(avl_slow.check());
+
+    int x = 0;
+    for (auto it = avl.begin(); it != avl.end(); ++it, ++x) {
+      REQUIRE(it.key() == 3 * x);
+      REQUIRE(*it == x);
+    }
+    REQUIRE(x == size);
+    x = 0;
+    for (auto it = avl_slow.begin(); it != avl_slow.end(); ++it, ++x) {
+      REQUIRE(*it == x);
+      REQUIRE(avl_slow.select(static_cast<std::uint16_t>(x)) == it);
+    }
+    REQUIRE(x == size);
+
+    // the tree is a regular AVL tree afterwards
+    for (int n = 0; n < size; n += 2) {
+      REQUIRE(avl.erase(3 * n));
+      REQUIRE(avl.check());
+    }
+    for (int n = 0; n < size && avl.size() < avl.max_size(); n++) {
+      REQUIRE(avl.insert(3 * n + 1, n));
+      REQUIRE(avl.check());
+    }
+  }
+
+  // too many elements
+  v.clear();
+  for (int n = 0; n < 1025; n++) {
+    v.push_back(std::pair<int, int>(n, n));
+  }
+  REQUIRE(!avl.assign_sorted(v.begin(), v.end()));
+  REQUIRE(avl.empty());
+  REQUIRE(avl.check());
+}
+
+
 TEST_CASE("Equal insert", "[insert]" ) {
   avl_array<int, int, int, 1024> avl;
   for (int n = 0; n < 10; n++) {
@@ -98,6 +174,942 @@ TEST_CASE("Equal insert", "[insert]" ) {
 }
 
 
+// value type which counts its copies
+struct copy_counter {
+  static int copies;
+  std::string data;
+  copy_counter() { }
+  explicit copy_counter(const std::string& d) : data(d) { }
+  copy_counter(const std::string& d, std::size_t n) : data(d + std::string(n, '!')) { }
+  copy_counter(const copy_counter& other) : data(other.data) { copies++; }
+  copy_counter(copy_counter&& other) : data(std::move(other.data)) { }
+  copy_counter& operator=(const copy_counter& other) { data = other.data; copies++; return *this; }
+  copy_counter& operator=(copy_counter&& other) { data = std::move(other.data); return *this; }
+};
+int copy_counter::copies = 0;
+
+
+TEST_CASE("Move insert", "[insert]" ) {
+  avl_array<std::string, copy_counter, int, 256> avl;
+  copy_counter::copies = 0;
+  for (int n = 0; n < 256; n++) {
+    std::string key = std::to_string((n * 37) % 256);
+    copy_counter val(std::string(100, 'x') + key);
+    REQUIRE(avl.insert(std::move(key), std::move(val)));
+  }
+  REQUIRE(avl.size() == 256);
+  REQUIRE(avl.check());
+  REQUIRE(!avl.insert(std::string("full"), copy_counter("full")));
+
+  // update
+  REQUIRE(avl.insert(std::string("7"), copy_counter("seven")));
+  REQUIRE(avl.find("7").val().data == "seven");
+
+  // erase relocates the last node by moving
+  for (int n = 0; n < 256; n += 2) {
+    REQUIRE(avl.erase(std::to_string(n)));
+    REQUIRE(avl.check());
+  }
+  REQUIRE(copy_counter::copies == 0);
+  for (int n = 1; n < 256; n += 2) {
+    REQUIRE(avl.find(std::to_string(n)).val().data == (n == 7 ? "seven" : std::string(100, 'x') + std::to_string(n)));
+  }
+
+  // copy insert still copies
+  const copy_counter val("copy");
+  REQUIRE(avl.insert("copy", val));
+  REQUIRE(copy_counter::copies == 1);
+}
+
+
+TEST_CASE("Emplace", "[insert]" ) {
+  avl_array<std::string, copy_counter, int, 4> avl;
+  copy_counter::copies = 0;
+
+  auto res = avl.emplace("a", "value a", 3U);
+  REQUIRE(res.second);
+  REQUIRE(res.first.key() == "a");
+  REQUIRE(res.first.val().data == "value a!!!");
+
+  // existing key is not updated
+  res = avl.emplace("a", "other");
+  REQUIRE(!res.second);
+  REQUIRE(res.first.val().data == "value a!!!");
+
+  res = avl.try_emplace(std::string("b"), "value b");
+  REQUIRE(res.second);
+  REQUIRE(avl.find("b") == res.first);
+  res = avl.try_emplace("b", "other");
+  REQUIRE(!res.second);
+  REQUIRE(res.first.val().data == "value b");
+
+  REQUIRE(avl.try_emplace("c").second);
+  REQUIRE(avl.find("c").val().data.empty());
+  REQUIRE(avl.emplace("d", "value d").second);
+  REQUIRE(avl.size() == 4);
+
+  // full
+  res = avl.try_emplace("e", "value e");
+  REQUIRE(!res.second);
+  REQUIRE(res.first == avl.end());
+  REQUIRE(avl.check());
+  REQUIRE(copy_counter::copies == 0);
+}
+
+
+// value type without default ctor which counts its living instances
+struct instance_counter {
+  static int instances;
+  int value;
+  explicit instance_counter(int v) : value(v) { instances++; }
+  instance_counter(const instance_counter& other) : value(other.value) { instances++; }
+  instance_counter& operator=(const instance_counter& other) { value = other.value; return *this; }
+  ~instance_counter() { instances--; }
+};
+int instance_counter::instances = 0;
+
+
+TEST_CASE("Element lifetime", "[insert]" ) {
+  instance_counter::instances = 0;
+  {
+    avl_array<int, instance_counter, int, 1024> avl;
+    REQUIRE(instance_counter::instances == 0);
+    for (int n = 0; n < 1000; n++) {
+      REQUIRE(avl.emplace(n, n).second);
+    }
+    REQUIRE(instance_counter::instances == 1000);
+    REQUIRE(avl.insert(5, instance_counter(50)));
+    REQUIRE(instance_counter::instances == 1000);
+    REQUIRE(avl.find(5).val().value == 50);
+
+    for (int n = 0; n < 1000; n += 2) {
+      REQUIRE(avl.erase(n));
+    }
+    REQUIRE(instance_counter::instances == 500);
+    REQUIRE(avl.check());
+
+    // copy and move
+    avl_array<int, instance_counter, int, 1024> copy(avl);
+    REQUIRE(instance_counter::instances == 1000);
+    REQUIRE(copy.check());
+    REQUIRE(copy.size() == 500);
+    avl_array<int, instance_counter, int, 1024> moved(std::move(copy));
+    REQUIRE(moved.check());
+    for (int n = 1; n < 1000; n += 2) {
+      REQUIRE(moved.find(n).val().value == (n == 5 ? 50 : n));
+    }
+    copy = moved;
+    REQUIRE(instance_counter::instances == 1500);
+    moved.clear();
+    REQUIRE(instance_counter::instances == 1000);
+    moved = std::move(copy);
+    REQUIRE(moved.size() == 500);
+    REQUIRE(instance_counter::instances == 1500);
+
+    std::vector<std::pair<int, instance_counter> > sorted;
+    for (int n = 0; n < 100; n++) {
+      sorted.push_back(std::pair<int, instance_counter>(n, instance_counter(n)));
+    }
+    const int before = instance_counter::instances;
+    REQUIRE(avl.assign_sorted(sorted.begin(), sorted.end()));
+    REQUIRE(instance_counter::instances == before - 500 + 100);
+  }
+  REQUIRE(instance_counter::instances == 0);
+}
+
+
+TEST_CASE("Dynamic allocation", "[alloc]" ) {
+  avl_array<int, std::string, std::uint32_t, 1024U * 1024U, true, avl_array_layout_soa, false, avl_array_alloc_dynamic> avl;
+  REQUIRE(avl.capacity() == 0U);
+  REQUIRE(avl.max_size() == 1024U * 1024U);
+  REQUIRE(avl.find(1) == avl.end());
+
+  // geometric growth keeps the elements
+  for (int n = 0; n < 1000; n++) {
+    REQUIRE(avl.insert((n * 7919) % 1000, std::to_string(n) + std::string(20, 'x')));
+    REQUIRE(avl.capacity() >= avl.size());
+  }
+  REQUIRE(avl.capacity() == 1024U);
+  REQUIRE(avl.check());
+  for (int n = 0; n < 1000; n++) {
+    REQUIRE(avl.find((n * 7919) % 1000).val() == std::to_string(n) + std::string(20, 'x'));
+  }
+
+  REQUIRE(avl.reserve(5000U));
+  REQUIRE(avl.capacity() == 5000U);
+  REQUIRE(avl.reserve(100U));
+  REQUIRE(avl.capacity() == 5000U);
+  REQUIRE(!avl.reserve(1024U * 1024U + 1U));
+
+  for (int n = 0; n < 1000; n += 2) {
+    REQUIRE(avl.erase(n));
+  }
+  avl.shrink_to_fit();
+  REQUIRE(avl.capacity() == 500U);
+  REQUIRE(avl.check());
+  for (int n = 1; n < 1000; n += 2) {
+    REQUIRE(avl.find(n) != avl.end());
+  }
+  REQUIRE(avl.insert(0, "zero"));
+  REQUIRE(avl.capacity() == 1000U);
+
+  // copy allocates its own arrays
+  avl_array<int, std::string, std::uint32_t, 1024U * 1024U, true, avl_array_layout_soa, false, avl_array_alloc_dynamic> copy(avl);
+  REQUIRE(copy.capacity() == avl.size());
+  REQUIRE(copy.check());
+  avl.clear();
+  avl.shrink_to_fit();
+  REQUIRE(avl.capacity() == 0U);
+  REQUIRE(copy.find(0).val() == "zero");
+}
+
+
+TEST_CASE("Dynamic allocation - blocked layout, slow mode, ranked", "[alloc]" ) {
+  avl_array<int, int, std::uint16_t, 1000, false, avl_array_layout_blocked, true, avl_array_alloc_dynamic> avl;
+  for (int n = 0; n < 1000; n++) {
+    REQUIRE(avl.insert(n, n));
+  }
+  REQUIRE(avl.capacity() == 1000U);
+  REQUIRE(!avl.insert(1000, 1000));
+  REQUIRE(avl.check());
+
+  srand(0U);
+  for (int n = 0; n < 5000; n++) {
+    const int key = rand() % 2000;
+    if (rand() & 1) {
+      avl.erase(key);
+    }
+    else if (avl.size() < avl.max_size()) {
+      REQUIRE(avl.insert(key, key));
+    }
+    if (!(n % 500)) {
+      avl.shrink_to_fit();
+      REQUIRE(avl.capacity() == avl.size());
+    }
+  }
+  REQUIRE(avl.check());
+  int x = 0;
+  for (auto it = avl.begin(); it != avl.end(); ++it, ++x) {
+    REQUIRE(*avl.select(static_cast<std::uint16_t>(x)) == it.key());
+  }
+}
+
+
+TEST_CASE("Blocked layout, record alignment", "[alloc]" ) {
+  // a 16 byte key and two 16 bit links are padded to a 32 byte record, so no record spans two cache lines
+  struct wide_key {
+    std::uint32_t data[4];
+    bool operator<(const wide_key& other) const  { return data[0] < other.data[0]; }
+    bool operator==(const wide_key& other) const { return data[0] == other.data[0]; }
+  };
+  typedef avl_array<wide_key, int, std::uint16_t, 1024, true, avl_array_layout_blocked> static_type;
+  typedef avl_array<wide_key, int, std::uint16_t, 1024, true, avl_array_layout_blocked, false, avl_array_alloc_dynamic> dynamic_type;
+  REQUIRE(alignof(static_type) == 32U);
+  static_type* avl = new static_type;
+  dynamic_type* dyn = new dynamic_type;
+  for (std::uint32_t n = 0U; n < 100U; n++) {
+    const wide_key key = { { (n * 37U) % 100U, n, n, n } };
+    REQUIRE(avl->insert(key, static_cast<int>(n)));
+    REQUIRE(dyn->insert(key, static_cast<int>(n)));
+  }
+  REQUIRE(avl->check());
+  REQUIRE(dyn->check());
+  for (auto it = avl->begin(); it != avl->end(); ++it) {
+    REQUIRE(!(reinterpret_cast<std::uintptr_t>(&it.key()) % 32U));
+  }
+  for (auto it = dyn->begin(); it != dyn->end(); ++it) {
+    REQUIRE(!(reinterpret_cast<std::uintptr_t>(&it.key()) % 32U));
+    if (!it.key().data[1]) {
+      REQUIRE(!(reinterpret_cast<std::uintptr_t>(&it.key()) % 64U));   // the first record starts the heap array
+    }
+  }
+  delete avl;
+  delete dyn;
+}
+
+
+#if defined(__unix__)
+TEST_CASE("Mmap allocation", "[alloc]" ) {
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 1024U * 1024U, true, avl_array_layout_soa, false, avl_array_alloc_mmap<> > mmap_type;
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 65536U, false, avl_array_layout_blocked, true, avl_array_alloc_mmap<avl_array_placement_transparent> > mmap_blocked_type;
+  mmap_type avl;
+  mmap_blocked_type avl2;
+  REQUIRE(avl.max_size() == 1024U * 1024U);
+  REQUIRE(avl2.max_size() == 65536U);
+
+  for (std::uint32_t n = 0U; n < 65536U; n++) {
+    const std::uint32_t key = (n * 2654435761U) & 0xFFFFU;
+    REQUIRE(avl.insert(key, key + 1U));
+    REQUIRE(avl2.insert(key, key + 1U));
+  }
+  REQUIRE(!avl2.insert(70000U, 0U));
+
+  // erase most elements and give the memory back
+  for (std::uint32_t n = 0U; n < 65536U; n++) {
+    if (n % 16U) {
+      REQUIRE(avl.erase(n));
+      REQUIRE(avl2.erase(n));
+    }
+  }
+  avl.shrink_to_fit();
+  avl2.shrink_to_fit();
+  REQUIRE(avl.size() == 4096U);
+  REQUIRE(avl.check());
+  REQUIRE(avl2.check());
+  for (std::uint32_t n = 0U; n < 65536U; n += 16U) {
+    std::uint64_t val;
+    REQUIRE(avl.find(n, val));
+    REQUIRE(val == n + 1U);
+    REQUIRE(*avl2.select(n / 16U) == n + 1U);
+  }
+
+  // released memory is usable again
+  for (std::uint32_t n = 1U; n < 65536U; n += 16U) {
+    REQUIRE(avl.insert(n, n));
+    REQUIRE(avl2.insert(n, n));
+  }
+  REQUIRE(avl.check());
+  REQUIRE(avl2.check());
+  REQUIRE(avl.size() == 8192U);
+
+  // copies get their own mappings
+  mmap_type* copy = new mmap_type(avl);
+  REQUIRE(copy->size() == 8192U);
+  avl.clear();
+  REQUIRE(copy->check());
+  REQUIRE(*copy->find(17U) == 17U);
+  delete copy;
+}
+
+
+// placement hook which records the reported placements
+struct placement_hook : avl_array_placement_fixed<avl_array_placement::PAGE_HUGE_2MB, avl_array_placement::NUMA_BIND, 0>
+{
+  static int                 count;
+  static std::size_t         smallest;
+  static avl_array_placement last;
+
+  static void placed(const void* addr, std::size_t bytes, const avl_array_placement& actual)
+  {
+    // less than one huge page is mapped with regular pages
+    REQUIRE(addr != nullptr);
+    REQUIRE(((bytes % (2U * 1024U * 1024U) == 0U) || (bytes < 2U * 1024U * 1024U)));
+    count++;
+    smallest = (bytes < smallest) ? bytes : smallest;
+    last = actual;
+  }
+};
+int                 placement_hook::count = 0;
+std::size_t         placement_hook::smallest = 0U;
+avl_array_placement placement_hook::last;
+
+TEST_CASE("Placed allocation", "[alloc]" ) {
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 1024U * 1024U, true, avl_array_layout_soa, false, avl_array_alloc_placed<placement_hook> > placed_type;
+  placement_hook::count = 0;
+  {
+    placed_type avl;
+    REQUIRE(avl.capacity() == 0U);
+    REQUIRE(placement_hook::count == 0);
+
+    for (std::uint32_t n = 0U; n < 100000U; n++) {
+      REQUIRE(avl.insert(n, n + 1U));
+    }
+    REQUIRE(avl.check());
+    REQUIRE(placement_hook::count > 0);
+
+    // hugetlb pages need a pool, without one regular (transparent huge) pages are reported
+    const avl_array_placement actual = placement_hook::last;
+    REQUIRE(actual.page != avl_array_placement::PAGE_HUGE_1GB);
+    if (actual.numa == avl_array_placement::NUMA_BIND) {
+      REQUIRE(actual.node == 0);
+      REQUIRE(avl_array_numa_node(&avl.begin().key()) == 0);
+    }
+    else {
+      REQUIRE(actual.numa == avl_array_placement::NUMA_DEFAULT);
+    }
+
+    for (std::uint32_t n = 0U; n < 100000U; n++) {
+      if (n % 10U) {
+        REQUIRE(avl.erase(n));
+      }
+    }
+    avl.shrink_to_fit();
+    REQUIRE(avl.capacity() == 10000U);
+    REQUIRE(avl.check());
+    for (std::uint32_t n = 0U; n < 100000U; n += 10U) {
+      std::uint64_t val;
+      REQUIRE(avl.find(n, val));
+      REQUIRE(val == n + 1U);
+    }
+  }
+
+  // the placeholder arrays of disabled features (no parent and subtree size) don't occupy a huge page
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 1024U * 1024U, false, avl_array_layout_soa, false, avl_array_alloc_mmap<placement_hook> > mmap_type;
+  placement_hook::smallest = static_cast<std::size_t>(-1);
+  mmap_type* avl = new mmap_type;
+  REQUIRE(avl->max_size() == 1024U * 1024U);
+  REQUIRE(placement_hook::smallest == static_cast<std::size_t>(sysconf(_SC_PAGESIZE)));
+  for (std::uint32_t n = 0U; n < 300000U; n++) {
+    REQUIRE(avl->insert(n, n + 1U));
+  }
+  for (std::uint32_t n = 0U; n < 300000U; n++) {
+    if (n % 10U) {
+      REQUIRE(avl->erase(n));
+    }
+  }
+  avl->shrink_to_fit();
+  REQUIRE(avl->check());
+  for (std::uint32_t n = 0U; n < 300000U; n += 10U) {
+    REQUIRE(*avl->find(n) == n + 1U);
+  }
+  delete avl;
+}
+
+
+TEST_CASE("Image save, load_mmap", "[alloc]" ) {
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 65536U> static_type;
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 65536U, true, avl_array_layout_soa, false, avl_array_alloc_image> image_type;
+  typedef avl_array<std::uint16_t, std::uint32_t, std::uint32_t, 65536U, false, avl_array_layout_compact, true, avl_array_alloc_image> compact_type;
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 65535U, true, avl_array_layout_soa, false, avl_array_alloc_image> other_type;
+  static_type* avl = new static_type;
+  compact_type compact, compact_load;
+  image_type load;
+  other_type other;
+
+  char path[] = "/tmp/avl_array_image_XXXXXX";
+  const int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+
+  // empty image
+  REQUIRE(avl->save(fd));
+  REQUIRE(load.insert(1U, 1U));
+  REQUIRE(load.load_mmap(path, true));
+  REQUIRE(load.empty());
+  REQUIRE(load.check());
+
+  for (std::uint32_t n = 0U; n < 40000U; n++) {
+    const std::uint32_t key = (n * 2654435761U) & 0xFFFFU;
+    REQUIRE(avl->insert(key, key + 1U));
+    REQUIRE(compact.insert(static_cast<std::uint16_t>(key), key + 1U));
+  }
+  for (std::uint32_t n = 0U; n < 65536U; n += 3U) {
+    avl->erase(n);
+    compact.erase(static_cast<std::uint16_t>(n));
+  }
+  REQUIRE(avl->save(fd));
+  REQUIRE(load.load_mmap(path, true));
+  REQUIRE(load.size() == avl->size());
+  REQUIRE(load.capacity() == avl->size());
+  REQUIRE(load.check());
+  static_type::const_iterator it = avl->begin();
+  for (image_type::const_iterator lt = load.begin(); lt != load.end(); ++lt, ++it) {
+    REQUIRE(lt.key() == it.key());
+    REQUIRE(*lt == *it);
+  }
+  REQUIRE(it == avl->end());
+
+  // the mapped arrays are copied when the container grows, the file is not modified
+  for (std::uint32_t n = 0U; n < 65536U; n += 3U) {
+    REQUIRE(load.insert(n, 0U));
+  }
+  REQUIRE(load.erase(1U));
+  REQUIRE(load.check());
+  REQUIRE(load.load_mmap(path));
+  REQUIRE(load.size() == avl->size());
+  REQUIRE(load.count(3U) == 0U);
+  REQUIRE(load.count(1U) == avl->count(1U));
+
+  // other container types don't match
+  REQUIRE(!other.load_mmap(path));
+  REQUIRE(other.empty());
+  REQUIRE(!compact_load.load_mmap(path));
+  REQUIRE(!load.load_mmap("/tmp/avl_array_image_does_not_exist"));
+
+  // an out of bounds child index is detected by the link check, even with matching checksums
+  avl_array_image::header_type header;
+  REQUIRE(pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)));
+  const std::uint32_t wild = static_cast<std::uint32_t>(header.size) + 5U;
+  REQUIRE(pwrite(fd, &wild, sizeof(wild), static_cast<off_t>(header.offset[3] + 8U * 7U)) == static_cast<ssize_t>(sizeof(wild)));   // left child of node 7
+  header.data_checksum = 0U;
+  for (std::uint32_t a = 0U; a < header.arrays; a++) {
+    std::vector<unsigned char> bytes(static_cast<std::size_t>(header.size) * header.elem_bytes[a]);
+    REQUIRE(pread(fd, bytes.data(), bytes.size(), static_cast<off_t>(header.offset[a])) == static_cast<ssize_t>(bytes.size()));
+    header.data_checksum = avl_array_image::checksum(bytes.data(), bytes.size(), header.data_checksum);
+  }
+  header.header_checksum = 0U;
+  header.header_checksum = avl_array_image::checksum(&header, sizeof(header));
+  REQUIRE(pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)));
+  REQUIRE(!load.load_mmap(path));
+  REQUIRE(load.empty());
+  REQUIRE(load.load_mmap(path, false));   // trusted, not checked
+  load.clear();
+
+  // an array offset whose end wraps around is rejected, even for trusted files
+  header.offset[0] = 0U - static_cast<std::uint64_t>(avl_array_image::ALIGN);
+  header.header_checksum = 0U;
+  header.header_checksum = avl_array_image::checksum(&header, sizeof(header));
+  REQUIRE(pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)));
+  REQUIRE(!load.load_mmap(path, false));
+  REQUIRE(load.empty());
+
+  // slow, ranked, compact layout
+  REQUIRE(compact.save(fd));
+  REQUIRE(compact_load.load_mmap(path, true));
+  REQUIRE(compact_load.size() == compact.size());
+  REQUIRE(compact_load.check());
+  for (std::uint32_t k = 0U; k < compact.size(); k += 97U) {
+    REQUIRE(compact_load.select(k).key() == compact.select(k).key());
+    REQUIRE(*compact_load.select(k) == *compact.select(k));
+  }
+
+  // a corrupted array is only detected with verify, a corrupted header always
+  const unsigned char bad = 0xAAU;
+  REQUIRE(pwrite(fd, &bad, 1U, 65536 + 100) == 1);
+  REQUIRE(compact_load.load_mmap(path, false));
+  REQUIRE(!compact_load.load_mmap(path, true));
+  REQUIRE(compact_load.empty());
+  REQUIRE(pwrite(fd, &bad, 1U, 20) == 1);
+  REQUIRE(!compact_load.load_mmap(path));
+
+  close(fd);
+  unlink(path);
+  delete avl;
+}
+
+
+// true if both containers hold the same elements
+template<typename A, typename B>
+static bool same_content(const A& a, const B& b)
+{
+  if (a.size() != b.size()) {
+    return false;
+  }
+  typename B::const_iterator bt = b.begin();
+  for (typename A::const_iterator at = a.begin(); at != a.end(); ++at, ++bt) {
+    if ((bt == b.end()) || (at.key() != bt.key()) || (*at != *bt)) {
+      return false;
+    }
+  }
+  return bt == b.end();
+}
+
+TEST_CASE("Delta write, apply", "[alloc]" ) {
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 65536U, true, avl_array_layout_soa, false, avl_array_alloc_dynamic, true> primary_type;
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 65536U> replica_type;
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 65536U, true, avl_array_layout_soa, false, avl_array_alloc_image> image_type;
+  typedef avl_array<std::uint16_t, std::uint32_t, std::uint32_t, 65536U, false, avl_array_layout_compact, true, avl_array_alloc_static, true> compact_type;
+  typedef avl_array<std::uint16_t, std::uint32_t, std::uint32_t, 65536U, false, avl_array_layout_compact, true> compact_replica_type;
+  primary_type primary;
+  replica_type* replica = new replica_type;
+  compact_type* compact = new compact_type;
+  compact_replica_type* compact_replica = new compact_replica_type;
+
+  char path[] = "/tmp/avl_array_delta_XXXXXX";
+  const int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  const int in = open(path, O_RDONLY);
+  REQUIRE(in >= 0);
+
+  // the first delta holds all nodes
+  REQUIRE(primary.dirty_count() == 0U);
+  for (std::uint32_t n = 0U; n < 10000U; n++) {
+    REQUIRE(primary.insert((n * 2654435761U) & 0xFFFFU, n));
+    REQUIRE(compact->insert(static_cast<std::uint16_t>((n * 2654435761U) & 0xFFFFU), n));
+  }
+  REQUIRE(primary.dirty_count() == primary.size());
+  REQUIRE(primary.write_delta(fd));
+  REQUIRE(primary.dirty_count() == 0U);
+  REQUIRE(compact->write_delta(fd));
+  REQUIRE(replica->apply_delta(in));
+  REQUIRE(compact_replica->apply_delta(in));
+  REQUIRE(same_content(primary, *replica));
+  REQUIRE(same_content(*compact, *compact_replica));
+
+  // rounds of inserts, updates and erases (with tail relocation), every delta only holds the modified nodes
+  srand(0U);
+  for (int round = 0; round < 50; round++) {
+    for (int op = 0; op < 200; op++) {
+      const std::uint32_t key = static_cast<std::uint32_t>(rand()) & 0xFFFFU;
+      if (rand() & 1) {
+        REQUIRE(primary.insert(key, static_cast<std::uint64_t>(round)));
+        REQUIRE(compact->insert(static_cast<std::uint16_t>(key), static_cast<std::uint32_t>(round)));
+      }
+      else {
+        primary.erase(key);
+        compact->erase(static_cast<std::uint16_t>(key));
+      }
+    }
+    REQUIRE(primary.dirty_count() < primary.size() / 2U);
+    REQUIRE(primary.write_delta(fd));
+    REQUIRE(compact->write_delta(fd));
+    REQUIRE(replica->apply_delta(in));
+    REQUIRE(compact_replica->apply_delta(in));
+    REQUIRE(replica->check());
+    REQUIRE(compact_replica->check());
+    REQUIRE(same_content(primary, *replica));
+    REQUIRE(same_content(*compact, *compact_replica));
+  }
+
+  // an empty delta, no delta left to read
+  REQUIRE(primary.write_delta(fd));
+  REQUIRE(replica->apply_delta(in));
+  REQUIRE(same_content(primary, *replica));
+  REQUIRE(!replica->apply_delta(in));
+
+  // value changes through an iterator, find(), select() and for_each_*() are tracked, too
+  const primary_type& const_primary = primary;
+  REQUIRE(const_primary.begin().val() != 1000U);
+  REQUIRE(const_primary.find(const_primary.begin().key()) != const_primary.end());
+  REQUIRE(primary.dirty_count() == 0U);   // const access doesn't mark
+  *primary.begin() = 1000U;
+  primary.find((++const_primary.begin()).key()).val() = 1001U;
+  REQUIRE(primary.dirty_count() == 2U);
+  REQUIRE(primary.write_delta(fd));
+  REQUIRE(replica->apply_delta(in));
+  REQUIRE(same_content(primary, *replica));
+  REQUIRE(replica->begin().val() == 1000U);
+  primary.for_each_unordered([](const std::uint32_t& key, std::uint64_t& val) { val += key; });
+  REQUIRE(primary.write_delta(fd));
+  REQUIRE(replica->apply_delta(in));
+  REQUIRE(same_content(primary, *replica));
+  primary.for_each_sorted([](const std::uint32_t&, std::uint64_t& val) { val *= 3U; });
+  REQUIRE(primary.write_delta(fd));
+  REQUIRE(replica->apply_delta(in));
+  REQUIRE(same_content(primary, *replica));
+  compact->select(5U).val() = 12345U;
+  REQUIRE(compact->dirty_count() == 1U);
+  REQUIRE(compact->write_delta(fd));
+  REQUIRE(compact_replica->apply_delta(in));
+  REQUIRE(same_content(*compact, *compact_replica));
+
+  // a delta of another container type is rejected, the container is unchanged
+  REQUIRE(compact->write_delta(fd));
+  REQUIRE(!replica->apply_delta(in));
+  REQUIRE(same_content(primary, *replica));
+
+  // recovery from a full image and the deltas written after it
+  char image_path[] = "/tmp/avl_array_image_XXXXXX";
+  const int image_fd = mkstemp(image_path);
+  REQUIRE(image_fd >= 0);
+  REQUIRE(primary.save(image_fd));
+  primary.clear_dirty();
+  REQUIRE(primary.dirty_count() == 0U);
+  const off_t log_start = lseek(fd, 0, SEEK_CUR);
+  for (std::uint32_t n = 0U; n < 3000U; n++) {
+    REQUIRE(primary.insert(70000U + n, n));   // beyond the keys of the image, the container grows
+    primary.erase(n);
+  }
+  REQUIRE(primary.write_delta(fd));
+  image_type* recovered = new image_type;
+  REQUIRE(recovered->load_mmap(image_path, true));
+  REQUIRE(lseek(in, log_start, SEEK_SET) == log_start);
+  REQUIRE(recovered->apply_delta(in));
+  REQUIRE(recovered->check());
+  REQUIRE(same_content(primary, *recovered));
+
+  // a corrupted delta is rejected before the container is modified
+  REQUIRE(primary.insert(5U, 5U));
+  const off_t corrupt = lseek(fd, 0, SEEK_CUR);
+  REQUIRE(primary.write_delta(fd));
+  const unsigned char bad = 0xAAU;
+  REQUIRE(pwrite(fd, &bad, 1U, corrupt + static_cast<off_t>(sizeof(avl_array_image::delta_header_type)) + 9) == 1);
+  REQUIRE(!recovered->apply_delta(in));
+  REQUIRE(recovered->count(5U) == 0U);
+
+  close(image_fd);
+  unlink(image_path);
+  close(in);
+  close(fd);
+  unlink(path);
+  delete recovered;
+  delete replica;
+  delete compact;
+  delete compact_replica;
+}
+
+
+static void ignore_signal(int)
+{ }
+
+TEST_CASE("Delta apply, interrupted read", "[alloc]" ) {
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 65536U, true, avl_array_layout_soa, false, avl_array_alloc_dynamic, true> primary_type;
+  typedef avl_array<std::uint32_t, std::uint64_t, std::uint32_t, 65536U, true, avl_array_layout_soa, false, avl_array_alloc_dynamic> replica_type;
+  primary_type primary;
+  replica_type replica;
+  for (std::uint32_t n = 0U; n < 5000U; n++) {
+    REQUIRE(primary.insert(n * 7U, n));
+  }
+  char path[] = "/tmp/avl_array_delta_XXXXXX";
+  const int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  REQUIRE(primary.write_delta(fd));
+  const off_t bytes = lseek(fd, 0, SEEK_CUR);
+  std::vector<char> delta(static_cast<std::size_t>(bytes));
+  REQUIRE(pread(fd, delta.data(), delta.size(), 0) == bytes);
+  close(fd);
+  unlink(path);
+
+  // the reader blocks on a pipe which is fed in pieces, every piece is preceded by a signal without SA_RESTART
+  struct sigaction action, former;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = ignore_signal;
+  REQUIRE(sigaction(SIGUSR1, &action, &former) == 0);
+  int pipe_fd[2];
+  REQUIRE(pipe(pipe_fd) == 0);
+  const pthread_t reader = pthread_self();
+  std::thread feeder([&]() {
+    for (std::size_t pos = 0U; pos < delta.size(); pos += 4096U) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      pthread_kill(reader, SIGUSR1);
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      const std::size_t n = delta.size() - pos < 4096U ? delta.size() - pos : 4096U;
+      if (write(pipe_fd[1], delta.data() + pos, n) != static_cast<ssize_t>(n)) {
+        break;
+      }
+    }
+    close(pipe_fd[1]);
+  });
+  const bool applied = replica.apply_delta(pipe_fd[0]);
+  char rest[4096];
+  while (read(pipe_fd[0], rest, sizeof(rest)) != 0);   // drain, so the feeder finishes if the read failed
+  feeder.join();
+  close(pipe_fd[0]);
+  REQUIRE(sigaction(SIGUSR1, &former, nullptr) == 0);
+  REQUIRE(applied);
+  REQUIRE(replica.check());
+  REQUIRE(same_content(primary, replica));
+}
+
+
+// true if the journal holds exactly the elements of the map
+template<typename Journal>
+static bool same_content(const Journal& journal, const std::map<std::uint32_t, std::uint64_t>& expected)
+{
+  bool same = false;
+  journal.read([&](const typename Journal::container_type& avl) {
+    same = avl.check() && (avl.size() == expected.size());
+    std::map<std::uint32_t, std::uint64_t>::const_iterator e = expected.begin();
+    for (typename Journal::container_type::const_iterator it = avl.begin(); same && (it != avl.end()); ++it, ++e) {
+      same = (it.key() == e->first) && (*it == e->second);
+    }
+  });
+  return same;
+}
+
+static off_t file_size(const std::string& path)
+{
+  struct stat st;
+  return (::stat(path.c_str(), &st) == 0) ? st.st_size : -1;
+}
+
+TEST_CASE("Journal replay", "[alloc]" ) {
+  typedef avl_array_journal<std::uint32_t, std::uint64_t, std::uint32_t, 65536U> journal_type;
+  typedef avl_array_journal<std::uint32_t, std::uint32_t, std::uint32_t, 65536U> other_type;
+  char dir[] = "/tmp/avl_array_journal_XXXXXX";
+  REQUIRE(mkdtemp(dir) != nullptr);
+  const std::string path = std::string(dir) + "/index";
+  std::map<std::uint32_t, std::uint64_t> expected;
+
+  // empty start, log only
+  journal_type* journal = new journal_type(1024U);
+  REQUIRE(journal->insert(1U, 1U) == false);   // not open
+  REQUIRE(journal->open(path.c_str()));
+  REQUIRE(journal->open(path.c_str()) == false);
+  REQUIRE(journal->size() == 0U);
+  srand(0U);
+  for (int n = 0; n < 20000; n++) {
+    const std::uint32_t key = static_cast<std::uint32_t>(rand()) & 0x3FFFU;
+    if (rand() % 3) {
+      REQUIRE(journal->insert(key, static_cast<std::uint64_t>(n)));
+      expected[key] = static_cast<std::uint64_t>(n);
+    }
+    else {
+      REQUIRE(journal->erase(key) == (expected.erase(key) == 1U));
+    }
+  }
+  REQUIRE(journal->sync());
+  REQUIRE(journal->syncs() < 1000U);   // batched
+  delete journal;
+  journal = new journal_type;
+  REQUIRE(journal->open(path.c_str(), true));
+  REQUIRE(same_content(*journal, expected));
+
+  // image plus log tail
+  REQUIRE(journal->checkpoint());
+  for (std::uint32_t n = 0U; n < 5000U; n++) {
+    REQUIRE(journal->insert(n + 0x10000U, n));
+    expected[n + 0x10000U] = n;
+    journal->erase(n);
+    expected.erase(n);
+  }
+  std::uint64_t val;
+  REQUIRE(journal->find(0x10000U, val));
+  REQUIRE(val == 0U);
+  REQUIRE(!journal->find(0U, val));
+  delete journal;
+  journal = new journal_type;
+  REQUIRE(journal->open(path.c_str(), true));
+  REQUIRE(same_content(*journal, expected));
+
+  // durable writers share the syncs (group commit)
+  std::vector<std::thread> threads;
+  for (std::uint32_t t = 0U; t < 4U; t++) {
+    threads.push_back(std::thread([journal, t]() {
+      for (std::uint32_t n = 0U; n < 500U; n++) {
+        (void)journal->insert(0x20000U + t * 500U + n, t, true);
+      }
+    }));
+  }
+  for (std::size_t t = 0U; t < threads.size(); t++) {
+    threads[t].join();
+  }
+  for (std::uint32_t n = 0U; n < 2000U; n++) {
+    expected[0x20000U + n] = n / 500U;
+  }
+  REQUIRE(same_content(*journal, expected));
+  delete journal;
+
+  // a torn record at the end is cut off
+  const std::string log = path + ".log";
+  const off_t log_size = file_size(log);
+  int fd = open(log.c_str(), O_WRONLY | O_APPEND);
+  REQUIRE(fd >= 0);
+  const unsigned char torn[6] = { 1U, 2U, 3U, 4U, 5U, 6U };
+  REQUIRE(write(fd, torn, sizeof(torn)) == static_cast<ssize_t>(sizeof(torn)));
+  close(fd);
+  journal = new journal_type;
+  REQUIRE(journal->open(path.c_str()));
+  REQUIRE(same_content(*journal, expected));
+  REQUIRE(file_size(log) == log_size);
+  REQUIRE(journal->insert(7U, 7U, true));
+  expected[7U] = 7U;
+  delete journal;
+  journal = new journal_type;
+  REQUIRE(journal->open(path.c_str()));
+  REQUIRE(same_content(*journal, expected));
+
+  // crash after the image of a checkpoint is written, before the log is reset: the old log is discarded
+  std::vector<char> old_log(static_cast<std::size_t>(file_size(log)));
+  fd = open(log.c_str(), O_RDONLY);
+  REQUIRE(read(fd, old_log.data(), old_log.size()) == static_cast<ssize_t>(old_log.size()));
+  close(fd);
+  REQUIRE(journal->erase(7U));
+  expected.erase(7U);
+  REQUIRE(journal->checkpoint());
+  delete journal;
+  fd = open(log.c_str(), O_WRONLY | O_TRUNC);
+  REQUIRE(write(fd, old_log.data(), old_log.size()) == static_cast<ssize_t>(old_log.size()));
+  close(fd);
+  journal = new journal_type;
+  REQUIRE(journal->open(path.c_str()));
+  REQUIRE(same_content(*journal, expected));
+  REQUIRE(file_size(log) == static_cast<off_t>(sizeof(journal_type::header_type)));
+
+  // files of another container type
+  other_type* other = new other_type;
+  REQUIRE(!other->open(path.c_str()));
+  delete other;
+
+  // a failed log write undoes all modifications since the last sync, the journal refuses modifications then
+  delete journal;
+  journal = new journal_type;
+  REQUIRE(journal->open(path.c_str()));
+  REQUIRE(journal->insert(8U, 8U, true));
+  expected[8U] = 8U;
+  struct rlimit limit, former;
+  REQUIRE(getrlimit(RLIMIT_FSIZE, &former) == 0);
+  limit = former;
+  limit.rlim_cur = static_cast<rlim_t>(file_size(log));
+  void (*former_handler)(int) = signal(SIGXFSZ, SIG_IGN);
+  REQUIRE(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+  REQUIRE(journal->insert(8U, 80U));       // update
+  REQUIRE(journal->erase(0x20000U));       // erase
+  REQUIRE(journal->insert(9U, 9U));        // insert
+  REQUIRE(!journal->insert(10U, 10U, true));
+  REQUIRE(setrlimit(RLIMIT_FSIZE, &former) == 0);
+  signal(SIGXFSZ, former_handler);
+  REQUIRE(same_content(*journal, expected));
+  REQUIRE(!journal->insert(11U, 11U));
+  REQUIRE(!journal->sync());
+  delete journal;
+  journal = new journal_type;
+  REQUIRE(journal->open(path.c_str()));
+  REQUIRE(same_content(*journal, expected));
+
+  // a partly written batch is cut off the log, a recovery doesn't replay its complete records either
+  const off_t durable_size = file_size(log);
+  limit.rlim_cur = static_cast<rlim_t>(durable_size + 20);   // one insert record and a part of the next one
+  former_handler = signal(SIGXFSZ, SIG_IGN);
+  REQUIRE(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+  REQUIRE(journal->insert(8U, 80U));
+  REQUIRE(!journal->insert(9U, 9U, true));
+  REQUIRE(setrlimit(RLIMIT_FSIZE, &former) == 0);
+  signal(SIGXFSZ, former_handler);
+  REQUIRE(same_content(*journal, expected));
+  REQUIRE(file_size(log) == durable_size);
+  delete journal;
+  journal = new journal_type;
+  REQUIRE(journal->open(path.c_str()));
+  REQUIRE(same_content(*journal, expected));
+
+  // the flusher thread syncs a batch after the maximum delay, without sync()
+  delete journal;
+  journal = new journal_type(65536U, 20U);
+  REQUIRE(journal->open(path.c_str()));
+  const off_t synced_size = file_size(log);
+  REQUIRE(journal->insert(12U, 12U));
+  expected[12U] = 12U;
+  for (int wait = 0; (wait < 200) && !journal->syncs(); wait++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  REQUIRE(journal->syncs() == 1U);
+  REQUIRE(file_size(log) > synced_size);
+  delete journal;
+  journal_type* unflushed = new journal_type(65536U, 0U);
+  REQUIRE(unflushed->open(path.c_str()));
+  REQUIRE(same_content(*unflushed, expected));
+  REQUIRE(unflushed->insert(13U, 13U));
+  expected[13U] = 13U;
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  REQUIRE(unflushed->syncs() == 0U);
+  delete unflushed;
+  journal = new journal_type;
+  REQUIRE(journal->open(path.c_str()));
+  REQUIRE(same_content(*journal, expected));
+
+  delete journal;
+  unlink((path + ".img").c_str());
+  unlink(log.c_str());
+
+  // records larger than the replay buffer
+  struct big_type { std::uint32_t data[20000]; };
+  typedef avl_array_journal<std::uint32_t, big_type, std::uint32_t, 16U> big_journal_type;
+  big_journal_type* big = new big_journal_type;
+  REQUIRE(big->open(path.c_str()));
+  big_type val_big;
+  for (std::uint32_t n = 0U; n < 8U; n++) {
+    for (std::uint32_t i = 0U; i < 20000U; i++) {
+      val_big.data[i] = n * i;
+    }
+    REQUIRE(big->insert(n, val_big));
+  }
+  REQUIRE(big->erase(3U));
+  REQUIRE(big->sync());
+  delete big;
+  big = new big_journal_type;
+  REQUIRE(big->open(path.c_str()));
+  REQUIRE(big->size() == 7U);
+  REQUIRE(!big->find(3U, val_big));
+  REQUIRE(big->find(7U, val_big));
+  REQUIRE(val_big.data[19999] == 7U * 19999U);
+  delete big;
+  unlink((path + ".img").c_str());
+  unlink(log.c_str());
+  rmdir(dir);
+}
+#endif
+
+
 TEST_CASE("Random insert", "[insert]" ) {
   avl_array<int, int, int, 10000> avl;
   srand(0U);
@@ -186,11 +1198,129 @@ TEST_CASE("Random erase - slow mode", "[erase]" ) {
     REQUIRE(arr[n] == *avl.find(arr[n]));
   }
 
-  for (int n = 0; n < 10000; n++) {
-    avl.erase(avl.find(arr[n]));
-    REQUIRE(avl.check());
+  for (int n = 0; n < 10000; n++) {
+    avl.erase(avl.find(arr[n]));
+    REQUIRE(avl.check());
+  }
+  REQUIRE(avl.empty());
+}
+
+
+TEST_CASE("Random insert/erase - blocked layout", "[layout]" ) {
+  avl_array<int, int, int, 10000, true, avl_array_layout_blocked> avl;
+  int arr[10000];
+  srand(0U);
+  for (int n = 0; n < 10000; n++) {
+    const int r = rand();
+    REQUIRE(avl.insert(r, r));
+    arr[n] = r;
+    REQUIRE(avl.check());
+  }
+
+  int x = -1;
+  for (auto it = avl.begin(); it != avl.end(); ++it) {
+    REQUIRE(x < it.key());
+    REQUIRE(*it == it.key());
+    x = it.key();
+  }
+
+  for (int n = 0; n < 10000; n++) {
+    REQUIRE(avl.erase(arr[n]));
+    REQUIRE(avl.find(arr[n]) == avl.end());
+    REQUIRE(avl.check());
+  }
+  REQUIRE(avl.empty());
+}
+
+
+TEST_CASE("Random insert/erase - blocked layout, slow mode", "[layout]" ) {
+  avl_array<int, int, std::uint16_t, 2048, false, avl_array_layout_blocked> avl;
+  int arr[2048];
+  srand(0U);
+  for (int n = 0; n < 2048; n++) {
+    const int r = rand();
+    REQUIRE(avl.insert(r, n));
+    arr[n] = r;
+    REQUIRE(avl.check());
+  }
+
+  int val;
+  for (int n = 0; n < 2048; n++) {
+    REQUIRE(avl.find(arr[n], val));
+    REQUIRE(val == n);
+  }
+
+  for (int n = 0; n < 2048; n++) {
+    REQUIRE(avl.erase(arr[n]));
+    REQUIRE(!avl.find(arr[n], val));
+    REQUIRE(avl.check());
+  }
+  REQUIRE(avl.empty());
+}
+
+
+TEST_CASE("Random insert/erase - compact layout", "[layout]" ) {
+  avl_array<int, int, int, 10000, true, avl_array_layout_compact, true> avl;
+  int arr[10000];
+  srand(0U);
+  for (int n = 0; n < 10000; n++) {
+    const int r = rand();
+    REQUIRE(avl.insert(r, r));
+    arr[n] = r;
+    REQUIRE(avl.check());
+  }
+
+  int x = -1;
+  for (auto it = avl.begin(); it != avl.end(); ++it) {
+    REQUIRE(x < it.key());
+    REQUIRE(*it == it.key());
+    x = it.key();
+  }
+  auto it = avl.begin();
+  it += 5000;
+  REQUIRE(*avl.select(5000) == *it);
+
+  for (int n = 0; n < 10000; n++) {
+    REQUIRE(avl.erase(arr[n]));
+    REQUIRE(avl.find(arr[n]) == avl.end());
+    REQUIRE(avl.check());
+  }
+  REQUIRE(avl.empty());
+}
+
+
+TEST_CASE("Random insert/erase - compact layout, slow mode", "[layout]" ) {
+  // 63 nodes use 8 bit indices with the balance in the two high bits of the left child
+  avl_array<int, int, int, 63, false, avl_array_layout_compact> avl;
+  avl_array<int, int, int, 63, false, avl_array_layout_soa> avl_soa;
+  REQUIRE(sizeof(avl) < sizeof(avl_soa));
+  int arr[63];
+  srand(0U);
+  for (int round = 0; round < 10; round++) {
+    for (int n = 0; n < 63; n++) {
+      int r;
+      do {
+        r = rand() % 1000;
+      } while (avl.count(r));
+      REQUIRE(avl.insert(r, n));
+      arr[n] = r;
+      REQUIRE(avl.check());
+    }
+    REQUIRE(!avl.insert(1000, 0));
+
+    int val;
+    for (int n = 0; n < 63; n++) {
+      REQUIRE(avl.find(arr[n], val));
+      REQUIRE(val == n);
+    }
+
+    for (int n = 0; n < 63; n++) {
+      REQUIRE(avl.erase(arr[(n * 17) % 63]));
+      REQUIRE(!avl.find(arr[(n * 17) % 63], val));
+      REQUIRE(avl.check());
+    }
+    REQUIRE(avl.empty());
   }
-  REQUIRE(avl.empty());
 }
 
 
@@ -309,6 +1439,131 @@ TEST_CASE("Erase and insert", "[erase]" ) {
 }
 
 
+TEST_CASE("Erase and insert - slow mode", "[erase]" ) {
+  // the rebalancing of the slow mode uses the recorded path, it must build the same tree as the fast mode
+  avl_array<int, int, std::uint16_t, 4096, true,  avl_array_layout_soa, true> avl_fast;
+  avl_array<int, int, std::uint16_t, 4096, false, avl_array_layout_soa, true> avl_slow;
+  srand(1U);
+  for (int n = 0; n < 20000; n++) {
+    const int r = rand() % 8192;
+    if (rand() % 3) {
+      REQUIRE(avl_fast.insert(r, n) == avl_slow.insert(r, n));
+    }
+    else {
+      REQUIRE(avl_fast.erase(r) == avl_slow.erase(avl_slow.find(r)));
+    }
+    if (!(n % 64)) {
+      REQUIRE(avl_slow.check());
+    }
+  }
+  REQUIRE(avl_slow.check());
+  REQUIRE(avl_fast.size() == avl_slow.size());
+  auto it = avl_slow.begin();
+  for (auto it_fast = avl_fast.begin(); it_fast != avl_fast.end(); ++it_fast, ++it) {
+    REQUIRE(it.key() == it_fast.key());
+    REQUIRE(*it == *it_fast);
+    REQUIRE(avl_slow.rank(it.key()) == avl_fast.rank(it_fast.key()));
+  }
+}
+
+
+TEST_CASE("Select, rank", "[ranked]" ) {
+  avl_array<int, int, std::uint16_t, 2048, true, avl_array_layout_soa, true> avl;
+  REQUIRE(avl.select(0) == avl.end());
+  REQUIRE(avl.rank(0) == 0U);
+
+  // even keys in random order
+  int arr[2048];
+  for (int n = 0; n < 2048; n++) {
+    arr[n] = 2 * n;
+  }
+  srand(0U);
+  for (int n = 2047; n > 0; n--) {
+    const int r = rand() % (n + 1);
+    const int t = arr[n]; arr[n] = arr[r]; arr[r] = t;
+  }
+  for (int n = 0; n < 2048; n++) {
+    REQUIRE(avl.insert(arr[n], arr[n]));
+    REQUIRE(avl.check());
+  }
+
+  for (int n = 0; n < 2048; n++) {
+    REQUIRE(avl.select(static_cast<std::uint16_t>(n)).key() == 2 * n);
+    REQUIRE(avl.rank(2 * n) == n);
+    REQUIRE(avl.rank(2 * n + 1) == n + 1);
+  }
+  REQUIRE(avl.select(2048) == avl.end());
+  REQUIRE(avl.rank(-1) == 0U);
+
+  // erase half of the keys
+  for (int n = 0; n < 1024; n++) {
+    REQUIRE(avl.erase(arr[n]));
+    REQUIRE(avl.check());
+  }
+  int pos = 0;
+  for (auto it = avl.begin(); it != avl.end(); ++it, ++pos) {
+    REQUIRE(avl.select(static_cast<std::uint16_t>(pos)) == it);
+    REQUIRE(avl.rank(it.key()) == pos);
+  }
+  REQUIRE(pos == 1024);
+}
+
+
+TEST_CASE("Select, rank - slow mode, blocked layout", "[ranked]" ) {
+  avl_array<int, int, int, 10000, false, avl_array_layout_blocked, true> avl;
+  int arr[10000];
+  srand(0U);
+  for (int n = 0; n < 10000; n++) {
+    arr[n] = rand();
+    REQUIRE(avl.insert(arr[n], n));
+  }
+  REQUIRE(avl.check());
+  int pos = 0;
+  for (auto it = avl.begin(); it != avl.end(); ++it, ++pos) {
+    REQUIRE(avl.select(pos) == it);
+    REQUIRE(avl.rank(it.key()) == pos);
+  }
+  for (int n = 0; n < 10000; n += 2) {
+    REQUIRE(avl.erase(arr[n]));
+  }
+  REQUIRE(avl.check());
+  REQUIRE(avl.size() == 5000);
+  pos = 0;
+  for (auto it = avl.begin(); it != avl.end(); ++it, ++pos) {
+    REQUIRE(avl.select(pos) == it);
+  }
+}
+
+
+TEST_CASE("Iterator +=", "[iterator]" ) {
+  avl_array<int, int, int, 1000, true, avl_array_layout_soa, true> ranked;
+  avl_array<int, int, int, 1000> unranked;
+  for (int n = 0; n < 1000; n++) {
+    REQUIRE(ranked.insert(n, n));
+    REQUIRE(unranked.insert(n, n));
+  }
+  for (int start = 0; start < 1000; start += 7) {
+    for (int step = 0; step < 1100; step += 13) {
+      auto it = ranked.find(start);
+      auto it2 = unranked.find(start);
+      it += step;
+      it2 += step;
+      if (start + step < 1000) {
+        REQUIRE(*it == start + step);
+        REQUIRE(*it2 == start + step);
+      }
+      else {
+        REQUIRE(it == ranked.end());
+        REQUIRE(it2 == unranked.end());
+      }
+    }
+  }
+  auto it = ranked.end();
+  it += 5;
+  REQUIRE(it == ranked.end());
+}
+
+
 TEST_CASE("Iterator init", "[iterator]" ) {
   avl_array<int, int, std::uint16_t, 2048> avl;
   avl_array<int, int, std::uint16_t, 2048>::iterator it = avl.begin();
@@ -373,6 +1628,166 @@ TEST_CASE("Iterator assignment", "[iterator]" ) {
 }
 
 
+TEST_CASE("Iterator --", "[iterator]" ) {
+  avl_array<int, int, std::uint16_t, 2048> avl;
+  avl_array<int, int, std::uint16_t, 2048, false> avl_slow;
+  for (int n = 0; n < 2000; n++) {
+    const int key = (n * 7919) % 2000;
+    REQUIRE(avl.insert(key, key));
+    REQUIRE(avl_slow.insert(key, key));
+  }
+  // decrementing end() gives the largest element
+  auto it = avl.end();
+  auto it_slow = avl_slow.end();
+  for (int x = 1999; x >= 0; x--) {
+    --it;
+    it_slow--;
+    REQUIRE(*it == x);
+    REQUIRE(*it_slow == x);
+  }
+
+  // starting in the middle
+  it = avl.find(1000);
+  it_slow = avl_slow.find(1000);
+  for (int n = 1000; n < 1500; n++, ++it, ++it_slow) {
+    REQUIRE(*it == n);
+    REQUIRE(*it_slow == n);
+  }
+  for (int n = 1500; n > 500; n--, --it, --it_slow) {
+    REQUIRE(*it == n);
+    REQUIRE(*it_slow == n);
+  }
+}
+
+
+TEST_CASE("Iterator - slow mode", "[iterator]" ) {
+  avl_array<int, int, int, 4096, false> avl;
+  for (int n = 0; n < 4096; n++) {
+    REQUIRE(avl.insert(4095 - n, n));
+  }
+  int x = 0;
+  for (auto it = avl.begin(); it != avl.end(); ++it) {
+    REQUIRE(it.key() == x++);
+  }
+  REQUIRE(x == 4096);
+  for (int n = 0; n < 2048; n++) {
+    REQUIRE(avl.erase(n * 2));
+  }
+  x = 1;
+  for (auto it = avl.begin(); it != avl.end(); it++, x += 2) {
+    REQUIRE(it.key() == x);
+  }
+  REQUIRE(x == 4097);
+}
+
+
+TEST_CASE("Reverse iterator", "[iterator]" ) {
+  avl_array<int, int, int, 1000> avl;
+  avl_array<int, int, int, 1000, false> avl_slow;
+  REQUIRE(avl.rbegin() == avl.rend());
+  for (int n = 0; n < 1000; n++) {
+    REQUIRE(avl.insert(n, n + 1));
+    REQUIRE(avl_slow.insert(n, n + 1));
+  }
+  int x = 999;
+  for (auto it = avl.rbegin(); it != avl.rend(); ++it) {
+    REQUIRE(it.key() == x);
+    REQUIRE(*it == 1 + x--);
+  }
+  REQUIRE(x == -1);
+  x = 999;
+  for (auto it = avl_slow.crbegin(); it != avl_slow.crend(); it++) {
+    REQUIRE(it.key() == x--);
+  }
+  REQUIRE(x == -1);
+
+  // decrementing rend() gives the smallest element
+  auto it = avl.rend();
+  --it;
+  REQUIRE(it.key() == 0);
+  --it;
+  REQUIRE(it.key() == 1);
+}
+
+
+TEST_CASE("Const iterator", "[iterator]" ) {
+  avl_array<int, int, int, 100> avl;
+  for (int n = 0; n < 100; n++) {
+    REQUIRE(avl.insert(n, n * 2));
+  }
+  const avl_array<int, int, int, 100>& c = avl;
+  int x = 0;
+  for (avl_array<int, int, int, 100>::const_iterator it = c.begin(); it != c.end(); ++it, ++x) {
+    REQUIRE(*it == x * 2);
+  }
+  REQUIRE(x == 100);
+  REQUIRE(c.find(50).key() == 50);
+  REQUIRE(c.find(200) == c.end());
+  REQUIRE(c.lower_bound(10).key() == 10);
+  REQUIRE(c.upper_bound(10).key() == 11);
+  REQUIRE(c.count(99) == 1);
+
+  // iterator converts to const_iterator
+  avl_array<int, int, int, 100>::const_iterator cit = avl.find(5);
+  REQUIRE(*cit == 10);
+  REQUIRE(cit == avl.find(5));
+  REQUIRE(avl.cbegin() == avl.begin());
+  REQUIRE(avl.cend() == avl.end());
+}
+
+
+TEST_CASE("For each", "[iterator]" ) {
+  avl_array<int, int, int, 1000> avl;
+  avl_array<int, int, int, 1000, false, avl_array_layout_blocked> avl_slow;
+  int count = 0;
+  avl.for_each_sorted([&](const int&, int&) { count++; });
+  avl.for_each_unordered([&](const int&, int&) { count++; });
+  REQUIRE(count == 0);
+
+  for (int n = 0; n < 1000; n++) {
+    const int key = (n * 7919) % 1000;
+    REQUIRE(avl.insert(key, key * 2));
+    REQUIRE(avl_slow.insert(key, key * 2));
+  }
+  for (int n = 0; n < 1000; n += 3) {
+    REQUIRE(avl.erase(n));
+    REQUIRE(avl_slow.erase(n));
+  }
+
+  // sorted, same order as the iterator
+  auto it = avl.begin();
+  avl.for_each_sorted([&](const int& key, int& val) {
+    REQUIRE(key == it.key());
+    REQUIRE(val == key * 2);
+    ++it;
+  });
+  REQUIRE(it == avl.end());
+  it = avl.begin();
+  avl_slow.for_each_sorted([&](const int& key, int& val) {
+    REQUIRE(key == it.key());
+    val++;
+    ++it;
+  });
+  REQUIRE(it == avl.end());
+
+  // unordered, every element exactly once
+  std::vector<int> seen(1000, 0);
+  long sum = 0;
+  const avl_array<int, int, int, 1000>& c = avl;
+  c.for_each_unordered([&](const int& key, const int& val) {
+    seen[static_cast<std::size_t>(key)]++;
+    sum += val;
+  });
+  long expected = 0;
+  for (int n = 0; n < 1000; n++) {
+    REQUIRE(seen[static_cast<std::size_t>(n)] == ((n % 3) ? 1 : 0));
+    expected += (n % 3) ? n * 2 : 0;
+  }
+  REQUIRE(sum == expected);
+  avl_slow.for_each_unordered([&](const int& key, int& val) { REQUIRE(val == key * 2 + 1); });
+}
+
+
 TEST_CASE("Find (iterator)", "[find]" ) {
   avl_array<int, int, std::uint16_t, 2048> avl;
   for (int n = 0; n < 2048; n++) {
@@ -404,6 +1819,115 @@ TEST_CASE("Find (value)", "[find]" ) {
 }
 
 
+TEST_CASE("Find (branchless)", "[find]" ) {
+  avl_array<int, int, std::uint16_t, 2048> avl;
+  avl_array<int, int, std::uint16_t, 2048, true, avl_array_layout_blocked> avl_blocked;
+  int val;
+  REQUIRE(!avl.find_branchless(0, val));
+  REQUIRE(!avl_blocked.find_branchless(0, val));
+
+  srand(0U);
+  for (int n = 0; n < 2048; n++) {
+    const int r = rand() & 0xFFFF;
+    avl.insert(r, n);
+    avl_blocked.insert(r, n);
+  }
+  for (int k = 0; k <= 0x10000; k++) {
+    int val2;
+    const bool found = avl.find(k, val);
+    REQUIRE(avl.find_branchless(k, val2) == found);
+    if (found) {
+      REQUIRE(val2 == val);
+    }
+    REQUIRE(avl_blocked.find_branchless(k, val2) == found);
+    if (found) {
+      REQUIRE(val2 == val);
+    }
+  }
+}
+
+
+TEST_CASE("Find (batch)", "[find]" ) {
+  avl_array<int, int, std::uint16_t, 2048> avl;
+  int keys[100], out[100];
+  bool found[100];
+  for (int n = 0; n < 100; n++) {
+    keys[n] = n;
+  }
+  REQUIRE(avl.find_batch(keys, 100, out, found) == 0U);
+  for (int n = 0; n < 100; n++) {
+    REQUIRE(!found[n]);
+  }
+
+  srand(0U);
+  for (int n = 0; n < 2048; n++) {
+    const int r = rand() & 0xFFFF;
+    avl.insert(r, n);
+  }
+  for (int k = 0; k <= 0x10000; k += 100) {
+    // odd batch sizes to test incomplete groups
+    const std::size_t size = static_cast<std::size_t>(1 + k % 97);
+    for (std::size_t n = 0U; n < size; n++) {
+      keys[n] = k + static_cast<int>(n);
+    }
+    std::size_t count = 0U;
+    for (std::size_t n = 0U; n < size; n++) {
+      count += avl.count(keys[n]);
+    }
+    REQUIRE(avl.find_batch(keys, size, out, found) == count);
+    for (std::size_t n = 0U; n < size; n++) {
+      int val;
+      REQUIRE(found[n] == avl.find(keys[n], val));
+      if (found[n]) {
+        REQUIRE(out[n] == val);
+      }
+    }
+  }
+}
+
+
+TEST_CASE("Lower bound, upper bound, equal range", "[find]" ) {
+  avl_array<int, int, std::uint16_t, 1024> avl;
+  REQUIRE(avl.lower_bound(0) == avl.end());
+  REQUIRE(avl.upper_bound(0) == avl.end());
+  REQUIRE(avl.equal_range(0).first == avl.end());
+  REQUIRE(avl.equal_range(0).second == avl.end());
+
+  // even keys only
+  for (int n = 0; n < 1024; n++) {
+    REQUIRE(avl.insert(2 * n, n));
+  }
+  for (int k = -1; k <= 2048; k++) {
+    const bool exists = (k >= 0) && (k < 2048) && !(k & 1);
+    const int lower = (k < 0) ? 0 : (k + 1) & ~1;
+    const int upper = (k < 0) ? 0 : (k + 2) & ~1;
+    if (lower < 2048) {
+      REQUIRE(avl.lower_bound(k).key() == lower);
+    }
+    else {
+      REQUIRE(avl.lower_bound(k) == avl.end());
+    }
+    if (upper < 2048) {
+      REQUIRE(avl.upper_bound(k).key() == upper);
+    }
+    else {
+      REQUIRE(avl.upper_bound(k) == avl.end());
+    }
+    auto range = avl.equal_range(k);
+    REQUIRE(range.first == avl.lower_bound(k));
+    REQUIRE(range.second == avl.upper_bound(k));
+    REQUIRE((range.first != range.second) == exists);
+  }
+
+  // range scan
+  int x = 100;
+  for (auto it = avl.lower_bound(99); it != avl.upper_bound(201); ++it, x += 2) {
+    REQUIRE(it.key() == x);
+  }
+  REQUIRE(x == 202);
+}
+
+
 TEST_CASE("Count", "[find]" ) {
   avl_array<int, int, int, 1024> avl;
   for (int n = 0; n < 1023; n++) {
@@ -423,6 +1947,144 @@ TEST_CASE("Count", "[find]" ) {
 }
 
 
+TEST_CASE("Stats", "[stats]" ) {
+  typedef avl_array<int, int, int, 1024, true, avl_array_layout_soa, false, avl_array_alloc_static, false, avl_array_stats_counting> stats_type;
+  REQUIRE(std::is_empty<avl_array_stats_none>::value);
+  stats_type* avl = new stats_type;
+  int val;
+
+  // ascending keys build a perfect tree of height 10 with single left rotations only
+  for (int n = 0; n < 1023; n++) {
+    REQUIRE(avl->insert(n, n));
+  }
+  REQUIRE(avl->stats().left_rotations == 1013U);
+  REQUIRE(avl->stats().rotations() == avl->stats().left_rotations);
+  REQUIRE(avl->stats().insert_path.count == 1023U);   // one sample per insert, an empty path for the root
+  REQUIRE(avl->stats().insert_path.bucket[0] == 1U);
+  REQUIRE(avl->stats().relocations == 0U);
+  REQUIRE(avl->stats().comparisons > 0U);
+
+  avl->stats().reset();
+  REQUIRE(avl->stats().comparisons == 0U);
+  REQUIRE(avl->stats().insert_path.count == 0U);
+  for (int n = 0; n < 1023; n++) {
+    REQUIRE(avl->find(n, val));
+  }
+  const avl_array_stats_counting::histogram& depth = avl->stats().find_depth;
+  REQUIRE(depth.count == 1023U);
+  REQUIRE(depth.bucket[1] == 1U);
+  REQUIRE(depth.bucket[10] == 512U);
+  REQUIRE(depth.percentile(1.0) == 10U);
+  REQUIRE(depth.percentile(0.49) == 9U);
+  REQUIRE(depth.percentile(0.5) == 10U);
+  REQUIRE(depth.mean() == Approx(9217.0 / 1023.0));
+  std::uint64_t exported = 0U;
+  depth.for_each_bucket([&](std::size_t length, std::uint64_t samples) {
+    REQUIRE(samples == (1U << (length - 1U)));
+    exported += samples;
+  });
+  REQUIRE(exported == depth.count);
+  REQUIRE(avl->stats().rotations() == 0U);
+
+  // the root is found by a 'less than' and an 'equal to' comparison, a missing key visits a whole path
+  avl->stats().reset();
+  REQUIRE(avl->find(511, val));
+  REQUIRE(avl->stats().comparisons == 2U);
+  REQUIRE(!avl->find(2000, val));
+  REQUIRE(avl->stats().find_depth.bucket[10] == 1U);
+  REQUIRE(avl->count(511) == 1U);
+  REQUIRE(avl->find_branchless(511, val));
+  REQUIRE(avl->find_bounded(511, val));
+  REQUIRE(avl->stats().find_depth.count == 5U);
+
+  // erasing the last node needs no relocation, any other node does
+  avl->stats().reset();
+  REQUIRE(avl->erase(1022));
+  REQUIRE(avl->stats().relocations == 0U);
+  REQUIRE(avl->erase(0));
+  REQUIRE(avl->stats().relocations == 1U);
+  REQUIRE(avl->stats().erase_path.count == 2U);
+
+  // the insert into an empty tree and the erase of the last node record an empty path as well
+  stats_type* single = new stats_type;
+  REQUIRE(single->insert(1, 1));
+  REQUIRE(single->erase(1));
+  REQUIRE(single->insert(2, 2));
+  REQUIRE(single->insert(3, 3));
+  REQUIRE(single->erase(2));
+  REQUIRE(single->erase(3));
+  REQUIRE(single->stats().insert_path.count == 3U);
+  REQUIRE(single->stats().erase_path.count == 3U);
+  REQUIRE(single->stats().insert_path.bucket[0] == 2U);
+  REQUIRE(single->stats().erase_path.bucket[0] == 2U);
+  delete single;
+
+  // bounds, ranges and batches count their comparisons, but no find depth
+  avl->stats().reset();
+  REQUIRE(avl->lower_bound(511).key() == 511);
+  const std::uint64_t lower = avl->stats().comparisons;
+  REQUIRE(lower >= 9U);
+  REQUIRE(avl->upper_bound(511).key() == 512);
+  REQUIRE(avl->stats().comparisons >= 2U * lower);
+  avl->stats().reset();
+  REQUIRE(avl->equal_range(511).first.key() == 511);
+  REQUIRE(avl->stats().comparisons > lower);
+  avl->stats().reset();
+  const int keys[4] = { 1, 511, 700, 2000 };
+  int vals[4];
+  bool found[4];
+  REQUIRE(avl->find_batch(keys, 4U, vals, found) == 3U);
+  REQUIRE(avl->stats().comparisons >= 4U * 9U);
+  REQUIRE(avl->stats().find_depth.count == 0U);
+  delete avl;
+
+  // random keys need all rotation types, the statistics don't change the tree
+  typedef avl_array<std::uint16_t, int, std::uint32_t, 4096U, false, avl_array_layout_compact, true, avl_array_alloc_static, false, avl_array_stats_counting> slow_stats_type;
+  slow_stats_type* counted = new slow_stats_type;
+  avl_array<std::uint16_t, int, std::uint32_t, 4096U, false, avl_array_layout_compact, true>* plain = new avl_array<std::uint16_t, int, std::uint32_t, 4096U, false, avl_array_layout_compact, true>;
+  srand(0U);
+  std::uint64_t erased = 0U;
+  for (int n = 0; n < 20000; n++) {
+    const std::uint16_t key = static_cast<std::uint16_t>(rand() % 6000);
+    if (rand() & 1) {
+      REQUIRE(counted->insert(key, n) == plain->insert(key, n));
+    }
+    else {
+      const bool removed = counted->erase(key);
+      REQUIRE(removed == plain->erase(key));
+      erased += removed ? 1U : 0U;
+    }
+  }
+  REQUIRE(counted->check());
+  REQUIRE(counted->size() == plain->size());
+  auto it = plain->begin();
+  for (auto ct = counted->begin(); ct != counted->end(); ++ct, ++it) {
+    REQUIRE(ct.key() == it.key());
+    REQUIRE(*ct == *it);
+  }
+  REQUIRE(counted->stats().left_rotations > 0U);
+  REQUIRE(counted->stats().right_rotations > 0U);
+  REQUIRE(counted->stats().left_right_rotations > 0U);
+  REQUIRE(counted->stats().right_left_rotations > 0U);
+  REQUIRE(counted->stats().relocations <= erased);
+  REQUIRE(counted->stats().relocations > erased / 2U);
+  REQUIRE(counted->stats().erase_path.count == erased);   // one sample per erase
+  REQUIRE(counted->stats().insert_path.percentile(1.0) <= 13U);
+
+  // the rank and the parent searches of the slow version count their comparisons
+  counted->stats().reset();
+  (void)counted->rank(counted->begin().key());
+  REQUIRE(counted->stats().comparisons > 0U);
+  counted->stats().reset();
+  auto first = counted->begin();
+  REQUIRE(first != counted->end());
+  ++first;
+  REQUIRE(counted->stats().comparisons > 0U);
+  delete counted;
+  delete plain;
+}
+
+
 TEST_CASE("Container size", "[size]" ) {
   {
     avl_array<int, int, int, 1> avl;
@@ -510,3 +2172,456 @@ TEST_CASE("Container size", "[size]" ) {
     REQUIRE(*it == 5);
   }
 }
+
+
+TEST_CASE("Parallel bulk load, find batch", "[concurrent]" ) {
+  typedef avl_array<int, int, std::uint32_t, 100000U> fast_type;
+  typedef avl_array<int, int, std::uint32_t, 100000U, false, avl_array_layout_compact, true, avl_array_alloc_dynamic> slow_type;
+  fast_type* avl = new fast_type;
+  slow_type* avl_slow = new slow_type;
+  avl_array_thread_pool pool(4U);
+  REQUIRE(pool.size() == 4U);
+
+  // sorted input, parallel assign gives the same tree as the sequential one
+  std::vector<std::pair<int, int> > v;
+  for (int size = 0; size <= 100000; size += (size < 70) ? 1 : 33331) {
+    v.clear();
+    for (int n = 0; n < size; n++) {
+      v.push_back(std::pair<int, int>(3 * n, n));
+    }
+    avl->insert(-1, -1);   // former content is discarded
+    REQUIRE(avl->assign_sorted(v.begin(), v.end(), pool));
+    REQUIRE(avl_slow->assign_sorted(v.begin(), v.end(), pool));
+    REQUIRE(avl->size() == static_cast<std::uint32_t>(size));
+    REQUIRE(avl_slow->size() == static_cast<std::uint32_t>(size));
+    REQUIRE(avl->check());
+    REQUIRE(avl_slow->check());
+    int x = 0;
+    for (auto it = avl_slow->begin(); it != avl_slow->end(); ++it, ++x) {
+      REQUIRE(it.key() == 3 * x);
+      REQUIRE(*it == x);
+    }
+    REQUIRE(x == size);
+  }
+  v.clear();
+  for (int n = 0; n < 100001; n++) {
+    v.push_back(std::pair<int, int>(n, n));
+  }
+  REQUIRE(!avl->assign_sorted(v.begin(), v.end(), pool));   // too many elements
+  REQUIRE(avl->empty());
+
+  // unsorted input with duplicates, the last pair of a key wins
+  v.clear();
+  srand(0U);
+  for (int n = 0; n < 120000; n++) {
+    v.push_back(std::pair<int, int>(rand() % 90000, n));
+  }
+  std::vector<int> last(90000, -1);
+  std::size_t unique = 0U;
+  for (std::size_t n = 0U; n < v.size(); n++) {
+    unique += (last[static_cast<std::size_t>(v[n].first)] < 0) ? 1U : 0U;
+    last[static_cast<std::size_t>(v[n].first)] = v[n].second;
+  }
+  REQUIRE(avl_array_bulk_load(*avl, v.begin(), v.end(), pool));
+  REQUIRE(avl_array_bulk_load(*avl_slow, v.begin(), v.end(), pool));
+  REQUIRE(avl->size() == unique);
+  REQUIRE(avl_slow->size() == unique);
+  REQUIRE(avl->check());
+  REQUIRE(avl_slow->check());
+  for (int k = 0; k < 90000; k++) {
+    int val;
+    REQUIRE(avl->find(k, val) == (last[static_cast<std::size_t>(k)] >= 0));
+    if (last[static_cast<std::size_t>(k)] >= 0) {
+      REQUIRE(val == last[static_cast<std::size_t>(k)]);
+    }
+  }
+
+  // parallel batch find gives the same result as the sequential one
+  std::vector<int> keys(70000), out(70000), out_seq(70000);
+  bool* found = new bool[70000];
+  bool* found_seq = new bool[70000];
+  for (std::size_t n = 0U; n < keys.size(); n++) {
+    keys[n] = rand() % 100000;
+  }
+  const std::size_t count = avl->find_batch(keys.data(), keys.size(), out_seq.data(), found_seq);
+  REQUIRE(avl->find_batch(keys.data(), keys.size(), out.data(), found, pool) == count);
+  REQUIRE(avl_slow->find_batch(keys.data(), keys.size(), out.data(), found, pool) == count);
+  for (std::size_t n = 0U; n < keys.size(); n++) {
+    REQUIRE(found[n] == found_seq[n]);
+    if (found[n]) {
+      REQUIRE(out[n] == out_seq[n]);
+    }
+  }
+  delete[] found;
+  delete[] found_seq;
+  delete avl;
+  delete avl_slow;
+}
+
+
+TEST_CASE("Seqlock", "[concurrent]" ) {
+  typedef avl_array_seqlock<std::uint32_t, std::uint64_t, std::uint32_t, 4096U> seqlock_type;
+  seqlock_type* avl = new seqlock_type;
+
+  // even keys are always present, odd keys are inserted and erased by the writer
+  for (std::uint32_t k = 0U; k < 4096U; k += 2U) {
+    REQUIRE(avl->insert(k, k * 3U));
+  }
+
+  std::atomic<bool>     stop(false);
+  std::atomic<unsigned> errors(0U), finds(0U);
+  std::vector<std::thread> readers;
+  for (std::uint32_t t = 0U; t < 3U; t++) {
+    readers.push_back(std::thread([avl, t, &stop, &errors, &finds]() {
+      std::uint32_t rnd = t + 1U;
+      while (!stop.load()) {
+        rnd = rnd * 1664525U + 1013904223U;
+        const std::uint32_t k = (rnd >> 8U) % 4096U;
+        std::uint64_t val = 0U;
+        const bool found = avl->find(k, val);
+        if ((!(k & 1U) && !found) || (found && (val != k * 3U))) {
+          errors++;
+        }
+        finds++;
+      }
+    }));
+  }
+
+  for (std::uint32_t n = 0U; n < 50000U; n++) {
+    const std::uint32_t k = ((n * 2654435761U) % 2048U) * 2U + 1U;
+    if (n & 1U) {
+      avl->erase(k);
+    }
+    else {
+      avl->insert(k, k * 3U);
+    }
+    if (!(n % 1000U)) {
+      // batch in one write section
+      avl->write([n](seqlock_type::container_type& c) {
+        for (std::uint32_t i = 0U; i < 64U; i++) {
+          c.insert(((n + i) % 2048U) * 2U + 1U, (((n + i) % 2048U) * 2U + 1U) * 3U);
+        }
+      });
+    }
+  }
+  while (finds.load() < 10000U) {
+    std::this_thread::yield();
+  }
+  stop = true;
+  for (std::size_t t = 0U; t < readers.size(); t++) {
+    readers[t].join();
+  }
+  REQUIRE(errors.load() == 0U);
+
+  std::uint64_t val;
+  REQUIRE(avl->find(4094U, val));
+  REQUIRE(val == 4094U * 3U);
+  REQUIRE(avl->size() >= 2048U);
+  avl->write([](seqlock_type::container_type& c) { REQUIRE(c.check()); });
+  avl->clear();
+  REQUIRE(avl->size() == 0U);
+  REQUIRE(!avl->find(4094U, val));
+  delete avl;
+}
+
+
+// heap memory source which fails for more than 16 KiB
+struct limited_memory : avl_array_memory_heap
+{
+  inline void* allocate(std::size_t bytes)
+  { return bytes > 16384U ? nullptr : avl_array_memory_heap::allocate(bytes); }
+};
+
+
+TEST_CASE("Seqlock - failed reserve", "[concurrent]" ) {
+  // the value array can't be reserved, insert must not grow the arrays later
+  avl_array_seqlock<std::uint32_t, std::uint64_t, std::uint32_t, 4096U, true, avl_array_layout_soa, false, avl_array_alloc_growing<limited_memory> > avl;
+  REQUIRE(avl.capacity() == 0U);
+  REQUIRE(!avl.insert(1U, 1U));
+  REQUIRE(avl.size() == 0U);
+  std::uint64_t val;
+  REQUIRE(!avl.find(1U, val));
+
+  // the full reserve succeeds
+  avl_array_seqlock<std::uint32_t, std::uint64_t, std::uint32_t, 2048U, true, avl_array_layout_soa, false, avl_array_alloc_growing<limited_memory> > avl_small;
+  REQUIRE(avl_small.capacity() == 2048U);
+  for (std::uint32_t n = 0U; n < 2048U; n++) {
+    REQUIRE(avl_small.insert(n, n));
+  }
+  REQUIRE(avl_small.insert(5U, 50U));
+  REQUIRE(!avl_small.insert(5000U, 1U));
+  REQUIRE(avl_small.find(5U, val));
+  REQUIRE(val == 50U);
+}
+
+
+TEST_CASE("RCU", "[concurrent]" ) {
+  typedef avl_array_rcu<int, int, int, 1024, true, avl_array_layout_soa, false, avl_array_alloc_static, 4U> rcu_type;
+  rcu_type* avl = new rcu_type;
+  REQUIRE(!(reinterpret_cast<std::uintptr_t>(avl) % 64U));   // reader slots are cache line aligned on the heap
+  for (int k = 0; k < 100; k++) {
+    REQUIRE(avl->insert(k, 0));
+  }
+
+  // every batch sets all values to the batch number, readers must never see a partial batch
+  std::atomic<bool>     stop(false);
+  std::atomic<unsigned> errors(0U), reads(0U);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 3; t++) {
+    readers.push_back(std::thread([avl, &stop, &errors, &reads]() {
+      rcu_type::reader reader(*avl);
+      if (!reader.valid()) {
+        errors++;
+        return;
+      }
+      while (!stop.load()) {
+        reader.read([&errors](const rcu_type::container_type& c) {
+          const int batch = *c.begin();
+          int n = 0;
+          for (auto it = c.begin(); it != c.end(); ++it, ++n) {
+            if ((*it != batch) || (it.key() != n)) {
+              errors++;
+            }
+          }
+          if (n != 100) {
+            errors++;
+          }
+        });
+        reads++;
+      }
+    }));
+  }
+
+  for (int batch = 1; batch <= 2000; batch++) {
+    avl->write([batch](rcu_type::container_type& c) {
+      for (int k = 0; k < 100; k++) {
+        c.insert(k, batch);
+      }
+    });
+  }
+  while (reads.load() < 1000U) {
+    std::this_thread::yield();
+  }
+  stop = true;
+  for (std::size_t t = 0U; t < readers.size(); t++) {
+    readers[t].join();
+  }
+  REQUIRE(errors.load() == 0U);
+
+  // both copies are up to date
+  {
+    rcu_type::reader reader(*avl);
+    int val;
+    REQUIRE(reader.find(50, val));
+    REQUIRE(val == 2000);
+    REQUIRE(avl->erase(50));
+    REQUIRE(!reader.find(50, val));
+    REQUIRE(avl->insert(50, 1));
+    REQUIRE(reader.find(50, val));
+    REQUIRE(val == 1);
+    REQUIRE(avl->erase(50));
+    REQUIRE(!reader.find(50, val));
+  }
+
+  // all slots in use
+  {
+    rcu_type::reader r0(*avl), r1(*avl), r2(*avl), r3(*avl), r4(*avl);
+    REQUIRE(r3.valid());
+    REQUIRE(!r4.valid());
+    int val;
+    REQUIRE(!r4.find(1, val));
+    REQUIRE(!r4.read([](const rcu_type::container_type&) { }));
+  }
+  delete avl;
+}
+
+
+TEST_CASE("Sharded", "[concurrent]" ) {
+  typedef avl_array_sharded<int, int, int, 2048, 8> hash_type;
+  hash_type* avl = new hash_type;
+  REQUIRE(!(reinterpret_cast<std::uintptr_t>(avl) % 64U));   // shards are cache line aligned on the heap
+  REQUIRE(avl->empty());
+  REQUIRE(avl->max_size() == 8U * 2048U);
+
+  // writer threads insert disjoint key ranges
+  std::atomic<unsigned> errors(0U);
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; t++) {
+    writers.push_back(std::thread([avl, t, &errors]() {
+      for (int n = 0; n < 2000; n++) {
+        const int k = ((n * 7919) % 2000) * 4 + t;
+        if (!avl->insert(k, -k)) {
+          errors++;
+        }
+      }
+      for (int n = 0; n < 2000; n += 2) {
+        if (!avl->erase(n * 4 + t)) {
+          errors++;
+        }
+      }
+    }));
+  }
+  for (std::size_t t = 0U; t < writers.size(); t++) {
+    writers[t].join();
+  }
+  REQUIRE(errors.load() == 0U);
+  REQUIRE(avl->size() == 4000U);
+
+  int val;
+  REQUIRE(avl->find(4 * 1 + 2, val));
+  REQUIRE(val == -6);
+  REQUIRE(!avl->find(0, val));
+  REQUIRE(avl->count(4 * 3 + 1) == 1);
+  REQUIRE(avl->count(8) == 0);
+
+  // merged iteration in ascending order, odd multiples of 4 plus the thread number
+  int prev = -1, n = 0;
+  for (hash_type::const_iterator it = avl->begin(); it != avl->end(); ++it, ++n) {
+    REQUIRE(prev < it.key());
+    REQUIRE(*it == -it.key());
+    REQUIRE((it.key() / 4) % 2 == 1);
+    prev = it.key();
+  }
+  REQUIRE(n == 4000);
+  prev = -1; n = 0;
+  avl->for_each_sorted([&prev, &n](const int& key, const int&) {
+    if (prev < key) {
+      n++;
+    }
+    prev = key;
+  });
+  REQUIRE(n == 4000);
+
+  avl->clear();
+  REQUIRE(avl->empty());
+  REQUIRE(avl->begin() == avl->end());
+  delete avl;
+
+  // range partition, ascending key ranges per shard, full shard
+  typedef avl_array_sharded<std::int16_t, int, std::uint16_t, 16U, 4U, avl_array_partition_range> range_type;
+  REQUIRE(avl_array_partition_range::shard(static_cast<std::int16_t>(-32768), 4U) == 0U);
+  REQUIRE(avl_array_partition_range::shard(static_cast<std::int16_t>(-1), 4U) == 1U);
+  REQUIRE(avl_array_partition_range::shard(static_cast<std::int16_t>(0), 4U) == 2U);
+  REQUIRE(avl_array_partition_range::shard(static_cast<std::int16_t>(32767), 4U) == 3U);
+  REQUIRE(avl_array_partition_range::shard(static_cast<std::uint32_t>(0xFFFFFFFFU), 3U) == 2U);
+  range_type range;
+  for (int k = -32; k < 32; k++) {
+    REQUIRE(range.insert(static_cast<std::int16_t>(k * 1024), k));
+  }
+  REQUIRE(range.size() == 64U);
+  REQUIRE(!range.insert(static_cast<std::int16_t>(-31500), 0));   // shard 0 full
+  REQUIRE(range.insert(static_cast<std::int16_t>(31 * 1024), 1));     // update
+  n = -32;
+  for (range_type::const_iterator it = range.begin(); it != range.end(); ++it, ++n) {
+    REQUIRE(it.key() == n * 1024);
+    REQUIRE(*it == (n == 31 ? 1 : n));
+  }
+  REQUIRE(n == 32);
+
+  // range partition with a single shard
+  typedef avl_array_sharded<std::int32_t, int, std::uint16_t, 64U, 1U, avl_array_partition_range> single_type;
+  REQUIRE(avl_array_partition_range::shard(static_cast<std::int32_t>(-2147483647 - 1), 1U) == 0U);
+  REQUIRE(avl_array_partition_range::shard(static_cast<std::int32_t>(2147483647), 1U) == 0U);
+  REQUIRE(avl_array_partition_range::shard(static_cast<std::uint64_t>(0xFFFFFFFFFFFFFFFFULL), 1U) == 0U);
+  single_type single;
+  for (int k = 32; k > -32; k--) {
+    REQUIRE(single.insert(k * 65536, k));
+  }
+  REQUIRE(single.size() == 64U);
+  REQUIRE(!single.insert(1, 1));    // the only shard is full
+  REQUIRE(single.count(-31 * 65536) == 1U);
+  n = -31;
+  for (single_type::const_iterator it = single.begin(); it != single.end(); ++it, ++n) {
+    REQUIRE(it.key() == n * 65536);
+    REQUIRE(*it == n);
+  }
+  REQUIRE(n == 33);
+}
+
+
+TEST_CASE("Snapshot", "[snapshot]" ) {
+  avl_array<int, int, int, 1000> avl;
+  avl_array_snapshot<int, int, int, 1000> snap;
+  REQUIRE(snap.freeze(avl));
+  REQUIRE(snap.empty());
+  REQUIRE(snap.begin() == snap.end());
+  REQUIRE(snap.lower_bound(0) == snap.end());
+
+  for (int size = 1; size <= 1000; size = size * 3 + 1) {
+    avl.clear();
+    for (int n = 0; n < size; n++) {
+      REQUIRE(avl.insert(2 * n, n));    // even keys only
+    }
+    REQUIRE(snap.freeze(avl));
+    REQUIRE(snap.size() == size);
+
+    // in order iteration
+    int x = 0;
+    for (auto it = snap.begin(); it != snap.end(); ++it) {
+      REQUIRE(it.key() == 2 * x);
+      REQUIRE(*it == x++);
+    }
+    REQUIRE(x == size);
+
+    int val;
+    for (int k = -1; k <= 2 * size; k++) {
+      if ((k >= 0) && (k < 2 * size) && !(k & 1)) {
+        REQUIRE(snap.find(k, val));
+        REQUIRE(val == k / 2);
+        REQUIRE(snap.find(k).key() == k);
+        REQUIRE(snap.lower_bound(k).key() == k);
+      }
+      else {
+        REQUIRE(!snap.find(k, val));
+        REQUIRE(snap.find(k) == snap.end());
+        if (k < 2 * size - 1) {
+          REQUIRE(snap.lower_bound(k).key() == k + 1);
+        }
+        else {
+          REQUIRE(snap.lower_bound(k) == snap.end());
+        }
+      }
+      if (k < 2 * size - 2) {
+        REQUIRE(snap.upper_bound(k).key() == ((k + 2) & ~1));
+      }
+      else {
+        REQUIRE(snap.upper_bound(k) == snap.end());
+      }
+    }
+  }
+
+  // snapshot too small
+  avl_array_snapshot<int, int, int, 10> small;
+  REQUIRE(!small.freeze(avl));
+
+  // the keys start at a cache line on the heap, position 1 (the root) follows the unused position 0
+  avl_array_snapshot<int, int, int, 1000>* heap = new avl_array_snapshot<int, int, int, 1000>;
+  avl.clear();
+  REQUIRE(avl.insert(1, 1));
+  REQUIRE(heap->freeze(avl));
+  REQUIRE(!((reinterpret_cast<std::uintptr_t>(&heap->begin().key()) - sizeof(int)) % 64U));
+  delete heap;
+
+  // only the actual elements are constructed, no default ctor needed
+  instance_counter::instances = 0;
+  {
+    avl_array<int, instance_counter, int, 1000> src;
+    for (int n = 0; n < 100; n++) {
+      REQUIRE(src.emplace(n, n).second);
+    }
+    avl_array_snapshot<int, instance_counter, int, 1000> snap_inst;
+    REQUIRE(instance_counter::instances == 100);
+    REQUIRE(snap_inst.freeze(src));
+    REQUIRE(instance_counter::instances == 200);
+    REQUIRE(snap_inst.find(42).val().value == 42);
+    REQUIRE(src.erase(42));
+    REQUIRE(snap_inst.freeze(src));
+    REQUIRE(instance_counter::instances == 198);
+    avl_array_snapshot<int, instance_counter, int, 1000> copy(snap_inst);
+    REQUIRE(instance_counter::instances == 297);
+    REQUIRE(copy.find(43).val().value == 43);
+    copy.clear();
+    REQUIRE(instance_counter::instances == 198);
+  }
+  REQUIRE(instance_counter::instances == 0);
+}